@@ -0,0 +1,175 @@
+#include "evaluatorbenchmark.h"
+#include "cpufitnessevaluator.h"
+#include "cudafitnessevaluator.h"
+#include "compressorutils.h"
+#include "mappedfile.h"
+#include "bmpfile.h"
+#include "utils.h"
+#include <random>
+
+using namespace std;
+using namespace lossycompressor;
+
+int EvaluatorBenchmark::run() {
+	vector<string> fileNames;
+	string directoryPath;
+	if (args->imagesDirectoryPath != NULL) {
+		directoryPath = args->imagesDirectoryPath;
+		if (!directoryPath.empty() && directoryPath.back() != '/' && directoryPath.back() != '\\') {
+			directoryPath += '/';
+		}
+		if (!Utils::listFiles(directoryPath, ".bmp", &fileNames)) {
+			fprintf(stderr, "Images directory %s could not be open\n", args->imagesDirectoryPath);
+			return ERROR_FILE_COULD_NOT_OPEN_FILE;
+		}
+	}
+
+	output = stdout;
+	if (args->outputPath != NULL) {
+		errno_t err = fopen_s(&output, args->outputPath, "w");
+		if (err != 0 || output == NULL) {
+			fprintf(stderr, "Output file %s could not be open\n", args->outputPath);
+			return ERROR_FILE_COULD_NOT_OPEN_FILE;
+		}
+	}
+
+	fprintf(output, "evaluator,image,width,height,pixel_format,points,evaluations,time_secs,evaluations_per_sec,ns_per_pixel,"
+		"assignment_ns_per_pixel,accumulation_ns_per_pixel,averaging_ns_per_pixel,error_ns_per_pixel\n");
+	for (int i = 0; i < fileNames.size(); ++i) {
+		measureImageFile(directoryPath, fileNames[i]);
+	}
+	for (int i = 0; i + 1 < args->syntheticSizes.size(); i += 2) {
+		Image image;
+		generateSyntheticImage(args->syntheticSizes[i], args->syntheticSizes[i + 1], &image);
+		measureImage(&image);
+	}
+
+	if (output != stdout) {
+		fclose(output);
+	}
+	return 0;
+}
+
+void EvaluatorBenchmark::measureImageFile(const string & directoryPath, const string & fileName) {
+	MappedFile file;
+	BmpFile::ImageLayout layout;
+	int err = file.open((directoryPath + fileName).c_str());
+	if (err == 0) {
+		err = BmpFile::parse(file.getData(), file.getSize(), &layout);
+	}
+	if (err != 0) {
+		fprintf(stderr, "Image %s could not be read, error code %d\n", fileName.c_str(), err);
+		return;
+	}
+
+	// Pixels are used directly from the mapped file
+	Image image;
+	image.name = fileName;
+	image.width = layout.width;
+	image.height = layout.height;
+	image.data = layout.topRowData;
+	image.rowWidthInBytes = layout.rowStrideInBytes;
+	image.pixelFormat = layout.bytesPerPixel == 1 ? PixelFormat::GRAY8
+		: layout.bytesPerPixel == 3 ? PixelFormat::BGR24 : PixelFormat::BGRA32;
+	measureImage(&image);
+}
+
+void EvaluatorBenchmark::generateSyntheticImage(int32_t width, int32_t height, Image * image) {
+	image->name = "synthetic_" + to_string(width) + "x" + to_string(height);
+	image->width = width;
+	image->height = height;
+	image->rowWidthInBytes = width * 3;
+	image->pixelFormat = PixelFormat::BGR24;
+	image->pixels.resize((size_t)height * image->rowWidthInBytes);
+	image->data = image->pixels.data();
+
+	// Gradients with checkerboard of blocks and noise, so colors of neighbouring points differ
+	mt19937 generator(args->seed);
+	uniform_int_distribution<int> noise(0, 63);
+	for (int32_t i = 0; i < height; ++i) {
+		for (int32_t j = 0; j < width; ++j) {
+			uint8_t * pixel = image->data + (int64_t)i * image->rowWidthInBytes + j * 3;
+			pixel[0] = (uint8_t)((int64_t)j * 255 / width);
+			pixel[1] = (uint8_t)((int64_t)i * 255 / height);
+			pixel[2] = (uint8_t)(((j / 32 + i / 32) % 2) * 128 + noise(generator));
+		}
+	}
+}
+
+void EvaluatorBenchmark::measureImage(Image * image) {
+	// Evaluators are shared by all counts of points that fit into the image
+	int64_t pixelsCount = (int64_t)image->width * image->height;
+	vector<int> pointsCounts;
+	int maxPointsCount = 0;
+	for (int i = 0; i < args->pointsCounts.size(); ++i) {
+		if (args->pointsCounts[i] > 0 && args->pointsCounts[i] <= pixelsCount) {
+			pointsCounts.push_back(args->pointsCounts[i]);
+			maxPointsCount = Utils::max(maxPointsCount, args->pointsCounts[i]);
+		}
+	}
+	if (pointsCounts.empty()) {
+		return;
+	}
+
+	CpuFitnessEvaluator cpuFitnessEvaluator(image->width, image->height, maxPointsCount,
+		image->data, image->rowWidthInBytes, image->pixelFormat);
+	for (int i = 0; i < pointsCounts.size(); ++i) {
+		measure("cpu", &cpuFitnessEvaluator, image, pointsCounts[i]);
+	}
+
+	if (args->useCuda) {
+		CudaFitnessEvaluator cudaFitnessEvaluator(image->width, image->height, maxPointsCount,
+			image->data, image->rowWidthInBytes, image->pixelFormat);
+		for (int i = 0; i < pointsCounts.size(); ++i) {
+			measure("cuda", &cudaFitnessEvaluator, image, pointsCounts[i]);
+		}
+	}
+}
+
+void EvaluatorBenchmark::moveRandomPoint(VoronoiDiagram * diagram, Image * image) {
+	// Point is moved the same way as in local search, so the diagram stays nearly sorted
+	int pointToMove = Utils::generateRandom(diagram->diagramPointsCount - 1);
+	diagram->setPoint(pointToMove, Utils::generateRandom(image->width - 1), Utils::generateRandom(image->height - 1));
+	CompressorUtils::sortDiagramPoints(diagram);
+}
+
+void EvaluatorBenchmark::measure(const char * evaluatorName, FitnessEvaluator * fitnessEvaluator, Image * image, int pointsCount) {
+	Utils::getRandomGenerator().seed(args->seed);
+	VoronoiDiagram diagram(pointsCount);
+	CompressorUtils::generateRandomDiagram(&diagram, image->width, image->height);
+
+	for (int i = 0; i < args->warmUpEvaluationsCount; ++i) {
+		moveRandomPoint(&diagram, image);
+		fitnessEvaluator->calculateFitness(&diagram);
+	}
+
+	FitnessEvaluator::PhaseTimes startPhaseTimes = fitnessEvaluator->getPhaseTimes();
+	int startFitnessCacheMissesCount = fitnessEvaluator->getFitnessCacheMissesCount();
+	LARGE_INTEGER startTime, currentTime;
+	Utils::recordTime(&startTime);
+	double elapsedTimeSecs = 0;
+	for (int i = 0; i < args->minEvaluationsCount || elapsedTimeSecs < args->minMeasurementTimeSecs; ++i) {
+		moveRandomPoint(&diagram, image);
+		fitnessEvaluator->calculateFitness(&diagram);
+		Utils::recordTime(&currentTime);
+		elapsedTimeSecs = Utils::calculateInterval(&startTime, &currentTime);
+	}
+
+	// Diagrams found in the cache are not counted as evaluations
+	FitnessEvaluator::PhaseTimes phaseTimes = fitnessEvaluator->getPhaseTimes();
+	int evaluationsCount = fitnessEvaluator->getFitnessCacheMissesCount() - startFitnessCacheMissesCount;
+	double evaluatedPixelsCount = (double)evaluationsCount * image->width * image->height;
+	double nanosPerPixel = evaluatedPixelsCount > 0 ? 1e9 / evaluatedPixelsCount : 0;
+	const char * pixelFormatName = image->pixelFormat == PixelFormat::GRAY8 ? "gray8"
+		: image->pixelFormat == PixelFormat::BGR24 ? "bgr24" : "bgra32";
+
+	fprintf(output, "%s,%s,%d,%d,%s,%d,%d,%.6f,%.2f,%.4f,%.4f,%.4f,%.4f,%.4f\n",
+		evaluatorName, image->name.c_str(), image->width, image->height, pixelFormatName, pointsCount,
+		evaluationsCount, elapsedTimeSecs, elapsedTimeSecs > 0 ? evaluationsCount / elapsedTimeSecs : 0,
+		elapsedTimeSecs * nanosPerPixel,
+		(phaseTimes.assignmentSecs - startPhaseTimes.assignmentSecs) * nanosPerPixel,
+		(phaseTimes.accumulationSecs - startPhaseTimes.accumulationSecs) * nanosPerPixel,
+		(phaseTimes.averagingSecs - startPhaseTimes.averagingSecs) * nanosPerPixel,
+		(phaseTimes.errorSecs - startPhaseTimes.errorSecs) * nanosPerPixel);
+	fflush(output);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "fitnessevaluator.h"
+#include "pixelformat.h"
+
+namespace lossycompressor {
+
+	/// Class measuring speed of fitness evaluators.
+	/**
+		Every evaluator is measured on every BMP image in a directory and on synthetic images
+		of given sizes, for every count of points that is not larger than the count of pixels.
+		Measurement starts from a random diagram and moves one random point before every evaluation,
+		same as local search, so no fitness value is found in the cache. Random number generator
+		is seeded by the same seed before every measurement, so every evaluator gets the same diagrams.
+		Warm-up evaluations are not measured, measured evaluations continue until both minimal count
+		and minimal time are reached.
+
+		Results are written as CSV with one line per measurement:
+
+			evaluator,image,width,height,pixel_format,points,evaluations,time_secs,evaluations_per_sec,ns_per_pixel,
+			assignment_ns_per_pixel,accumulation_ns_per_pixel,averaging_ns_per_pixel,error_ns_per_pixel
+
+		where the last four columns are the phases measured by the evaluator, see FitnessEvaluator::PhaseTimes.
+	*/
+	class EvaluatorBenchmark {
+	public:
+		/// Instance of this class is passed as a parameter into EvaluatorBenchmark.
+		struct Args {
+			const char * imagesDirectoryPath = "../test_images";		///< Directory with BMP images, bundled images from the Benchmark directory by default, no image is read if NULL.
+			const char * outputPath = NULL;								///< Path of the CSV file with results, results are written into the standard output if NULL.
+			std::vector<int> pointsCounts = { 100, 500, 2000, 5000, 20000 };	///< Counts of points of measured diagrams.
+			std::vector<int32_t> syntheticSizes = { 256, 256, 640, 480, 1280, 720 };	///< Width and height of every synthetic image.
+			int warmUpEvaluationsCount = 2;								///< Count of evaluations before the measurement.
+			int minEvaluationsCount = 5;								///< Minimal count of measured evaluations.
+			double minMeasurementTimeSecs = 1;							///< Minimal time of measured evaluations.
+			uint32_t seed = 1;											///< Seed of random diagrams and synthetic images.
+			bool useCuda = false;										///< True if the evaluator accelerated by CUDA should be measured too.
+		};
+	private:
+		// Image in memory, pixels of synthetic images are owned by it
+		struct Image {
+			std::string name;
+			int32_t width;
+			int32_t height;
+			uint8_t * data;
+			int rowWidthInBytes;
+			PixelFormat pixelFormat;
+			std::vector<uint8_t> pixels;
+		};
+
+		EvaluatorBenchmark::Args * args;
+		FILE * output;
+
+		// Reports images that could not be read and skips them
+		void measureImageFile(const std::string & directoryPath, const std::string & fileName);
+		void generateSyntheticImage(int32_t width, int32_t height, Image * image);
+		void measureImage(Image * image);
+		// Moves a random point of the diagram to a random position, so its fitness is not in the cache
+		void moveRandomPoint(VoronoiDiagram * diagram, Image * image);
+		void measure(const char * evaluatorName, FitnessEvaluator * fitnessEvaluator, Image * image, int pointsCount);
+	public:
+		static const int ERROR_FILE_COULD_NOT_OPEN_FILE = 2;		///< Benchmark error code. Images directory or output file could not be open.
+
+		/// Construct a new EvaluatorBenchmark with given arguments.
+		EvaluatorBenchmark(EvaluatorBenchmark::Args * args) : args(args) {};
+
+		/// Measure all evaluators on all images and write the results.
+		/**
+			Images that could not be read are reported to the standard error and skipped,
+			so they do not mix with results written into the standard output.
+
+			\return	0 if successfull, error code of this class otherwise.
+		*/
+		int run();
+	};
+}
@@ -0,0 +1,80 @@
+#include "evaluatorbenchmark.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+using namespace std;
+using namespace lossycompressor;
+
+// Parses comma separated positive integers
+bool parseIntegers(const char * text, vector<int> * values) {
+	values->clear();
+	istringstream stream(text);
+	string value;
+	while (getline(stream, value, ',')) {
+		int parsed = atoi(value.c_str());
+		if (parsed <= 0) {
+			return false;
+		}
+		values->push_back(parsed);
+	}
+	return !values->empty();
+}
+
+int main(int argc, char* argv[]) {
+	EvaluatorBenchmark::Args benchmarkArgs;
+	benchmarkArgs.useCuda = true;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--images") == 0 && i + 1 < argc) {
+			benchmarkArgs.imagesDirectoryPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--no-images") == 0) {
+			benchmarkArgs.imagesDirectoryPath = NULL;
+		}
+		else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+			benchmarkArgs.outputPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--points") == 0 && i + 1 < argc) {
+			if (!parseIntegers(argv[++i], &benchmarkArgs.pointsCounts)) {
+				printf("Invalid counts of points %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--synthetic") == 0 && i + 1 < argc) {
+			vector<int> sizes;
+			if (!parseIntegers(argv[++i], &sizes) || sizes.size() % 2 != 0) {
+				printf("Invalid sizes of synthetic images %s\n", argv[i]);
+				return 1;
+			}
+			benchmarkArgs.syntheticSizes.assign(sizes.begin(), sizes.end());
+		}
+		else if (strcmp(argv[i], "--no-synthetic") == 0) {
+			benchmarkArgs.syntheticSizes.clear();
+		}
+		else if (strcmp(argv[i], "--warm-up") == 0 && i + 1 < argc) {
+			benchmarkArgs.warmUpEvaluationsCount = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--min-evaluations") == 0 && i + 1 < argc) {
+			benchmarkArgs.minEvaluationsCount = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+			benchmarkArgs.minMeasurementTimeSecs = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			benchmarkArgs.seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+		}
+		else if (strcmp(argv[i], "--cpu-only") == 0) {
+			benchmarkArgs.useCuda = false;
+		}
+		else {
+			printf("Usage: [--images directory_path | --no-images] [--output csv_path] [--points count,count,...]\n");
+			printf("       [--synthetic width,height,width,height,... | --no-synthetic] [--warm-up evaluations_count]\n");
+			printf("       [--min-evaluations evaluations_count] [--min-time secs] [--seed seed] [--cpu-only]\n");
+			return 1;
+		}
+	}
+
+	EvaluatorBenchmark benchmark(&benchmarkArgs);
+	return benchmark.run();
+}
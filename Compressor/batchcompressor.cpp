@@ -0,0 +1,231 @@
+#include "batchcompressor.h"
+#include "mappedfile.h"
+#include "utils.h"
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+using namespace lossycompressor;
+
+int BatchCompressor::compress() {
+	jobs.clear();
+	int err = Utils::isDirectory(args->manifestPath) ? readDirectory() : readManifest();
+	if (err != 0) {
+		return err;
+	}
+
+	// Sizes of source files are known without reading their headers
+	for (int i = 0; i < jobs.size(); ++i) {
+		MappedFile sourceFile;
+		jobs[i].sourceFileSize = sourceFile.open(jobs[i].sourceImagePath.c_str()) == 0 ? sourceFile.getSize() : 0;
+	}
+
+	// Largest jobs go first, so buffers of evaluators allocated by the first job of a thread fit its next jobs
+	vector<int> jobOrder(jobs.size());
+	for (int i = 0; i < jobs.size(); ++i) {
+		jobOrder[i] = i;
+	}
+	stable_sort(jobOrder.begin(), jobOrder.end(), [this](int first, int second) {
+		return jobs[first].sourceFileSize > jobs[second].sourceFileSize;
+	});
+
+	int threadCount = args->threadCount > 0 ? args->threadCount : Utils::max(1, (int)thread::hardware_concurrency());
+	threadCount = Utils::max(1, min(threadCount, (int)jobs.size()));
+	vector<JobQueue> queues(threadCount);
+	for (int i = 0; i < threadCount; ++i) {
+		int startJob = (int)((int64_t)jobs.size() * i / threadCount);
+		int endJob = (int)((int64_t)jobs.size() * (i + 1) / threadCount);
+		queues[i].jobIndices.assign(jobOrder.begin() + startJob, jobOrder.begin() + endJob);
+	}
+
+	vector<thread> threads;
+	for (int i = 1; i < threadCount; ++i) {
+		threads.push_back(thread(&BatchCompressor::runJobs, this, &queues, i));
+	}
+	runJobs(&queues, 0);
+	for (int i = 0; i < threads.size(); ++i) {
+		threads[i].join();
+	}
+
+	return writeSummary();
+}
+
+int BatchCompressor::readManifest() {
+	FILE * file;
+	errno_t err = fopen_s(&file, args->manifestPath, "r");
+	if (err != 0 || file == NULL) {
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+
+	int lineNumber = 0;
+	char lineBuffer[MAX_LINE_LENGTH];
+	while (fgets(lineBuffer, sizeof(lineBuffer), file) != NULL) {
+		++lineNumber;
+		string line(lineBuffer);
+		// Longer line would be split into several bogus jobs
+		if (line.empty() || (line.back() != '\n' && !feof(file))) {
+			printf("Line %d of the manifest is longer than %d characters\n", lineNumber, MAX_LINE_LENGTH - 1);
+			fclose(file);
+			return ERROR_INVALID_MANIFEST;
+		}
+		line.erase(line.find_last_not_of(" \t\r\n") + 1);
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+
+		vector<string> values;
+		stringstream lineStream(line);
+		string value;
+		while (getline(lineStream, value, ',')) {
+			values.push_back(value);
+		}
+
+		Job job;
+		job.maxCompressedSizeBytes = args->maxCompressedSizeBytes;
+		job.computationType = args->computationType;
+		bool isValid = values.size() >= 3 && values.size() <= 5;
+		if (isValid) {
+			job.sourceImagePath = values[0];
+			job.destinationCompressedPath = values[1];
+			job.destinationImagePath = values[2];
+			isValid = !job.sourceImagePath.empty() && !job.destinationCompressedPath.empty() && !job.destinationImagePath.empty();
+		}
+		if (isValid && values.size() >= 4 && !values[3].empty()) {
+			char * end;
+			unsigned long size = strtoul(values[3].c_str(), &end, 10);
+			isValid = *end == '\0' && size > 0 && size <= UINT32_MAX;
+			job.maxCompressedSizeBytes = (uint32_t)size;
+		}
+		if (isValid && values.size() == 5 && !values[4].empty()) {
+			isValid = Compressor::parseComputationType(values[4].c_str(), &job.computationType);
+		}
+		if (!isValid) {
+			printf("Invalid job on line %d of the manifest\n", lineNumber);
+			fclose(file);
+			return ERROR_INVALID_MANIFEST;
+		}
+		jobs.push_back(job);
+	}
+
+	fclose(file);
+	return 0;
+}
+
+int BatchCompressor::readDirectory() {
+	string directoryPath = args->manifestPath;
+	if (!directoryPath.empty() && directoryPath.back() != '/' && directoryPath.back() != '\\') {
+		directoryPath += '/';
+	}
+
+	vector<string> fileNames;
+	if (!Utils::listFiles(directoryPath, ".bmp", &fileNames)) {
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+
+	// Reconstructed images of earlier runs are not compressed again
+	for (int i = 0; i < fileNames.size(); ++i) {
+		if (fileNames[i].size() > 8 && fileNames[i].compare(fileNames[i].size() - 8, 8, ".vor.bmp") == 0) {
+			continue;
+		}
+		Job job;
+		job.sourceImagePath = directoryPath + fileNames[i];
+		job.destinationCompressedPath = job.sourceImagePath + ".vor";
+		job.destinationImagePath = job.sourceImagePath + ".vor.bmp";
+		job.maxCompressedSizeBytes = args->maxCompressedSizeBytes;
+		job.computationType = args->computationType;
+		jobs.push_back(job);
+	}
+	return 0;
+}
+
+bool BatchCompressor::takeJob(vector<JobQueue> * queues, int threadIndex, int * jobIndex) {
+	int queuesCount = (int)queues->size();
+	for (int i = 0; i < queuesCount; ++i) {
+		JobQueue & queue = (*queues)[(threadIndex + i) % queuesCount];
+		lock_guard<mutex> lock(queue.mutex);
+		if (queue.jobIndices.empty()) {
+			continue;
+		}
+		// Own jobs are taken from the start, jobs of other threads from the end
+		if (i == 0) {
+			*jobIndex = queue.jobIndices.front();
+			queue.jobIndices.pop_front();
+		}
+		else {
+			*jobIndex = queue.jobIndices.back();
+			queue.jobIndices.pop_back();
+		}
+		return true;
+	}
+	return false;
+}
+
+void BatchCompressor::runJobs(vector<JobQueue> * queues, int threadIndex) {
+	Compressor::ReusedFitnessEvaluators reusedFitnessEvaluators;
+	int jobIndex;
+	while (takeJob(queues, threadIndex, &jobIndex)) {
+		runJob(&jobs[jobIndex], &reusedFitnessEvaluators);
+	}
+	reusedFitnessEvaluators.release();
+}
+
+void BatchCompressor::runJob(Job * job, Compressor::ReusedFitnessEvaluators * reusedFitnessEvaluators) {
+	Compressor::Args compressorArgs;
+	compressorArgs.sourceImagePath = job->sourceImagePath.c_str();
+	compressorArgs.destinationCompressedPath = job->destinationCompressedPath.c_str();
+	compressorArgs.destinationImagePath = job->destinationImagePath.c_str();
+	compressorArgs.maxCompressedSizeBytes = job->maxCompressedSizeBytes;
+	compressorArgs.computationType = job->computationType;
+	compressorArgs.computationLimit = args->computationLimit;
+	compressorArgs.maxComputationTimeSecs = args->maxComputationTimeSecs;
+	compressorArgs.maxFitnessEvaluationCount = args->maxFitnessEvaluationCount;
+	compressorArgs.useCuda = args->useCuda;
+	compressorArgs.logImprovementToConsole = false;
+	compressorArgs.reusedFitnessEvaluators = reusedFitnessEvaluators;
+
+	LARGE_INTEGER startTime, endTime;
+	Utils::recordTime(&startTime);
+	Compressor compressor(&compressorArgs);
+	job->err = compressor.compress();
+	Utils::recordTime(&endTime);
+
+	job->computationTimeSecs = Utils::calculateInterval(&startTime, &endTime);
+	job->fitnessEvaluationsCount = compressor.getFitnessEvaluationsCount();
+	job->fitness = compressor.getFitness();
+	printf("Compressing %s finished with code %d in %.4f seconds\n",
+		job->sourceImagePath.c_str(), job->err, job->computationTimeSecs);
+}
+
+int BatchCompressor::writeSummary() {
+	FILE * file;
+	errno_t err = fopen_s(&file, args->summaryPath, "w");
+	if (err != 0 || file == NULL) {
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+
+	fprintf(file, "source_image_path,compressed_path,max_size_in_bytes,algorithm,error,time_secs,fitness_evaluations,fitness\n");
+	for (int i = 0; i < jobs.size(); ++i) {
+		Job & job = jobs[i];
+		fprintf(file, "%s,%s,%u,%s,%d,%.4f,%d,%f\n",
+			Utils::quoteCsvField(job.sourceImagePath).c_str(), Utils::quoteCsvField(job.destinationCompressedPath).c_str(), job.maxCompressedSizeBytes,
+			Compressor::getComputationTypeName(job.computationType), job.err, job.computationTimeSecs,
+			job.fitnessEvaluationsCount, job.fitness);
+	}
+
+	fflush(file);
+	fclose(file);
+	return 0;
+}
+
+int BatchCompressor::getFailedJobsCount() {
+	int failedJobsCount = 0;
+	for (int i = 0; i < jobs.size(); ++i) {
+		if (jobs[i].err != 0) {
+			++failedJobsCount;
+		}
+	}
+	return failedJobsCount;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include "compressor.h"
+
+namespace lossycompressor {
+
+	/// Class compressing many images in one process.
+	/**
+		Jobs are read from a manifest file or created for every BMP image in a directory.
+		Manifest has one job per line with comma separated values:
+
+			source_image_path,compressed_path,compressed_image_path[,max_size_in_bytes[,algorithm]]
+
+		where algorithm is one of local_search, evolutionary, memetic, iterated_local_search
+		and differential_evolution. Empty lines and lines starting with # are skipped,
+		missing values are taken from the arguments. Paths in the summary are quoted. Images in a directory are compressed
+		into files with added extensions .vor and .vor.bmp next to them.
+
+		Jobs are ordered by the size of their source files and split into runs of consecutive
+		jobs, one for every thread. Thread takes jobs from the start of its own run, when it has
+		no jobs left it takes them from the end of the run of another thread. Every thread reuses
+		its fitness evaluators, so images of similar size are compressed without new allocations.
+
+		Summary of all jobs is written at the end into CSV file.
+	*/
+	class BatchCompressor {
+	public:
+		/// Instance of this class is passed as a parameter into BatchCompressor.
+		struct Args {
+			const char * manifestPath;													///< Path of the manifest file or of the directory with compressed images.
+			const char * summaryPath;													///< Path of the CSV file into which summary of jobs is written.
+			uint32_t maxCompressedSizeBytes = 4000;										///< Maximum size of compressed files of jobs without their own size.
+			Compressor::ComputationType computationType = Compressor::ComputationType::LOCAL_SEARCH;	///< Type of computation of jobs without their own algorithm.
+			Compressor::ComputationLimit computationLimit = Compressor::ComputationLimit::TIME;		///< Type of computation limit of every job.
+			double maxComputationTimeSecs = 60;											///< Time limit of every job.
+			int maxFitnessEvaluationCount = 40000;										///< Limit on fitness evaluation of every job.
+			bool useCuda = false;														///< True if CUDA acceleration should be used, false otherwise.
+			int threadCount = 0;														///< Count of jobs compressed in parallel, count of hardware threads if 0.
+		};
+	private:
+		static const int MAX_LINE_LENGTH = 4096;
+
+		// Compression of one image
+		struct Job {
+			std::string sourceImagePath;
+			std::string destinationCompressedPath;
+			std::string destinationImagePath;
+			uint32_t maxCompressedSizeBytes;
+			Compressor::ComputationType computationType;
+			size_t sourceFileSize = 0;
+
+			// Results
+			int err = 0;
+			double computationTimeSecs = 0;
+			int fitnessEvaluationsCount = 0;
+			float fitness = -1;
+		};
+
+		// Jobs of one thread, other threads take jobs from its end
+		struct JobQueue {
+			std::deque<int> jobIndices;
+			std::mutex mutex;
+		};
+
+		BatchCompressor::Args * args;
+		std::vector<Job> jobs;
+
+		int readManifest();
+		int readDirectory();
+
+		// Takes the next job of the thread or a job of another thread, returns false if no job is left
+		bool takeJob(std::vector<JobQueue> * queues, int threadIndex, int * jobIndex);
+		void runJobs(std::vector<JobQueue> * queues, int threadIndex);
+		void runJob(Job * job, Compressor::ReusedFitnessEvaluators * reusedFitnessEvaluators);
+		int writeSummary();
+	public:
+		static const int ERROR_FILE_COULD_NOT_OPEN_FILE = 2;		///< Batch compression error code. Manifest, directory or summary file could not be open.
+		static const int ERROR_INVALID_MANIFEST = 14;				///< Batch compression error code. Manifest contains a line with missing paths, invalid size or unknown algorithm, or a line longer than 4095 characters.
+
+		/// Construct a new BatchCompressor with given arguments.
+		BatchCompressor(BatchCompressor::Args * args) : args(args) {};
+
+		/// Compress all jobs and write the summary.
+		/**
+			Failed jobs do not stop the others, their error codes are written in the summary.
+
+			\return	0 if the summary was written, error code of this class otherwise.
+		*/
+		int compress();
+
+		/// Returns count of jobs whose compression failed.
+		int getFailedJobsCount();
+	};
+}
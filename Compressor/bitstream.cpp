@@ -0,0 +1,141 @@
+#include "bitstream.h"
+
+using namespace std;
+using namespace lossycompressor;
+
+void BitWriter::writeBits(uint32_t value, int bitCount) {
+	for (int i = bitCount - 1; i >= 0; --i) {
+		if (this->bitCount % 8 == 0) {
+			data.push_back(0);
+		}
+		if ((value >> i) & 1) {
+			data.back() |= (uint8_t)(0x80 >> (this->bitCount % 8));
+		}
+		++this->bitCount;
+	}
+}
+
+void BitWriter::writeExpGolomb(uint32_t value, int order) {
+	// Value shifted by 2^order is written in binary and prefixed by zeros,
+	// count of the zeros tells the reader how long the binary part is
+	uint64_t shiftedValue = (uint64_t)value + ((uint64_t)1 << order);
+	int valueBitCount = 0;
+	while ((shiftedValue >> valueBitCount) > 0) {
+		++valueBitCount;
+	}
+
+	for (int i = 0; i < valueBitCount - 1 - order; ++i) {
+		writeBits(0, 1);
+	}
+	if (valueBitCount > 32) {
+		writeBits((uint32_t)(shiftedValue >> 32), valueBitCount - 32);
+		writeBits((uint32_t)shiftedValue, 32);
+	}
+	else {
+		writeBits((uint32_t)shiftedValue, valueBitCount);
+	}
+}
+
+void BitWriter::writeVarint(uint32_t value) {
+	while (value >= 0x80) {
+		writeBits((value & 0x7F) | 0x80, 8);
+		value >>= 7;
+	}
+	writeBits(value, 8);
+}
+
+uint64_t BitWriter::getBitCount() {
+	return bitCount;
+}
+
+const vector<uint8_t> & BitWriter::getData() {
+	return data;
+}
+
+int BitWriter::calculateExpGolombBitCount(uint32_t value, int order) {
+	uint64_t shiftedValue = (uint64_t)value + ((uint64_t)1 << order);
+	int valueBitCount = 0;
+	while ((shiftedValue >> valueBitCount) > 0) {
+		++valueBitCount;
+	}
+	return 2 * valueBitCount - 1 - order;
+}
+
+int BitWriter::calculateVarintByteCount(uint32_t value) {
+	int byteCount = 1;
+	while (value >= 0x80) {
+		value >>= 7;
+		++byteCount;
+	}
+	return byteCount;
+}
+
+int BitWriter::calculateBitCount(uint32_t valuesCount) {
+	int bitCount = 0;
+	while (bitCount < 32 && ((uint64_t)1 << bitCount) < valuesCount) {
+		++bitCount;
+	}
+	return bitCount;
+}
+
+uint32_t BitReader::readBits(int bitCount) {
+	uint32_t value = 0;
+	for (int i = 0; i < bitCount; ++i) {
+		value <<= 1;
+		if (position >= (uint64_t)dataSize * 8) {
+			overflow = true;
+			continue;
+		}
+		value |= (data[position / 8] >> (7 - position % 8)) & 1;
+		++position;
+	}
+	return value;
+}
+
+uint32_t BitReader::readExpGolomb(int order) {
+	int leadingZerosCount = 0;
+	while (readBits(1) == 0) {
+		if (overflow || leadingZerosCount > 32) {
+			overflow = true;
+			return 0;
+		}
+		++leadingZerosCount;
+	}
+
+	// The leading one bit was already read
+	int remainingBitCount = leadingZerosCount + order;
+	uint64_t shiftedValue = 1;
+	if (remainingBitCount > 32) {
+		shiftedValue = (shiftedValue << (remainingBitCount - 32)) | readBits(remainingBitCount - 32);
+		shiftedValue = (shiftedValue << 32) | readBits(32);
+	}
+	else {
+		shiftedValue = (shiftedValue << remainingBitCount) | readBits(remainingBitCount);
+	}
+	return (uint32_t)(shiftedValue - ((uint64_t)1 << order));
+}
+
+uint32_t BitReader::readVarint() {
+	uint32_t value = 0;
+	for (int shift = 0; shift < 35; shift += 7) {
+		uint32_t byte = readBits(8);
+		value |= (byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0 || overflow) {
+			return value;
+		}
+	}
+	overflow = true;
+	return value;
+}
+
+uint64_t BitReader::getPosition() {
+	return position;
+}
+
+void BitReader::seek(uint64_t position) {
+	this->position = position;
+}
+
+bool BitReader::hasOverflown() {
+	return overflow;
+}
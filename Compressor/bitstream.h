@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace lossycompressor {
+
+	/// Writes values bit by bit into a growing byte buffer.
+	/**
+		Bits are written from the most significant bit of every byte.
+		Unused bits of the last byte are zero.
+	*/
+	class BitWriter {
+		std::vector<uint8_t> data;
+		uint64_t bitCount = 0;
+	public:
+		/// Write lowest bitCount bits of the value, most significant bit first.
+		/**
+			\param[in] value	Value to write.
+			\param[in] bitCount	Count of bits to write, at most 32.
+		*/
+		void writeBits(uint32_t value, int bitCount);
+
+		/// Write the value in Exp-Golomb code of given order.
+		void writeExpGolomb(uint32_t value, int order);
+
+		/// Write the value as a sequence of 7 bit groups, every byte must be aligned.
+		void writeVarint(uint32_t value);
+
+		/// Returns the count of bits written so far.
+		uint64_t getBitCount();
+
+		/// Returns the written bytes.
+		const std::vector<uint8_t> & getData();
+
+		/// Returns the count of bits the value takes in Exp-Golomb code of given order.
+		static int calculateExpGolombBitCount(uint32_t value, int order);
+
+		/// Returns the count of bytes the value takes as varint.
+		static int calculateVarintByteCount(uint32_t value);
+
+		/// Returns the count of bits needed to store values from 0 to valuesCount - 1.
+		static int calculateBitCount(uint32_t valuesCount);
+	};
+
+	/// Reads values written by BitWriter.
+	/**
+		Reading past the end of the data sets the overflow flag and returns zeros.
+	*/
+	class BitReader {
+		const uint8_t * data;
+		size_t dataSize;
+		uint64_t position = 0;
+		bool overflow = false;
+	public:
+		/// Construct a reader of given data.
+		BitReader(const uint8_t * data, size_t dataSize) : data(data), dataSize(dataSize) {};
+
+		/// Read given count of bits, at most 32.
+		uint32_t readBits(int bitCount);
+
+		/// Read a value in Exp-Golomb code of given order.
+		uint32_t readExpGolomb(int order);
+
+		/// Read a varint, position must be aligned to a byte.
+		uint32_t readVarint();
+
+		/// Returns position of the next read bit.
+		uint64_t getPosition();
+
+		/// Moves to given bit position.
+		void seek(uint64_t position);
+
+		/// Returns true if reading went past the end of the data.
+		bool hasOverflown();
+	};
+}
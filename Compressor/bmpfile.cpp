@@ -0,0 +1,200 @@
+#include "bmpfile.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+using namespace lossycompressor;
+
+int BmpFile::parse(uint8_t * data, size_t dataSize, ImageLayout * layout) {
+	if (dataSize < BITMAP_FILE_HEADER_SIZE + BITMAP_INFO_HEADER_SIZE || data[0] != 'B' || data[1] != 'M') {
+		return ERROR_INVALID_BMP_HEADER;
+	}
+
+	uint32_t pixelDataOffset;
+	memcpy(&pixelDataOffset, &data[10], 4);
+	// Later versions of the info header start with the same fields
+	uint8_t * infoHeader = &data[BITMAP_FILE_HEADER_SIZE];
+	uint32_t infoHeaderSize;
+	int32_t width;
+	int32_t height;
+	uint16_t planesCount;
+	uint16_t colorDepth;
+	uint32_t compression;
+	memcpy(&infoHeaderSize, &infoHeader[0], 4);
+	memcpy(&width, &infoHeader[4], 4);
+	memcpy(&height, &infoHeader[8], 4);
+	memcpy(&planesCount, &infoHeader[12], 2);
+	memcpy(&colorDepth, &infoHeader[14], 2);
+	memcpy(&compression, &infoHeader[16], 4);
+	if (infoHeaderSize < BITMAP_INFO_HEADER_SIZE || width <= 0 || height == 0 || height == INT32_MIN || planesCount != 1) {
+		return ERROR_INVALID_BMP_HEADER;
+	}
+	if (colorDepth != 8 && colorDepth != 24 && colorDepth != 32) {
+		return ERROR_UNSUPPORTED_COLOR_DEPTH;
+	}
+
+	// Palette of 8 bit image must map indices to the same gray levels, colors are 4 bytes (b, g, r, 0)
+	if (colorDepth == 8) {
+		uint32_t paletteSize;
+		memcpy(&paletteSize, &infoHeader[32], 4);
+		if (paletteSize == 0) {
+			paletteSize = 256;
+		}
+		uint64_t paletteOffset = (uint64_t)BITMAP_FILE_HEADER_SIZE + infoHeaderSize;
+		if (paletteSize > 256 || paletteOffset + paletteSize * 4 > dataSize) {
+			return ERROR_INVALID_BMP_HEADER;
+		}
+		for (uint32_t i = 0; i < paletteSize; ++i) {
+			uint8_t * paletteColor = &data[paletteOffset + i * 4];
+			if (paletteColor[0] != i || paletteColor[1] != i || paletteColor[2] != i) {
+				return ERROR_UNSUPPORTED_COLOR_DEPTH;
+			}
+		}
+	}
+
+	// Bit fields are accepted only if they keep the byte order (b, g, r, a),
+	// they follow the basic info header or they are a part of the later versions
+	if (compression == COMPRESSION_BITFIELDS && colorDepth == 32) {
+		size_t masksOffset = BITMAP_FILE_HEADER_SIZE + BITMAP_INFO_HEADER_SIZE;
+		uint32_t masks[3];
+		if (masksOffset + sizeof(masks) > dataSize) {
+			return ERROR_INVALID_BMP_HEADER;
+		}
+		memcpy(masks, &data[masksOffset], sizeof(masks));
+		if (masks[0] != 0x00FF0000 || masks[1] != 0x0000FF00 || masks[2] != 0x000000FF) {
+			return ERROR_UNSUPPORTED_IMAGE_COMPRESSION;
+		}
+	}
+	else if (compression != COMPRESSION_NONE) {
+		return ERROR_UNSUPPORTED_IMAGE_COMPRESSION;
+	}
+
+	// Rows are padded to multiples of 4 bytes
+	int64_t rowWidthInBytes = ((colorDepth * (int64_t)width + 31) / 32) * 4;
+	int64_t rowsCount = height < 0 ? -(int64_t)height : height;
+	if (rowWidthInBytes > INT32_MAX || pixelDataOffset > dataSize
+		|| (uint64_t)(dataSize - pixelDataOffset) < (uint64_t)(rowWidthInBytes * rowsCount)) {
+		return ERROR_INVALID_BMP_HEADER;
+	}
+
+	layout->width = width;
+	layout->height = (int32_t)rowsCount;
+	layout->bytesPerPixel = colorDepth / 8;
+	layout->isTopDown = height < 0;
+	layout->rowStrideInBytes = (int)(layout->isTopDown ? rowWidthInBytes : -rowWidthInBytes);
+	layout->topRowData = data + pixelDataOffset + (layout->isTopDown ? 0 : (rowsCount - 1) * rowWidthInBytes);
+	return 0;
+}
+
+int BmpFile::write(const char * path, int32_t width, int32_t height,
+	uint8_t * imageData, int rowWidthInBytes) {
+
+	FILE* file;
+	errno_t err = fopen_s(
+		&file,
+		path,
+		"wb");
+	if (err != 0 || file == NULL) {
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+
+	// Positive height means rows are stored from bottom to top
+	writeHeaders(file, width, height);
+	for (int32_t i = height - 1; i >= 0; --i) {
+		writeRows(file, width, 1, imageData + (int64_t)i * rowWidthInBytes, rowWidthInBytes);
+	}
+
+	fflush(file);
+	fclose(file);
+	return 0;
+}
+
+int BmpFile::beginWrite(const char * path, int32_t width, int32_t height, FILE ** file) {
+	errno_t err = fopen_s(
+		file,
+		path,
+		"wb");
+	if (err != 0 || *file == NULL) {
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+
+	// Negative height means rows are stored from top to bottom
+	writeHeaders(*file, width, -height);
+	return 0;
+}
+
+void BmpFile::writeRows(FILE * file, int32_t width, int32_t rowsCount,
+	uint8_t * imageData, int rowWidthInBytes) {
+
+	int fileRowWidthInBytes = calculateRowWidthInBytes(width);
+	uint8_t rowPadding[3] = { 0 };
+	for (int32_t i = 0; i < rowsCount; ++i) {
+		fwrite(imageData + (int64_t)i * rowWidthInBytes, 1, width * 3, file);
+		if (fileRowWidthInBytes > width * 3) {
+			fwrite(rowPadding, 1, fileRowWidthInBytes - width * 3, file);
+		}
+	}
+}
+
+void BmpFile::endWrite(FILE * file) {
+	fflush(file);
+	fclose(file);
+}
+
+void BmpFile::writeHeaders(FILE * file, int32_t width, int32_t height) {
+	int64_t rowsCount = height < 0 ? -(int64_t)height : height;
+	uint64_t pixelDataSize = (uint64_t)calculateRowWidthInBytes(width) * rowsCount;
+	uint32_t pixelDataOffset = BITMAP_FILE_HEADER_SIZE + BITMAP_INFO_HEADER_SIZE;
+	uint64_t totalFileSize = pixelDataOffset + pixelDataSize;
+	// Sizes of images over 4 GB do not fit in the headers, 0 is allowed for uncompressed images
+	uint32_t storedPixelDataSize = totalFileSize > UINT32_MAX ? 0 : (uint32_t)pixelDataSize;
+	uint32_t storedTotalFileSize = totalFileSize > UINT32_MAX ? 0 : (uint32_t)totalFileSize;
+
+	uint8_t header[BITMAP_FILE_HEADER_SIZE + BITMAP_INFO_HEADER_SIZE] = { 0 };
+	// Bitmap File Header
+	header[0] = 'B';
+	header[1] = 'M';
+	memcpy(&header[2], &storedTotalFileSize, 4);
+	memcpy(&header[10], &pixelDataOffset, 4);
+	// Bitmap Info Header
+	uint8_t * infoHeader = &header[BITMAP_FILE_HEADER_SIZE];
+	uint32_t infoHeaderSize = BITMAP_INFO_HEADER_SIZE;
+	uint16_t planesCount = 1;
+	uint16_t colorDepth = COLOR_DEPTH;
+	int32_t pixelsPerMeter = 2835;
+	memcpy(&infoHeader[0], &infoHeaderSize, 4);
+	memcpy(&infoHeader[4], &width, 4);
+	memcpy(&infoHeader[8], &height, 4);
+	memcpy(&infoHeader[12], &planesCount, 2);
+	memcpy(&infoHeader[14], &colorDepth, 2);
+	memcpy(&infoHeader[20], &storedPixelDataSize, 4);
+	memcpy(&infoHeader[24], &pixelsPerMeter, 4);
+	memcpy(&infoHeader[28], &pixelsPerMeter, 4);
+	fwrite(header, 1, sizeof(header), file);
+}
+
+int BmpFile::writeRaw(const char * path, int32_t width, int32_t height,
+	uint8_t * imageData, int rowWidthInBytes) {
+
+	FILE* file;
+	errno_t err = fopen_s(
+		&file,
+		path,
+		"wb");
+	if (err != 0 || file == NULL) {
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+
+	for (int32_t i = 0; i < height; ++i) {
+		fwrite(imageData + (int64_t)i * rowWidthInBytes, 1, width * 3, file);
+	}
+
+	fflush(file);
+	fclose(file);
+	return 0;
+}
+
+int BmpFile::calculateRowWidthInBytes(int32_t width) {
+	return ((COLOR_DEPTH * width + 31) / 32) * 4;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+namespace lossycompressor {
+
+	/// Reads and writes images in BMP format.
+	/**
+		Images are read in place from the file data, rows of images stored from bottom
+		to top are described by a negative stride instead of being reordered.
+	*/
+	class BmpFile {
+		static const int BITMAP_FILE_HEADER_SIZE = 14;
+		static const int BITMAP_INFO_HEADER_SIZE = 40;
+		static const int COLOR_DEPTH = 24;
+		static const uint32_t COMPRESSION_NONE = 0;
+		static const uint32_t COMPRESSION_BITFIELDS = 3;
+
+		// Writes file and info headers of 24 bit image, negative height means rows are stored from top to bottom
+		static void writeHeaders(FILE * file, int32_t width, int32_t height);
+	public:
+		static const int ERROR_FILE_COULD_NOT_OPEN_FILE = 2;		///< Error code. File could not be open.
+		static const int ERROR_INVALID_BMP_HEADER = 3;				///< Error code. File has invalid header or it is shorter than its pixel data.
+		static const int ERROR_UNSUPPORTED_COLOR_DEPTH = 4;			///< Error code. Image is not 24 or 32 bit, or 8 bit with palette of gray levels.
+		static const int ERROR_UNSUPPORTED_IMAGE_COMPRESSION = 5;	///< Error code. Image is compressed or its bit fields are not (b, g, r, a).
+
+		/// Layout of pixels of an image stored in memory.
+		struct ImageLayout {
+			int32_t width;					///< Width of the image.
+			int32_t height;					///< Height of the image.
+			int bytesPerPixel;				///< 1 if pixels are gray levels, 3 if pixels are stored as (b, g, r), 4 if pixels are stored as (b, g, r, a).
+			bool isTopDown;					///< True if rows are stored from top to bottom.
+			int rowStrideInBytes;			///< Distance from the start of a row to the start of the row below it, negative if rows are stored from bottom to top.
+			uint8_t * topRowData;			///< First pixel of the top row.
+		};
+
+		/// Validate headers of BMP file data and describe its pixels in place.
+		/**
+			Uncompressed 24 and 32 bit images with rows stored in both orders are supported.
+			8 bit images are supported if their palette maps every index to the gray level of the same value,
+			their pixels are then the gray levels.
+
+			\param[in] data			Data of the whole file.
+			\param[in] dataSize		Size of the data in bytes.
+			\param[out] layout		Layout of pixels pointing into the data.
+			\return 0 if successfull, error code otherwise.
+		*/
+		static int parse(uint8_t * data, size_t dataSize, ImageLayout * layout);
+
+		/// Write 24 bit image into BMP file.
+		/**
+			\param[in] path				Path of the written file.
+			\param[in] width			Width of the image.
+			\param[in] height			Height of the image.
+			\param[in] imageData		Pixel data stored by rows from top to bottom, 3 bytes (b, g, r) per pixel.
+			\param[in] rowWidthInBytes	Width of a row in image data in bytes.
+			\return 0 if successfull, error code otherwise.
+		*/
+		static int write(const char * path, int32_t width, int32_t height,
+			uint8_t * imageData, int rowWidthInBytes);
+
+		/// Start writing 24 bit image into BMP file by bands of rows, so the whole image does not have to be in memory.
+		/**
+			Rows are then written from top to bottom by writeRows() and the file is closed by endWrite().
+
+			\param[in] path			Path of the written file.
+			\param[in] width		Width of the image.
+			\param[in] height		Height of the image.
+			\param[out] file		Opened file.
+			\return 0 if successfull, error code otherwise.
+		*/
+		static int beginWrite(const char * path, int32_t width, int32_t height, FILE ** file);
+
+		/// Write next rows of 24 bit image into BMP file started by beginWrite().
+		/**
+			\param[in] file				File started by beginWrite().
+			\param[in] width			Width of the image.
+			\param[in] rowsCount		Count of written rows.
+			\param[in] imageData		Pixel data of the rows stored from top to bottom, 3 bytes (b, g, r) per pixel.
+			\param[in] rowWidthInBytes	Width of a row in image data in bytes.
+		*/
+		static void writeRows(FILE * file, int32_t width, int32_t rowsCount,
+			uint8_t * imageData, int rowWidthInBytes);
+
+		/// Finish writing of BMP file started by beginWrite().
+		static void endWrite(FILE * file);
+
+		/// Write 24 bit image into file without any header as rows from top to bottom without padding.
+		/**
+			Parameters are the same as in write().
+		*/
+		static int writeRaw(const char * path, int32_t width, int32_t height,
+			uint8_t * imageData, int rowWidthInBytes);
+
+		/// Returns width of a row of 24 bit image in BMP file including padding.
+		static int calculateRowWidthInBytes(int32_t width);
+	};
+}
@@ -0,0 +1,146 @@
+#include "checkpoint.h"
+#include "mappedfile.h"
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include "Windows.h"
+#endif
+
+using namespace std;
+using namespace lossycompressor;
+
+Checkpoint::~Checkpoint() {
+	for (int i = 0; i < diagrams.size(); ++i) {
+		delete diagrams[i];
+	}
+}
+
+int Checkpoint::write(const char * path) {
+	vector<uint8_t> data;
+	append(&data, "VCP", 3);
+	uint8_t version = FORMAT_VERSION;
+	append(&data, &version, 1);
+	uint8_t algorithmNameLength = (uint8_t)algorithmName.size();
+	append(&data, &algorithmNameLength, 1);
+	append(&data, algorithmName.data(), algorithmNameLength);
+	append(&data, &width, 4);
+	append(&data, &height, 4);
+	append(&data, &diagramPointsCount, 4);
+	append(&data, &fitnessEvaluationsCount, 4);
+	append(&data, &elapsedTimeSecs, 8);
+	append(&data, &bestFitness, 4);
+	append(&data, &bestMeanSquaredError, 4);
+	uint32_t randomGeneratorStateLength = (uint32_t)randomGeneratorState.size();
+	append(&data, &randomGeneratorStateLength, 4);
+	append(&data, randomGeneratorState.data(), randomGeneratorStateLength);
+	int32_t diagramsCount = (int32_t)diagrams.size();
+	append(&data, &diagramsCount, 4);
+	for (int i = 0; i < diagramsCount; ++i) {
+		append(&data, &diagramsFitness[i], 4);
+		append(&data, diagrams[i]->diagramPointsXCoordinates, (size_t)diagramPointsCount * 4);
+		append(&data, diagrams[i]->diagramPointsYCoordinates, (size_t)diagramPointsCount * 4);
+	}
+
+	string temporaryPath = string(path) + ".tmp";
+	FILE * file;
+	errno_t openErr = fopen_s(&file, temporaryPath.c_str(), "wb");
+	if (openErr != 0 || file == NULL) {
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+	size_t writtenSize = fwrite(data.data(), 1, data.size(), file);
+	bool isWritten = fflush(file) == 0 && writtenSize == data.size();
+	fclose(file);
+	if (!isWritten || !replaceFile(temporaryPath.c_str(), path)) {
+		remove(temporaryPath.c_str());
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+	return 0;
+}
+
+int Checkpoint::read(const char * path) {
+	MappedFile file;
+	if (file.open(path) != 0) {
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+	const uint8_t * data = file.getData();
+	size_t dataSize = file.getSize();
+	size_t position = 0;
+
+	char magic[3];
+	uint8_t version;
+	uint8_t algorithmNameLength;
+	if (!extract(data, dataSize, &position, magic, 3) || memcmp(magic, "VCP", 3) != 0
+		|| !extract(data, dataSize, &position, &version, 1) || version != FORMAT_VERSION
+		|| !extract(data, dataSize, &position, &algorithmNameLength, 1)) {
+		return ERROR_INVALID_CHECKPOINT;
+	}
+	algorithmName.resize(algorithmNameLength);
+	uint32_t randomGeneratorStateLength;
+	if (!extract(data, dataSize, &position, &algorithmName[0], algorithmNameLength)
+		|| !extract(data, dataSize, &position, &width, 4)
+		|| !extract(data, dataSize, &position, &height, 4)
+		|| !extract(data, dataSize, &position, &diagramPointsCount, 4)
+		|| !extract(data, dataSize, &position, &fitnessEvaluationsCount, 4)
+		|| !extract(data, dataSize, &position, &elapsedTimeSecs, 8)
+		|| !extract(data, dataSize, &position, &bestFitness, 4)
+		|| !extract(data, dataSize, &position, &bestMeanSquaredError, 4)
+		|| !extract(data, dataSize, &position, &randomGeneratorStateLength, 4)
+		|| randomGeneratorStateLength > dataSize - position) {
+		return ERROR_INVALID_CHECKPOINT;
+	}
+	randomGeneratorState.resize(randomGeneratorStateLength);
+	int32_t diagramsCount;
+	if (!extract(data, dataSize, &position, &randomGeneratorState[0], randomGeneratorStateLength)
+		|| !extract(data, dataSize, &position, &diagramsCount, 4)
+		|| width <= 0 || height <= 0 || diagramPointsCount <= 0 || diagramsCount < 0
+		|| (uint64_t)diagramsCount * (4 + (uint64_t)diagramPointsCount * 8) != dataSize - position) {
+		return ERROR_INVALID_CHECKPOINT;
+	}
+
+	for (int i = 0; i < diagramsCount; ++i) {
+		float fitness;
+		extract(data, dataSize, &position, &fitness, 4);
+		diagramsFitness.push_back(fitness);
+
+		// Points are set one by one, so the hash of the diagram is valid
+		VoronoiDiagram * diagram = new VoronoiDiagram(diagramPointsCount);
+		diagrams.push_back(diagram);
+		size_t xPosition = position;
+		size_t yPosition = position + (size_t)diagramPointsCount * 4;
+		for (int j = 0; j < diagramPointsCount; ++j) {
+			int32_t x = 0, y = 0;
+			extract(data, dataSize, &xPosition, &x, 4);
+			extract(data, dataSize, &yPosition, &y, 4);
+			if (x < 0 || x >= width || y < 0 || y >= height) {
+				return ERROR_INVALID_CHECKPOINT;
+			}
+			diagram->setPoint(j, x, y);
+		}
+		position = yPosition;
+	}
+	return 0;
+}
+
+void Checkpoint::append(vector<uint8_t> * data, const void * value, size_t size) {
+	const uint8_t * bytes = (const uint8_t *)value;
+	data->insert(data->end(), bytes, bytes + size);
+}
+
+bool Checkpoint::extract(const uint8_t * data, size_t dataSize, size_t * position, void * value, size_t size) {
+	if (size > dataSize - *position) {
+		return false;
+	}
+	memcpy(value, data + *position, size);
+	*position += size;
+	return true;
+}
+
+bool Checkpoint::replaceFile(const char * sourcePath, const char * destinationPath) {
+#ifdef _WIN32
+	return MoveFileExA(sourcePath, destinationPath, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return rename(sourcePath, destinationPath) == 0;
+#endif
+}
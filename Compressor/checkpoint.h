@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "voronoidiagram.h"
+
+namespace lossycompressor {
+
+	/// State of an interrupted computation from which it can continue.
+	/**
+		Checkpoint files have the following format, numbers are stored in native byte order:
+		3 bytes - characters "VCP",
+		1 byte - format version (1),
+		1 byte - length of the algorithm name, followed by the name,
+		4 bytes - image width,
+		4 bytes - image height,
+		4 bytes - count of points in every diagram,
+		4 bytes - count of fitness evaluations,
+		8 bytes - elapsed computation time in seconds,
+		4 bytes - best fitness,
+		4 bytes - mean squared error of the best solution,
+		4 bytes - length of the random number generator state, followed by the state in text,
+		4 bytes - count of diagrams.
+		Rest of the file contains the diagrams, every one as:
+			4 bytes - fitness of the diagram,
+			4 bytes per point - x coordinates of points,
+			4 bytes per point - y coordinates of points.
+
+		File is written into a temporary file next to it, which then replaces it,
+		so the previous checkpoint is kept whole if writing is interrupted.
+	*/
+	class Checkpoint {
+		static const uint8_t FORMAT_VERSION = 1;
+
+		static void append(std::vector<uint8_t> * data, const void * value, size_t size);
+		// Returns false if the data end before the value
+		static bool extract(const uint8_t * data, size_t dataSize, size_t * position, void * value, size_t size);
+		// Replaces the destination file by the source file
+		static bool replaceFile(const char * sourcePath, const char * destinationPath);
+	public:
+		static const int ERROR_FILE_COULD_NOT_OPEN_FILE = 2;	///< Error code. File could not be open.
+		static const int ERROR_INVALID_CHECKPOINT = 20;			///< Error code. Checkpoint file is damaged or it was written by a different computation.
+
+		std::string algorithmName;					///< Name of the algorithm that wrote the checkpoint.
+		int32_t width;								///< Width of the compressed image.
+		int32_t height;								///< Height of the compressed image.
+		int diagramPointsCount;						///< Count of points in every diagram.
+		int fitnessEvaluationsCount;				///< Count of fitness evaluations done by the computation.
+		double elapsedTimeSecs;						///< Time the computation ran.
+		float bestFitness;							///< Fitness of the best solution found by the computation.
+		float bestMeanSquaredError;					///< Mean squared error of color channels of the best solution.
+		std::string randomGeneratorState;			///< State of the random number generator of the computation.
+		std::vector<VoronoiDiagram *> diagrams;		///< Diagrams of the computation, deleted with the checkpoint.
+		std::vector<float> diagramsFitness;			///< Fitness of every diagram.
+
+		~Checkpoint();
+
+		/// Write the checkpoint into the file.
+		/**
+			\return 0 if successfull, error code otherwise.
+		*/
+		int write(const char * path);
+
+		/// Read the checkpoint from the file, diagrams are allocated by this method.
+		/**
+			\return 0 if successfull, error code otherwise.
+		*/
+		int read(const char * path);
+	};
+}
@@ -0,0 +1,204 @@
+#include "colorquantizer.h"
+#include "utils.h"
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+using namespace lossycompressor;
+
+float ColorQuantizer::calculateSquareDistance(const Color24bit & first, const float * second) {
+	float bDeviation = first.b - second[0];
+	float gDeviation = first.g - second[1];
+	float rDeviation = first.r - second[2];
+	return bDeviation * bDeviation + gDeviation * gDeviation + rDeviation * rDeviation;
+}
+
+void ColorQuantizer::runKMeans(Color24bit * colors, int * pixelPerPointCounts, int diagramPointsCount,
+	int paletteSize, float * centroids, int * colorPaletteIndices) {
+
+	// Choose initial centroids by k-means++, probability of a color is proportional
+	// to its count of pixels and squared distance to the closest chosen centroid
+	vector<float> closestSquareDistances(diagramPointsCount, -1);
+	for (int k = 0; k < paletteSize; ++k) {
+		double weightsSum = 0;
+		for (int i = 0; i < diagramPointsCount; ++i) {
+			float distance = k == 0 ? 1 : closestSquareDistances[i];
+			weightsSum += (double)pixelPerPointCounts[i] * distance;
+		}
+
+		int chosenIndex = Utils::generateRandom(diagramPointsCount - 1);
+		if (weightsSum > 0) {
+			double chosenWeight = Utils::generateRandomFloat() * weightsSum;
+			for (int i = 0; i < diagramPointsCount; ++i) {
+				float distance = k == 0 ? 1 : closestSquareDistances[i];
+				chosenWeight -= (double)pixelPerPointCounts[i] * distance;
+				if (chosenWeight < 0 && pixelPerPointCounts[i] > 0) {
+					chosenIndex = i;
+					break;
+				}
+			}
+		}
+
+		float * centroid = &centroids[k * 3];
+		centroid[0] = colors[chosenIndex].b;
+		centroid[1] = colors[chosenIndex].g;
+		centroid[2] = colors[chosenIndex].r;
+		for (int i = 0; i < diagramPointsCount; ++i) {
+			float distance = calculateSquareDistance(colors[i], centroid);
+			if (k == 0 || distance < closestSquareDistances[i]) {
+				closestSquareDistances[i] = distance;
+			}
+		}
+	}
+
+	vector<double> sums(paletteSize * 3);
+	vector<double> weights(paletteSize);
+	for (int i = 0; i < diagramPointsCount; ++i) {
+		colorPaletteIndices[i] = -1;
+	}
+
+	bool changed = true;
+	for (int iteration = 0; iteration < KMEANS_MAX_ITERATION_COUNT && changed; ++iteration) {
+		changed = false;
+		for (int i = 0; i < diagramPointsCount; ++i) {
+			int closestIndex = 0;
+			float closestDistance = calculateSquareDistance(colors[i], &centroids[0]);
+			for (int k = 1; k < paletteSize; ++k) {
+				float distance = calculateSquareDistance(colors[i], &centroids[k * 3]);
+				if (distance < closestDistance) {
+					closestIndex = k;
+					closestDistance = distance;
+				}
+			}
+			if (colorPaletteIndices[i] != closestIndex) {
+				colorPaletteIndices[i] = closestIndex;
+				changed = true;
+			}
+		}
+
+		fill(sums.begin(), sums.end(), 0);
+		fill(weights.begin(), weights.end(), 0);
+		for (int i = 0; i < diagramPointsCount; ++i) {
+			int k = colorPaletteIndices[i];
+			sums[k * 3] += (double)colors[i].b * pixelPerPointCounts[i];
+			sums[k * 3 + 1] += (double)colors[i].g * pixelPerPointCounts[i];
+			sums[k * 3 + 2] += (double)colors[i].r * pixelPerPointCounts[i];
+			weights[k] += pixelPerPointCounts[i];
+		}
+		for (int k = 0; k < paletteSize; ++k) {
+			// Centroid without any color stays where it is
+			if (weights[k] > 0) {
+				for (int channel = 0; channel < 3; ++channel) {
+					centroids[k * 3 + channel] = (float)(sums[k * 3 + channel] / weights[k]);
+				}
+			}
+		}
+	}
+}
+
+void ColorQuantizer::quantize(int32_t sourceWidth, int32_t sourceHeight,
+	uint8_t * sourceImageData, int sourceDataRowWidthInBytes, PixelFormat sourcePixelFormat,
+	int * pixelPointAssignment, int diagramPointsCount,
+	Color24bit * colors, int paletteSize,
+	Color24bit * palette, int * colorPaletteIndices) {
+
+	// Group pixels by points
+	vector<int64_t> pointPixelsStarts(diagramPointsCount + 1, 0);
+	for (int64_t i = 0; i < (int64_t)sourceWidth * sourceHeight; ++i) {
+		++pointPixelsStarts[pixelPointAssignment[i] + 1];
+	}
+	vector<int> pixelPerPointCounts(diagramPointsCount);
+	for (int i = 0; i < diagramPointsCount; ++i) {
+		pixelPerPointCounts[i] = (int)pointPixelsStarts[i + 1];
+		pointPixelsStarts[i + 1] += pointPixelsStarts[i];
+	}
+	// Colors of pixels, gray levels are copied into all channels
+	vector<Color24bit> pointPixels((int64_t)sourceWidth * sourceHeight);
+	vector<int64_t> pointPixelsEnds(pointPixelsStarts.begin(), pointPixelsStarts.end() - 1);
+	int bytesPerPixel = PixelFormatUtils::getBytesPerPixel(sourcePixelFormat);
+	for (int i = 0; i < sourceHeight; ++i) {
+		for (int j = 0; j < sourceWidth; ++j) {
+			int pointIndex = pixelPointAssignment[(int64_t)i * sourceWidth + j];
+			uint8_t * pixel = sourceImageData + (int64_t)i * sourceDataRowWidthInBytes + j * bytesPerPixel;
+			pointPixels[pointPixelsEnds[pointIndex]++] = PixelFormatUtils::readColor(sourcePixelFormat, pixel);
+		}
+	}
+
+	vector<float> centroids(paletteSize * 3);
+	runKMeans(colors, pixelPerPointCounts.data(), diagramPointsCount,
+		paletteSize, centroids.data(), colorPaletteIndices);
+	for (int k = 0; k < paletteSize; ++k) {
+		palette[k].b = (uint8_t)(centroids[k * 3] + 0.5f);
+		palette[k].g = (uint8_t)(centroids[k * 3 + 1] + 0.5f);
+		palette[k].r = (uint8_t)(centroids[k * 3 + 2] + 0.5f);
+	}
+
+	// K-means minimizes squared deviation, fitness uses absolute deviation. Alternately assign
+	// points to palette colors with the smallest absolute deviation of their pixels
+	// and move palette colors to the per channel median of their pixels.
+	vector<int> histograms(paletteSize * 3 * 256);
+	bool changed = true;
+	for (int iteration = 0; iteration < REFINEMENT_MAX_ITERATION_COUNT && changed; ++iteration) {
+		changed = false;
+		for (int i = 0; i < diagramPointsCount; ++i) {
+			int bestIndex = colorPaletteIndices[i];
+			long long bestDeviation = -1;
+			for (int k = 0; k < paletteSize; ++k) {
+				long long deviation = 0;
+				for (int64_t p = pointPixelsStarts[i]; p < pointPixelsStarts[i + 1]; ++p) {
+					Color24bit pixel = pointPixels[p];
+					deviation += abs(pixel.b - palette[k].b)
+						+ abs(pixel.g - palette[k].g)
+						+ abs(pixel.r - palette[k].r);
+				}
+				if (bestDeviation < 0 || deviation < bestDeviation) {
+					bestIndex = k;
+					bestDeviation = deviation;
+				}
+			}
+			if (colorPaletteIndices[i] != bestIndex) {
+				colorPaletteIndices[i] = bestIndex;
+				changed = true;
+			}
+		}
+
+		fill(histograms.begin(), histograms.end(), 0);
+		vector<int> paletteColorPixelCounts(paletteSize, 0);
+		for (int i = 0; i < diagramPointsCount; ++i) {
+			int * histogram = &histograms[colorPaletteIndices[i] * 3 * 256];
+			for (int64_t p = pointPixelsStarts[i]; p < pointPixelsStarts[i + 1]; ++p) {
+				Color24bit pixel = pointPixels[p];
+				++histogram[pixel.b];
+				++histogram[256 + pixel.g];
+				++histogram[2 * 256 + pixel.r];
+			}
+			paletteColorPixelCounts[colorPaletteIndices[i]] += pixelPerPointCounts[i];
+		}
+		for (int k = 0; k < paletteSize; ++k) {
+			if (paletteColorPixelCounts[k] == 0) {
+				continue;
+			}
+			uint8_t medians[3];
+			for (int channel = 0; channel < 3; ++channel) {
+				int * histogram = &histograms[(k * 3 + channel) * 256];
+				int cumulativeCount = 0;
+				int value = 0;
+				while ((cumulativeCount += histogram[value]) * 2 < paletteColorPixelCounts[k]) {
+					++value;
+				}
+				medians[channel] = (uint8_t)value;
+			}
+			if (palette[k].b != medians[0] || palette[k].g != medians[1] || palette[k].r != medians[2]) {
+				palette[k].b = medians[0];
+				palette[k].g = medians[1];
+				palette[k].r = medians[2];
+				changed = true;
+			}
+		}
+	}
+
+	for (int i = 0; i < diagramPointsCount; ++i) {
+		colors[i] = palette[colorPaletteIndices[i]];
+	}
+}
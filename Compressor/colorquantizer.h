@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include "color.h"
+#include "pixelformat.h"
+
+namespace lossycompressor {
+
+	/// Reduces colors of diagram points to a small palette.
+	/**
+		Palette is found by k-means over mean colors of points weighted by the count of
+		pixels of every point, which is the same as k-means over all pixels with the
+		restriction that pixels of one point share one palette color. It is then refined
+		on the pixels with respect to the absolute color deviation used as fitness.
+	*/
+	class ColorQuantizer {
+		static const int KMEANS_MAX_ITERATION_COUNT = 30;
+		static const int REFINEMENT_MAX_ITERATION_COUNT = 4;
+
+		static float calculateSquareDistance(const Color24bit & first, const float * second);
+
+		static void runKMeans(Color24bit * colors, int * pixelPerPointCounts, int diagramPointsCount,
+			int paletteSize, float * centroids, int * colorPaletteIndices);
+	public:
+		/// Find palette for colors of diagram points and assign palette colors to points.
+		/**
+			\param[in] sourceWidth					Width of the source image.
+			\param[in] sourceHeight					Height of the source image.
+			\param[in] sourceImageData				Pixel data of the source image.
+			\param[in] sourceDataRowWidthInBytes	Width of a row of pixel data in bytes.
+			\param[in] sourcePixelFormat			Format of pixels of the source image, palette of gray image is gray.
+			\param[in] pixelPointAssignment			Index of diagram point of every pixel.
+			\param[in] diagramPointsCount			Count of points in the diagram.
+			\param[in,out] colors					Mean colors of points, replaced by the assigned palette colors.
+			\param[in] paletteSize					Count of colors in the palette.
+			\param[out] palette						Array of paletteSize palette colors.
+			\param[out] colorPaletteIndices			Array of diagramPointsCount indices into the palette.
+		*/
+		static void quantize(int32_t sourceWidth, int32_t sourceHeight,
+			uint8_t * sourceImageData, int sourceDataRowWidthInBytes, PixelFormat sourcePixelFormat,
+			int * pixelPointAssignment, int diagramPointsCount,
+			Color24bit * colors, int paletteSize,
+			Color24bit * palette, int * colorPaletteIndices);
+	};
+}
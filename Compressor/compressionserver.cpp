@@ -0,0 +1,313 @@
+#include "compressionserver.h"
+#include "utils.h"
+#include <cstring>
+#include <thread>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace lossycompressor;
+
+int CompressionServer::run(FILE * input, FILE * output) {
+	this->output = output;
+	isReadingFinished = false;
+
+	int threadCount = args->threadCount > 0 ? args->threadCount : Utils::max(1, (int)thread::hardware_concurrency());
+	vector<thread> threads;
+	for (int i = 0; i < threadCount; ++i) {
+		threads.push_back(thread(&CompressionServer::runJobs, this));
+	}
+
+	int err = 0;
+	bool isQuit = false;
+	char line[MAX_REQUEST_LENGTH];
+	while (err == 0 && !isQuit && fgets(line, sizeof(line), input) != NULL) {
+		err = readRequest(input, line, &isQuit);
+	}
+
+	// Threads finish the queued jobs and stop
+	{
+		lock_guard<mutex> lock(jobsMutex);
+		isReadingFinished = true;
+	}
+	jobQueuedCondition.notify_all();
+	for (int i = 0; i < threads.size(); ++i) {
+		threads[i].join();
+	}
+	return err;
+}
+
+int CompressionServer::runOnStandardStreams() {
+	// Responses are written into a duplicate of the standard output, which then goes into the standard error
+	fflush(stdout);
+#ifdef _WIN32
+	_setmode(_fileno(stdin), _O_BINARY);
+	int outputDescriptor = _dup(_fileno(stdout));
+	FILE * output = outputDescriptor >= 0 ? _fdopen(outputDescriptor, "wb") : NULL;
+	if (output != NULL) {
+		_dup2(_fileno(stderr), _fileno(stdout));
+	}
+#else
+	int outputDescriptor = dup(fileno(stdout));
+	FILE * output = outputDescriptor >= 0 ? fdopen(outputDescriptor, "wb") : NULL;
+	if (output != NULL) {
+		dup2(fileno(stderr), fileno(stdout));
+	}
+#endif
+	if (output == NULL) {
+		return Compressor::ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+
+	int err = run(stdin, output);
+
+	fflush(stdout);
+	fflush(output);
+#ifdef _WIN32
+	_dup2(outputDescriptor, _fileno(stdout));
+#else
+	dup2(outputDescriptor, fileno(stdout));
+#endif
+	fclose(output);
+	return err;
+}
+
+int CompressionServer::readRequest(FILE * input, const char * line, bool * isQuit) {
+	size_t lineLength = strlen(line);
+	if (lineLength == 0 || (line[lineLength - 1] != '\n' && !feof(input))) {
+		printf("Request is longer than %d characters\n", MAX_REQUEST_LENGTH - 1);
+		return ERROR_INVALID_REQUEST;
+	}
+
+	istringstream request(line);
+	string command;
+	if (!(request >> command)) {
+		// Empty lines are skipped
+		return 0;
+	}
+	if (command == "compress") {
+		return readCompressRequest(input, &request, line);
+	}
+	if (command == "cancel") {
+		string id;
+		if (request >> id) {
+			cancelJob(id);
+		}
+		return 0;
+	}
+	if (command == "quit") {
+		*isQuit = true;
+		return 0;
+	}
+	printf("Unknown request %s\n", command.c_str());
+	return 0;
+}
+
+int CompressionServer::readCompressRequest(FILE * input, istringstream * request, const char * line) {
+	string id;
+	int64_t maxCompressedSizeBytes;
+	string algorithm;
+	double deadlineSecs;
+	string sourceType;
+	if (!(*request >> id >> maxCompressedSizeBytes >> algorithm >> deadlineSecs >> sourceType)) {
+		// Pixels may follow the request, so the input can not be read further
+		printf("Invalid compress request %s", line);
+		return ERROR_INVALID_REQUEST;
+	}
+
+	Job * job = new Job();
+	job->server = this;
+	job->id = id;
+	job->maxCompressedSizeBytes = (uint32_t)maxCompressedSizeBytes;
+	job->deadlineSecs = deadlineSecs;
+	job->isCancelled = false;
+	job->lastProgressSecs = -1;
+	Utils::recordTime(&job->receiveTime);
+	bool isValid = maxCompressedSizeBytes > 0 && maxCompressedSizeBytes <= UINT32_MAX && deadlineSecs > 0
+		&& Compressor::parseComputationType(algorithm.c_str(), &job->computationType);
+
+	if (sourceType == "file") {
+		// Path is the rest of the line without the separating and trailing white space
+		string path;
+		getline(*request, path);
+		size_t start = path.find_first_not_of(" \t");
+		size_t end = path.find_last_not_of(" \t\r\n");
+		job->sourceImagePath = start == string::npos ? "" : path.substr(start, end - start + 1);
+		isValid = isValid && !job->sourceImagePath.empty();
+	}
+	else if (sourceType == "pixels") {
+		string format;
+		if (!(*request >> job->width >> job->height >> format)
+			|| job->width <= 0 || job->height <= 0 || !parsePixelFormat(format.c_str(), &job->pixelFormat)) {
+			printf("Invalid pixels of compress request %s", line);
+			delete job;
+			return ERROR_INVALID_REQUEST;
+		}
+		// Size is checked before the allocation, so a bad request can not exhaust the memory of the server
+		int64_t pixelsBytes = (int64_t)job->width * job->height * PixelFormatUtils::getBytesPerPixel(job->pixelFormat);
+		if (pixelsBytes > MAX_PIXELS_BYTES) {
+			printf("Pixels of job %s are larger than %lld bytes\n", id.c_str(), (long long)MAX_PIXELS_BYTES);
+			delete job;
+			return ERROR_INVALID_REQUEST;
+		}
+		job->pixels.resize((size_t)pixelsBytes);
+		if (fread(job->pixels.data(), 1, job->pixels.size(), input) != job->pixels.size()) {
+			printf("Input ended before pixels of job %s\n", id.c_str());
+			delete job;
+			return ERROR_INVALID_REQUEST;
+		}
+	}
+	else {
+		isValid = false;
+	}
+
+	{
+		lock_guard<mutex> lock(jobsMutex);
+		isValid = isValid && activeJobs.find(job->id) == activeJobs.end();
+	}
+	if (!isValid) {
+		finishJob(job, ERROR_INVALID_REQUEST, -1, NULL);
+		return 0;
+	}
+	queueJob(job);
+	return 0;
+}
+
+bool CompressionServer::parsePixelFormat(const char * name, PixelFormat * pixelFormat) {
+	if (strcmp(name, "gray8") == 0) {
+		*pixelFormat = PixelFormat::GRAY8;
+	}
+	else if (strcmp(name, "bgr24") == 0) {
+		*pixelFormat = PixelFormat::BGR24;
+	}
+	else if (strcmp(name, "bgra32") == 0) {
+		*pixelFormat = PixelFormat::BGRA32;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+void CompressionServer::queueJob(Job * job) {
+	{
+		unique_lock<mutex> lock(jobsMutex);
+		jobTakenCondition.wait(lock, [this] { return queuedJobs.size() < (size_t)Utils::max(1, args->maxQueuedJobsCount); });
+		queuedJobs.push_back(job);
+		activeJobs[job->id] = job;
+	}
+	jobQueuedCondition.notify_one();
+}
+
+void CompressionServer::cancelJob(const string & id) {
+	lock_guard<mutex> lock(jobsMutex);
+	auto activeJob = activeJobs.find(id);
+	if (activeJob != activeJobs.end()) {
+		activeJob->second->isCancelled = true;
+	}
+}
+
+void CompressionServer::runJobs() {
+	Compressor::ReusedFitnessEvaluators reusedFitnessEvaluators;
+	while (true) {
+		Job * job;
+		{
+			unique_lock<mutex> lock(jobsMutex);
+			jobQueuedCondition.wait(lock, [this] { return !queuedJobs.empty() || isReadingFinished; });
+			if (queuedJobs.empty()) {
+				break;
+			}
+			job = queuedJobs.front();
+			queuedJobs.pop_front();
+		}
+		jobTakenCondition.notify_one();
+		runJob(job, &reusedFitnessEvaluators);
+	}
+	reusedFitnessEvaluators.release();
+}
+
+void CompressionServer::runJob(Job * job, Compressor::ReusedFitnessEvaluators * reusedFitnessEvaluators) {
+	if (job->isCancelled) {
+		finishJob(job, Compressor::ERROR_CANCELLED, -1, NULL);
+		return;
+	}
+
+	LARGE_INTEGER startTime;
+	Utils::recordTime(&startTime);
+	double remainingSecs = job->deadlineSecs - Utils::calculateInterval(&job->receiveTime, &startTime);
+	if (remainingSecs <= 0) {
+		finishJob(job, ERROR_DEADLINE_EXPIRED, -1, NULL);
+		return;
+	}
+
+	vector<uint8_t> compressedData;
+	Compressor::Args compressorArgs;
+	compressorArgs.sourceImagePath = job->sourceImagePath.c_str();
+	compressorArgs.destinationCompressedPath = NULL;
+	compressorArgs.destinationImagePath = NULL;
+	compressorArgs.destinationCompressedData = &compressedData;
+	compressorArgs.maxCompressedSizeBytes = job->maxCompressedSizeBytes;
+	compressorArgs.computationType = job->computationType;
+	compressorArgs.computationLimit = Compressor::ComputationLimit::TIME;
+	compressorArgs.maxComputationTimeSecs = remainingSecs;
+	compressorArgs.maxFitnessEvaluationCount = 0;
+	compressorArgs.useCuda = args->useCuda;
+	compressorArgs.logImprovementToConsole = false;
+	compressorArgs.reusedFitnessEvaluators = reusedFitnessEvaluators;
+	if (job->sourceImagePath.empty()) {
+		compressorArgs.sourcePixels = job->pixels.data();
+		compressorArgs.sourcePixelsWidth = job->width;
+		compressorArgs.sourcePixelsHeight = job->height;
+		compressorArgs.sourcePixelsRowWidthInBytes = job->width * PixelFormatUtils::getBytesPerPixel(job->pixelFormat);
+		compressorArgs.sourcePixelsFormat = job->pixelFormat;
+	}
+	compressorArgs.progressCallback = onProgress;
+	compressorArgs.cancelCallback = onCancel;
+	compressorArgs.callbackContext = job;
+
+	Compressor compressor(&compressorArgs);
+	int err = compressor.compress();
+	finishJob(job, err, compressor.getFitness(), &compressedData);
+}
+
+void CompressionServer::finishJob(Job * job, int err, float fitness, vector<uint8_t> * compressedData) {
+	size_t byteCount = err == 0 && compressedData != NULL ? compressedData->size() : 0;
+	{
+		lock_guard<mutex> lock(outputMutex);
+		fprintf(output, "done %s %d %f %zu\n", job->id.c_str(), err, fitness, byteCount);
+		if (byteCount > 0) {
+			fwrite(compressedData->data(), 1, byteCount, output);
+		}
+		fflush(output);
+	}
+	{
+		lock_guard<mutex> lock(jobsMutex);
+		auto activeJob = activeJobs.find(job->id);
+		if (activeJob != activeJobs.end() && activeJob->second == job) {
+			activeJobs.erase(activeJob);
+		}
+	}
+	delete job;
+}
+
+void CompressionServer::onProgress(const CompressorAlgorithm::Progress * progress, void * callbackContext) {
+	Job * job = (Job *)callbackContext;
+	CompressionServer * server = job->server;
+	if (job->lastProgressSecs >= 0 && progress->elapsedTimeSecs - job->lastProgressSecs < server->PROGRESS_INTERVAL_SECS) {
+		return;
+	}
+	job->lastProgressSecs = progress->elapsedTimeSecs;
+
+	lock_guard<mutex> lock(server->outputMutex);
+	fprintf(server->output, "progress %s %d %.4f %f\n", job->id.c_str(),
+		progress->fitnessEvaluationsCount, progress->elapsedTimeSecs, progress->bestFitness);
+	fflush(server->output);
+}
+
+bool CompressionServer::onCancel(void * callbackContext) {
+	return ((Job *)callbackContext)->isCancelled;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <map>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include "compressor.h"
+
+namespace lossycompressor {
+
+	/// Long running process compressing jobs received through a pipe.
+	/**
+		Requests are read from the input, one per line:
+
+			compress job_id max_size_in_bytes algorithm deadline_secs file source_image_path
+			compress job_id max_size_in_bytes algorithm deadline_secs pixels width height format
+			cancel job_id
+			quit
+
+		Path of the source image is the rest of the line. Pixels request is followed by width * height
+		pixels stored by rows from top to bottom without padding, format is gray8, bgr24 or bgra32. Pixels must not be larger than 1 GiB.
+		Algorithm is a name accepted by Compressor::parseComputationType().
+
+		Jobs are computed by a fixed pool of threads, at most maxQueuedJobsCount jobs wait for a thread,
+		reading of requests is blocked while the queue is full. Deadline is counted from the moment
+		the job is received, so the computation time limit is what remains of it when a thread takes the job.
+		Every thread keeps its fitness evaluators between jobs.
+
+		Responses are written into the output, one per line:
+
+			progress job_id fitness_evaluations elapsed_secs best_fitness
+			done job_id error fitness byte_count
+
+		Done line is followed by byte_count bytes of the compressed file, which are missing if the job failed.
+		Progress is reported at most once per PROGRESS_INTERVAL_SECS. Cancelled job is done with
+		Compressor::ERROR_CANCELLED, invalid request is done with ERROR_INVALID_REQUEST. Reading stops
+		at quit or at the end of the input and all received jobs are finished before run() returns.
+	*/
+	class CompressionServer {
+	public:
+		/// Instance of this class is passed as a parameter into CompressionServer.
+		struct Args {
+			int threadCount = 0;						///< Count of jobs compressed in parallel, count of hardware threads if 0.
+			int maxQueuedJobsCount = 16;				///< Count of received jobs waiting for a thread at which reading of requests blocks.
+			bool useCuda = false;						///< True if CUDA acceleration should be used, false otherwise.
+		};
+	private:
+		const double PROGRESS_INTERVAL_SECS = 0.5;
+		static const int MAX_REQUEST_LENGTH = 4096;
+		static const int64_t MAX_PIXELS_BYTES = (int64_t)1 << 30;
+
+		// Received compression request
+		struct Job {
+			CompressionServer * server;
+			std::string id;
+			uint32_t maxCompressedSizeBytes;
+			Compressor::ComputationType computationType;
+			double deadlineSecs;
+			LARGE_INTEGER receiveTime;
+			std::string sourceImagePath;		// Empty if the pixels are sent
+			std::vector<uint8_t> pixels;
+			int32_t width;
+			int32_t height;
+			PixelFormat pixelFormat;
+			std::atomic<bool> isCancelled;
+			double lastProgressSecs;
+		};
+
+		CompressionServer::Args * args;
+		FILE * output;
+
+		// Jobs waiting for a thread and all unfinished jobs by their ids
+		std::deque<Job *> queuedJobs;
+		std::map<std::string, Job *> activeJobs;
+		bool isReadingFinished;
+		std::mutex jobsMutex;
+		std::condition_variable jobQueuedCondition;
+		std::condition_variable jobTakenCondition;
+
+		// Responses of parallel jobs are written whole
+		std::mutex outputMutex;
+
+		// Returns 0 if the request was handled, error code if the input can not be read further
+		int readRequest(FILE * input, const char * line, bool * isQuit);
+		int readCompressRequest(FILE * input, std::istringstream * request, const char * line);
+		static bool parsePixelFormat(const char * name, PixelFormat * pixelFormat);
+		void queueJob(Job * job);
+		void cancelJob(const std::string & id);
+		void runJobs();
+		void runJob(Job * job, Compressor::ReusedFitnessEvaluators * reusedFitnessEvaluators);
+		void finishJob(Job * job, int err, float fitness, std::vector<uint8_t> * compressedData);
+		static void onProgress(const CompressorAlgorithm::Progress * progress, void * callbackContext);
+		static bool onCancel(void * callbackContext);
+	public:
+		static const int ERROR_INVALID_REQUEST = 17;		///< Server error code. Request has invalid format, unknown algorithm or duplicate job id.
+		static const int ERROR_DEADLINE_EXPIRED = 18;		///< Server error code. Deadline of the job expired before a thread took it.
+
+		/// Construct a new CompressionServer with given arguments.
+		CompressionServer(CompressionServer::Args * args) : args(args) {};
+
+		/// Serve requests from the input until quit or its end.
+		/**
+			\return	0 if all requests were read, ERROR_INVALID_REQUEST if a pixels request could not be parsed, so the rest of the input can not be read.
+		*/
+		int run(FILE * input, FILE * output);
+
+		/// Serve requests from the standard input and write responses into the standard output, see run().
+		/**
+			Standard output is redirected into the standard error during serving,
+			so messages printed by compressions do not mix with the responses.
+		*/
+		int runOnStandardStreams();
+	};
+}
@@ -1,19 +1,132 @@
 #include "compressor.h"
 #include "memeticalgorithm.h"
+#include "iteratedlocalsearch.h"
+#include "differentialevolution.h"
+#include "cudafitnessevaluator.h"
+#include "compressorutils.h"
+#include "vorformat.h"
+#include "colorquantizer.h"
+#include "utils.h"
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <algorithm>
+#include <utility>
+#include <vector>
 
+using namespace std;
 using namespace lossycompressor;
 
 int Compressor::compress() {
+	if (args->paletteSize < 0 || args->paletteSize > VorFormat::MAX_PALETTE_SIZE) {
+		printf("Palette size must be between 0 and %d\n", VorFormat::MAX_PALETTE_SIZE);
+		return VorFormat::ERROR_INVALID_PALETTE;
+	}
+	if (args->indexTileSize < 0) {
+		printf("Tile size of tile index must not be negative\n");
+		return VorFormat::ERROR_INVALID_INDEX_TILE_SIZE;
+	}
+	if (args->progressive && (args->paletteSize > 0 || args->indexTileSize > 0)) {
+		printf("Progressive compressed file can not use palette or tile index\n");
+		return VorFormat::ERROR_PROGRESSIVE_OPTIONS_CONFLICT;
+	}
+	if (args->compressionTileSize < 0 || args->compressionTileOverlap < 0 || (args->compressionTileSize > 0 && (args->paletteSize > 0
+		|| args->progressive || args->additionalOutputsCount > 0 || args->searchMinimumSize
+		|| args->seedCompressedPath != NULL || args->seedDiagram != NULL))) {
+		printf("Tiled compression can not use palette, progressive file, additional outputs, minimum size search or seed file\n");
+		return ERROR_TILED_OPTIONS_CONFLICT;
+	}
+	if (args->checkpointPath != NULL && (args->compressionTileSize > 0 || args->additionalOutputsCount > 0 || args->searchMinimumSize
+		|| args->computationType == ComputationType::ITERATED_LOCAL_SEARCH || args->computationType == ComputationType::DIFFERENTIAL_EVOLUTION)) {
+		printf("Checkpoint can only be used by local search, evolutionary and memetic computation without tiles, additional outputs or minimum size search\n");
+		return ERROR_CHECKPOINT_OPTIONS_CONFLICT;
+	}
+	if (args->searchMinimumSize && args->targetFitness < 0) {
+		printf("Minimum size search needs target fitness\n");
+		return ERROR_SIZE_SEARCH_WITHOUT_TARGET;
+	}
+
+	stopReason = CompressorAlgorithm::StopReason::NOT_STOPPED;
+	fitness = -1;
+	fitnessEvaluationsCount = 0;
+	stats = CompressorAlgorithm::Stats();
+	releaseOutput();
+
 	int err;
-	err = readSourceImageFile();
+	err = readSourceImage();
 	if (err != 0) {
-		printf("Encountered error during source image file reading with code %d\n", err);
+		printf("Encountered error during source image reading with code %d\n", err);
+		releaseMemory();
+		return err;
+	}
+
+	err = readSeedDiagram();
+	if (err != 0) {
+		printf("Encountered error during seed file reading with code %d\n", err);
+		releaseMemory();
+		return err;
+	}
+
+	if (args->compressionTileSize > 0) {
+		err = compressTiled();
+		if (err == 0) {
+			err = writeStatsFile(args->statsFileName);
+		}
 		releaseMemory();
 		return err;
 	}
 
-	CompressorAlgorithm * compressAlgorithm;
+	// Palette of gray image is only useful if its indices are shorter than gray levels
+	paletteSize = args->paletteSize;
+	if (sourcePixelFormat == PixelFormat::GRAY8 && paletteSize > VorFormat::MAX_GRAY_PALETTE_SIZE) {
+		printf("Palette of gray image is reduced to %d colors\n", VorFormat::MAX_GRAY_PALETTE_SIZE);
+		paletteSize = VorFormat::MAX_GRAY_PALETTE_SIZE;
+	}
+
+	// Outputs are compressed from the smallest, so every larger diagram can start from the smaller one
+	vector<Output> outputs;
+	Output mainOutput;
+	mainOutput.maxCompressedSizeBytes = args->maxCompressedSizeBytes;
+	mainOutput.destinationCompressedPath = args->destinationCompressedPath;
+	mainOutput.destinationImagePath = args->destinationImagePath;
+	mainOutput.destinationCompressedData = args->destinationCompressedData;
+	outputs.push_back(mainOutput);
+	if (!args->searchMinimumSize) {
+		for (int i = 0; i < args->additionalOutputsCount; ++i) {
+			outputs.push_back(args->additionalOutputs[i]);
+		}
+	}
+	sort(outputs.begin(), outputs.end(), [](const Output & first, const Output & second) {
+		return first.maxCompressedSizeBytes < second.maxCompressedSizeBytes;
+	});
+
+	// Calculate how many points compressed files can contain
+	vector<int> diagramPointsCounts;
+	int totalDiagramPointsCount = 0;
+	for (int i = 0; i < outputs.size(); ++i) {
+		diagramPointsCounts.push_back(calculateDiagramPointsCount(outputs[i].maxCompressedSizeBytes));
+		totalDiagramPointsCount += diagramPointsCounts[i];
+	}
+	int maxDiagramPointsCount = diagramPointsCounts.back();
+
+	// Trace is shared by all computations
+	ConvergenceTrace * trace = NULL;
+	if (args->traceFileName != NULL) {
+		trace = new ConvergenceTrace();
+		err = trace->open(args->traceFileName, args->traceFormat, args->traceDecimation, false);
+		if (err != 0) {
+			printf("Trace file %s could not be open\n", args->traceFileName);
+			delete trace;
+			releaseMemory();
+			return err;
+		}
+	}
+
+	// Evaluators are shared by all computations
+	CpuFitnessEvaluator * cpuFitnessEvaluator;
+	FitnessEvaluator * fitnessEvaluator;
+	acquireFitnessEvaluators(maxDiagramPointsCount, &cpuFitnessEvaluator, &fitnessEvaluator);
 
 	// Prepare the arguments for compression algorithm
 	CompressorAlgorithm::Args compressorAlgorithmArgs;
@@ -21,216 +134,949 @@ int Compressor::compress() {
 	compressorAlgorithmArgs.sourceHeight = sourceHeight;
 	compressorAlgorithmArgs.sourceImageData = sourceImageData;
 	compressorAlgorithmArgs.sourceDataRowWidthInBytes = rowWidthInBytes;
-	compressorAlgorithmArgs.limitByTime = args->computationLimit == Compressor::ComputationLimit::TIME;
-	compressorAlgorithmArgs.maxComputationTimeSecs = args->maxComputationTimeSecs;
-	compressorAlgorithmArgs.maxFitnessEvaluationCount = args->maxFitnessEvaluationCount;
-	compressorAlgorithmArgs.useCuda = args->useCuda;
-	compressorAlgorithmArgs.logFileName = args->logFileName;
-	compressorAlgorithmArgs.logImprovementToConsole = args->logImprovementToConsole;
-	
-	// Calculate how many points compressed file can contain
-	int compressedFileDataStorageSize = args->maxCompressedSizeBytes - COMPRESSED_FILE_HEADER_SIZE;
-	int dataPointSize = COMPRESSED_FILE_POINT_POSITION_SIZE + (SUPPORTED_COLOR_DEPTH / 8);
-	compressorAlgorithmArgs.diagramPointsCount = compressedFileDataStorageSize / dataPointSize;
+	compressorAlgorithmArgs.sourcePixelFormat = sourcePixelFormat;
+	fillAlgorithmArgs(&compressorAlgorithmArgs);
+	compressorAlgorithmArgs.fitnessEvaluator = fitnessEvaluator;
+	compressorAlgorithmArgs.cpuFitnessEvaluator = cpuFitnessEvaluator;
+	compressorAlgorithmArgs.trace = trace;
+
+	int * pixelPointAssignment = new int[(int64_t)sourceHeight * sourceWidth];
+	int destinationRowWidthInBytes = BmpFile::calculateRowWidthInBytes(sourceWidth);
+	uint8_t * destinationImageData = new uint8_t[(int64_t)sourceHeight * destinationRowWidthInBytes];
+
+	VoronoiDiagram * previousDiagram = NULL;
+	for (int outputIndex = 0; outputIndex < outputs.size() && err == 0; ++outputIndex) {
+		VoronoiDiagram * compressedDiagram = NULL;
+		Color24bit * diagramColors = NULL;
+
+		if (args->searchMinimumSize) {
+			err = searchMinimumSize(&compressorAlgorithmArgs, maxDiagramPointsCount,
+				&compressedDiagram, &diagramColors, &pixelPointAssignment);
+		}
+		else {
+			int diagramPointsCount = diagramPointsCounts[outputIndex];
+			compressedDiagram = new VoronoiDiagram(diagramPointsCount);
+			diagramColors = new Color24bit[diagramPointsCount];
+			compressorAlgorithmArgs.diagramPointsCount = diagramPointsCount;
 
+			// Computation limit is split among outputs by their count of points
+			double computationShare = diagramPointsCount / (double)totalDiagramPointsCount;
+			compressorAlgorithmArgs.maxComputationTimeSecs = args->maxComputationTimeSecs * computationShare;
+			compressorAlgorithmArgs.maxFitnessEvaluationCount = (int)(args->maxFitnessEvaluationCount * computationShare);
+
+			// Start from the smaller diagram with inserted points
+			VoronoiDiagram * initialDiagram = createInitialDiagram(previousDiagram, diagramPointsCount);
+			compressorAlgorithmArgs.initialDiagram = initialDiagram;
+
+			float fitness;
+			err = runCompressorAlgorithm(&compressorAlgorithmArgs,
+				compressedDiagram, diagramColors, pixelPointAssignment, &fitness);
+			compressorAlgorithmArgs.initialDiagram = NULL;
+			delete initialDiagram;
+		}
+
+		Color24bit * palette = NULL;
+		int * colorPaletteIndices = NULL;
+		if (err == 0 && paletteSize > 0) {
+			// Colors of points are replaced by the palette colors
+			palette = new Color24bit[paletteSize];
+			colorPaletteIndices = new int[compressedDiagram->diagramPointsCount];
+			ColorQuantizer::quantize(sourceWidth, sourceHeight, sourceImageData, rowWidthInBytes, sourcePixelFormat,
+				pixelPointAssignment, compressedDiagram->diagramPointsCount,
+				diagramColors, paletteSize, palette, colorPaletteIndices);
+		}
+
+		if (err == 0) {
+			err = writeCompressedFile(outputs[outputIndex].destinationCompressedPath, outputs[outputIndex].destinationCompressedData,
+				compressedDiagram, diagramColors, palette, colorPaletteIndices);
+			if (err != 0) {
+				printf("Encountered error during compressed output file writing with code %d\n", err);
+			}
+		}
+
+		if (err == 0) {
+			// Fill the colors of compressed image into the output data
+			int bytesPerPixel = PixelFormatUtils::getBytesPerPixel(sourcePixelFormat);
+			double deviationsSum = 0;
+			for (int i = 0; i < sourceHeight; ++i) {
+				for (int j = 0; j < sourceWidth; ++j) {
+					int pointIndex = pixelPointAssignment[(int64_t)i * sourceWidth + j];
+					Color24bit color = diagramColors[pointIndex];
+					uint8_t * sourcePixel = sourceImageData + (int64_t)i * rowWidthInBytes + j * bytesPerPixel;
+					Color24bit sourceColor = PixelFormatUtils::readColor(sourcePixelFormat, sourcePixel);
+					int64_t colorStartIndexInDestinationData = (int64_t)i * destinationRowWidthInBytes + j * 3;
+
+					destinationImageData[colorStartIndexInDestinationData] = color.b;
+					destinationImageData[colorStartIndexInDestinationData + 1] = color.g;
+					destinationImageData[colorStartIndexInDestinationData + 2] = color.r;
+
+					deviationsSum += PixelFormatUtils::getWeight(sourcePixelFormat, sourcePixel)
+						* (abs(sourceColor.b - color.b) + abs(sourceColor.g - color.g) + abs(sourceColor.r - color.r));
+				}
+			}
+			// Outputs are ordered by size, so the largest one is the last
+			fitness = (float)(deviationsSum / ((double)sourceWidth * sourceHeight));
+			if (palette != NULL) {
+				printf("Fitness with palette colors %f\n", fitness);
+			}
+
+			err = writeDestinationImageFile(outputs[outputIndex].destinationImagePath, destinationImageData);
+			if (err != 0) {
+				printf("Encountered error during output image file writing with code %d\n", err);
+			}
+		}
+
+		delete previousDiagram;
+		previousDiagram = compressedDiagram;
+		delete[] outputColors;
+		outputColors = diagramColors;
+		delete[] palette;
+		delete[] colorPaletteIndices;
+	}
+
+	// Diagram of the last output is kept for the caller
+	outputDiagram = previousDiagram;
+	if (err != 0) {
+		releaseOutput();
+	}
+	delete[] pixelPointAssignment;
+	delete[] destinationImageData;
+	releaseFitnessEvaluators(cpuFitnessEvaluator, fitnessEvaluator);
+	delete trace;
+
+	if (err == 0) {
+		err = writeStatsFile(args->statsFileName);
+	}
+	releaseMemory();
+	return err;
+}
+
+void Compressor::acquireFitnessEvaluators(int maxDiagramPointsCount,
+	CpuFitnessEvaluator ** cpuFitnessEvaluator, FitnessEvaluator ** fitnessEvaluator) {
+
+	ReusedFitnessEvaluators * reused = args->reusedFitnessEvaluators;
+	if (reused == NULL) {
+		createFitnessEvaluators(maxDiagramPointsCount, cpuFitnessEvaluator, fitnessEvaluator);
+		return;
+	}
+
+	// Evaluators are replaced if any of them is too small or CUDA usage differs
+	bool isReusable = reused->cpuFitnessEvaluator != NULL
+		&& (reused->fitnessEvaluator != reused->cpuFitnessEvaluator) == args->useCuda
+		&& reused->cpuFitnessEvaluator->resetSourceImage(sourceWidth, sourceHeight, maxDiagramPointsCount,
+			sourceImageData, rowWidthInBytes, sourcePixelFormat)
+		&& (reused->fitnessEvaluator == reused->cpuFitnessEvaluator
+			|| reused->fitnessEvaluator->resetSourceImage(sourceWidth, sourceHeight, maxDiagramPointsCount,
+				sourceImageData, rowWidthInBytes, sourcePixelFormat));
+	if (!isReusable) {
+		reused->release();
+		createFitnessEvaluators(maxDiagramPointsCount, &reused->cpuFitnessEvaluator, &reused->fitnessEvaluator);
+	}
+	*cpuFitnessEvaluator = reused->cpuFitnessEvaluator;
+	*fitnessEvaluator = reused->fitnessEvaluator;
+}
+
+void Compressor::createFitnessEvaluators(int maxDiagramPointsCount,
+	CpuFitnessEvaluator ** cpuFitnessEvaluator, FitnessEvaluator ** fitnessEvaluator) {
+
+	*cpuFitnessEvaluator = new CpuFitnessEvaluator(
+		sourceWidth, sourceHeight, maxDiagramPointsCount, sourceImageData, rowWidthInBytes, sourcePixelFormat);
+	*fitnessEvaluator = *cpuFitnessEvaluator;
+	if (args->useCuda) {
+		*fitnessEvaluator = new CudaFitnessEvaluator(
+			sourceWidth, sourceHeight, maxDiagramPointsCount, sourceImageData, rowWidthInBytes, sourcePixelFormat);
+	}
+}
+
+void Compressor::releaseFitnessEvaluators(CpuFitnessEvaluator * cpuFitnessEvaluator, FitnessEvaluator * fitnessEvaluator) {
+	// Reused evaluators are kept for the next compression
+	if (args->reusedFitnessEvaluators != NULL) {
+		return;
+	}
+	if (fitnessEvaluator != cpuFitnessEvaluator) {
+		delete fitnessEvaluator;
+	}
+	delete cpuFitnessEvaluator;
+}
+
+void Compressor::ReusedFitnessEvaluators::release() {
+	if (fitnessEvaluator != cpuFitnessEvaluator) {
+		delete fitnessEvaluator;
+	}
+	delete cpuFitnessEvaluator;
+	fitnessEvaluator = NULL;
+	cpuFitnessEvaluator = NULL;
+}
+
+int Compressor::calculateDiagramPointsCount(uint32_t maxCompressedSizeBytes) {
+	return VorFormat::calculateMaxDiagramPointsCount(maxCompressedSizeBytes, sourceWidth, sourceHeight,
+		paletteSize, args->indexTileSize, args->progressive, PixelFormatUtils::getChannelsCount(compressedPixelFormat));
+}
+
+int Compressor::readSeedDiagram() {
+	if (args->seedDiagram != NULL) {
+		seedDiagram = scaleSeedDiagram(args->seedDiagram, args->seedDiagramWidth, args->seedDiagramHeight);
+		return 0;
+	}
+	if (args->seedCompressedPath == NULL) {
+		return 0;
+	}
+
+	int32_t seedWidth, seedHeight;
+	VoronoiDiagram * diagram;
+	Color24bit * colors;
+	int err = VorFormat::read(args->seedCompressedPath, &seedWidth, &seedHeight, &diagram, &colors);
+	if (err != 0) {
+		return err;
+	}
+	delete[] colors;
+	seedDiagram = scaleSeedDiagram(diagram, seedWidth, seedHeight);
+	delete diagram;
+	return 0;
+}
+
+VoronoiDiagram * Compressor::scaleSeedDiagram(VoronoiDiagram * diagram, int32_t width, int32_t height) {
+	// Coordinates are scaled, so the corners of both images match
+	double horizontalScale = width > 1 ? (sourceWidth - 1) / (double)(width - 1) : 0;
+	double verticalScale = height > 1 ? (sourceHeight - 1) / (double)(height - 1) : 0;
+	VoronoiDiagram * scaledDiagram = new VoronoiDiagram(diagram->diagramPointsCount);
+	for (int i = 0; i < diagram->diagramPointsCount; ++i) {
+		scaledDiagram->setPoint(i,
+			(int32_t)(diagram->x(i) * horizontalScale + 0.5),
+			(int32_t)(diagram->y(i) * verticalScale + 0.5));
+	}
+
+	// Points of progressive files are stored by their importance
+	CompressorUtils::sortDiagramPoints(scaledDiagram);
+	return scaledDiagram;
+}
+
+VoronoiDiagram * Compressor::createInitialDiagram(VoronoiDiagram * previousDiagram, int diagramPointsCount) {
+	VoronoiDiagram * sourceDiagram = previousDiagram != NULL ? previousDiagram : seedDiagram;
+	if (sourceDiagram == NULL) {
+		return NULL;
+	}
+	VoronoiDiagram * initialDiagram = new VoronoiDiagram(diagramPointsCount);
+	CompressorUtils::resizeDiagram(sourceDiagram, initialDiagram, sourceWidth, sourceHeight);
+	return initialDiagram;
+}
+
+void Compressor::fillAlgorithmArgs(CompressorAlgorithm::Args * algorithmArgs) {
+	algorithmArgs->limitByTime = args->computationLimit == Compressor::ComputationLimit::TIME;
+	algorithmArgs->maxComputationTimeSecs = args->maxComputationTimeSecs;
+	algorithmArgs->maxFitnessEvaluationCount = args->maxFitnessEvaluationCount;
+	algorithmArgs->useCuda = args->useCuda;
+	algorithmArgs->logFileName = args->logFileName;
+	algorithmArgs->logImprovementToConsole = args->logImprovementToConsole;
+	algorithmArgs->targetFitness = args->targetFitness;
+	algorithmArgs->targetPsnr = args->targetPsnr;
+	algorithmArgs->stagnationFitnessEvaluationCount = args->stagnationFitnessEvaluationCount;
+	algorithmArgs->stagnationTimeSecs = args->stagnationTimeSecs;
+	algorithmArgs->stagnationMinRelativeImprovement = args->stagnationMinRelativeImprovement;
+	algorithmArgs->progressCallback = args->progressCallback;
+	algorithmArgs->cancelCallback = args->cancelCallback;
+	algorithmArgs->callbackContext = args->callbackContext;
+	algorithmArgs->checkpointPath = args->checkpointPath;
+	algorithmArgs->checkpointIntervalSecs = args->checkpointIntervalSecs;
+	algorithmArgs->resumeFromCheckpoint = args->resumeFromCheckpoint;
+	algorithmArgs->changedBlocks = args->changedBlocks;
+	algorithmArgs->changedBlockSize = args->changedBlockSize;
+}
+
+CompressorAlgorithm * Compressor::createCompressorAlgorithm(CompressorAlgorithm::Args * algorithmArgs) {
 	if (args->computationType == ComputationType::EVOLUTIONARY) {
-		compressAlgorithm = new EvolutionaryAlgorithm(&compressorAlgorithmArgs);
+		return new EvolutionaryAlgorithm(algorithmArgs);
 	}
 	else if (args->computationType == ComputationType::MEMETIC) {
-		compressAlgorithm = new MemeticAlgorithm(&compressorAlgorithmArgs);
+		return new MemeticAlgorithm(algorithmArgs);
+	}
+	else if (args->computationType == ComputationType::ITERATED_LOCAL_SEARCH) {
+		return new IteratedLocalSearch(algorithmArgs);
+	}
+	else if (args->computationType == ComputationType::DIFFERENTIAL_EVOLUTION) {
+		return new DifferentialEvolution(algorithmArgs);
 	}
 	else {
-		compressAlgorithm = new LocalSearch(&compressorAlgorithmArgs);
+		return new LocalSearch(algorithmArgs);
 	}
+}
 
-	VoronoiDiagram compressedDiagram(compressorAlgorithmArgs.diagramPointsCount);
-	Color24bit * diagramColors = new Color24bit[compressorAlgorithmArgs.diagramPointsCount];
-	int * pixelPointAssignment = new int[sourceHeight * sourceWidth];
+int Compressor::runCompressorAlgorithm(CompressorAlgorithm::Args * algorithmArgs,
+	VoronoiDiagram * outputDiagram, Color24bit * colors, int * pixelPointAssignment,
+	float * fitness) {
 
-	compressAlgorithm->compress(&compressedDiagram, diagramColors, pixelPointAssignment);
+	CompressorAlgorithm * compressAlgorithm = createCompressorAlgorithm(algorithmArgs);
+	int err = compressAlgorithm->compress(outputDiagram, colors, pixelPointAssignment);
+	*fitness = compressAlgorithm->getBestFitness();
+	stopReason = compressAlgorithm->getStopReason();
+	fitnessEvaluationsCount += algorithmArgs->fitnessEvaluator->getFitnessEvaluationsCount();
+	addStats(compressAlgorithm->getStats());
+	printf("Computation stopped: %s\n", CompressorAlgorithm::getStopReasonDescription(stopReason));
 	delete compressAlgorithm;
-	
-	err = writeCompressedFile(&compressedDiagram, diagramColors);
+	if (err == 0 && stopReason == CompressorAlgorithm::StopReason::CANCELLED) {
+		return ERROR_CANCELLED;
+	}
+	return err;
+}
+
+int Compressor::searchMinimumSize(CompressorAlgorithm::Args * algorithmArgs, int maxDiagramPointsCount,
+	VoronoiDiagram ** outputDiagram, Color24bit ** colors, int ** pixelPointAssignment) {
+
+	// Computations stop as soon as they reach the target
+	algorithmArgs->targetFitness = args->targetFitness;
+
+	// Start with the maximal count of points, if it does not reach the target nothing will
+	int passingPointsCount = maxDiagramPointsCount;
+	int failingPointsCount = 0;
+
+	*outputDiagram = new VoronoiDiagram(passingPointsCount);
+	*colors = new Color24bit[passingPointsCount];
+	algorithmArgs->diagramPointsCount = passingPointsCount;
+
+	VoronoiDiagram * seedInitialDiagram = createInitialDiagram(NULL, passingPointsCount);
+	algorithmArgs->initialDiagram = seedInitialDiagram;
+
+	float fitness;
+	int err = runCompressorAlgorithm(algorithmArgs, *outputDiagram, *colors, *pixelPointAssignment, &fitness);
+	algorithmArgs->initialDiagram = NULL;
+	delete seedInitialDiagram;
 	if (err != 0) {
-		releaseMemory();
-		printf("Encountered error during compressed output file writing with code %d\n", err);
 		return err;
 	}
+	printf("Diagram with %d points reached fitness %f\n", passingPointsCount, fitness);
+
+	if (fitness > args->targetFitness) {
+		printf("Target fitness %f cannot be reached within %u bytes\n",
+			args->targetFitness, args->maxCompressedSizeBytes);
+		return 0;
+	}
+
+	int * stepPixelPointAssignment = new int[(int64_t)sourceHeight * sourceWidth];
+
+	// Bisect the count of points, every step starts from the smallest passing diagram
+	while (passingPointsCount - failingPointsCount
+		> Utils::max(1, (int)(passingPointsCount * SIZE_SEARCH_PRECISION))) {
+
+		int pointsCount = (passingPointsCount + failingPointsCount) / 2;
+
+		VoronoiDiagram * initialDiagram = new VoronoiDiagram(pointsCount);
+		CompressorUtils::resizeDiagram(*outputDiagram, initialDiagram, sourceWidth, sourceHeight);
 
-	// Fill the colors of compressed image into the output data (data that we read as input)
-	for (int i = 0; i < sourceHeight; ++i) {
-		for (int j = 0; j < sourceWidth; ++j) {
-			int pointIndex = pixelPointAssignment[i * sourceWidth + j];
-			Color24bit color = diagramColors[pointIndex];
-			int colorStartIndexInSourceData = i * rowWidthInBytes + j * 3;
+		VoronoiDiagram * stepDiagram = new VoronoiDiagram(pointsCount);
+		Color24bit * stepColors = new Color24bit[pointsCount];
+		algorithmArgs->diagramPointsCount = pointsCount;
+		algorithmArgs->initialDiagram = initialDiagram;
 
-			sourceImageData[colorStartIndexInSourceData] = color.b;
-			sourceImageData[colorStartIndexInSourceData + 1] = color.g;
-			sourceImageData[colorStartIndexInSourceData + 2] = color.r;
+		err = runCompressorAlgorithm(algorithmArgs, stepDiagram, stepColors, stepPixelPointAssignment, &fitness);
+		algorithmArgs->initialDiagram = NULL;
+		delete initialDiagram;
+		if (err != 0) {
+			delete stepDiagram;
+			delete[] stepColors;
+			break;
 		}
+		printf("Diagram with %d points reached fitness %f\n", pointsCount, fitness);
+
+		if (fitness <= args->targetFitness) {
+			passingPointsCount = pointsCount;
+			std::swap(*outputDiagram, stepDiagram);
+			std::swap(*colors, stepColors);
+			std::swap(*pixelPointAssignment, stepPixelPointAssignment);
+		}
+		else {
+			failingPointsCount = pointsCount;
+		}
+		delete stepDiagram;
+		delete[] stepColors;
 	}
 
-	delete[] diagramColors;
-	delete[] pixelPointAssignment;
+	delete[] stepPixelPointAssignment;
+	return err;
+}
+
+int Compressor::compressTiled() {
+	int32_t tileSize = args->compressionTileSize;
+	// At least one point is needed to draw the image
+	int maxDiagramPointsCount = Utils::max(1, calculateDiagramPointsCount(args->maxCompressedSizeBytes));
 
-	err = writeDestinationImageFile();
+	vector<Tile> tiles;
+	for (int32_t y = 0; y < sourceHeight; y += tileSize) {
+		for (int32_t x = 0; x < sourceWidth; x += tileSize) {
+			Tile tile;
+			tile.x = x;
+			tile.y = y;
+			tile.width = min(tileSize, sourceWidth - x);
+			tile.height = min(tileSize, sourceHeight - y);
+			tile.pointsCount = 0;
+			tile.fitnessEvaluationsCount = 0;
+			tile.stopReason = CompressorAlgorithm::StopReason::NOT_STOPPED;
+			tile.err = 0;
+			tiles.push_back(tile);
+		}
+	}
+
+	// Points are split among tiles by their areas, remaining points go to the tiles with the largest remainders
+	double imageArea = (double)sourceWidth * sourceHeight;
+	int assignedPointsCount = 0;
+	vector<pair<double, int>> remainders;
+	for (int i = 0; i < tiles.size(); ++i) {
+		double exactPointsCount = maxDiagramPointsCount * ((double)tiles[i].width * tiles[i].height / imageArea);
+		tiles[i].pointsCount = (int)exactPointsCount;
+		assignedPointsCount += tiles[i].pointsCount;
+		remainders.push_back(make_pair(exactPointsCount - tiles[i].pointsCount, i));
+	}
+	sort(remainders.begin(), remainders.end(), greater<pair<double, int>>());
+	for (int i = 0; i < maxDiagramPointsCount - assignedPointsCount && i < remainders.size(); ++i) {
+		++tiles[remainders[i].second].pointsCount;
+	}
+
+	int threadCount = args->threadCount > 0 ? args->threadCount : Utils::max(1, (int)thread::hardware_concurrency());
+	threadCount = min(threadCount, (int)tiles.size());
+
+	// Tiles are compressed in parallel, the time limit is split among them by their count of points
+	double maxComputationTimeSecsPerPoint = args->maxComputationTimeSecs * threadCount / maxDiagramPointsCount;
+	atomic<int> nextTileIndex(0);
+	vector<thread> threads;
+	for (int i = 1; i < threadCount; ++i) {
+		threads.push_back(thread(&Compressor::compressTiles, this, &tiles, &nextTileIndex, maxComputationTimeSecsPerPoint));
+	}
+	compressTiles(&tiles, &nextTileIndex, maxComputationTimeSecsPerPoint);
+	for (int i = 0; i < threads.size(); ++i) {
+		threads[i].join();
+	}
+
+	int err = 0;
+	int mergedPointsCount = 0;
+	for (int i = 0; i < tiles.size(); ++i) {
+		if (tiles[i].err != 0 && err == 0) {
+			err = tiles[i].err;
+		}
+		if (tiles[i].pointsCount > 0) {
+			stopReason = tiles[i].stopReason;
+		}
+		fitnessEvaluationsCount += tiles[i].fitnessEvaluationsCount;
+		addStats(tiles[i].stats);
+		mergedPointsCount += (int)tiles[i].xCoordinates.size();
+	}
 	if (err != 0) {
-		releaseMemory();
-		printf("Encountered error during output image file writing with code %d\n", err);
+		printf("Encountered error during tile compression with code %d\n", err);
 		return err;
 	}
 
-	releaseMemory();
-	return 0;
+	// Points kept from tiles are merged into one diagram with colors calculated from the whole image
+	VoronoiDiagram * mergedDiagram = new VoronoiDiagram(mergedPointsCount);
+	int pointIndex = 0;
+	for (int i = 0; i < tiles.size(); ++i) {
+		for (int j = 0; j < tiles[i].xCoordinates.size(); ++j) {
+			mergedDiagram->setPoint(pointIndex++, tiles[i].xCoordinates[j], tiles[i].yCoordinates[j]);
+		}
+	}
+	CompressorUtils::sortDiagramPoints(mergedDiagram);
+	printf("Merged %d points of %d tiles\n", mergedPointsCount, (int)tiles.size());
+
+	Color24bit * mergedColors = new Color24bit[mergedPointsCount];
+	Rasterizer rasterizer(mergedDiagram, sourceWidth, sourceHeight);
+	calculateMergedColors(&rasterizer, mergedPointsCount, mergedColors, threadCount);
+
+	err = writeCompressedFile(args->destinationCompressedPath, args->destinationCompressedData,
+		mergedDiagram, mergedColors, NULL, NULL);
+	if (err != 0) {
+		printf("Encountered error during compressed output file writing with code %d\n", err);
+	}
+	if (err == 0) {
+		double mergedFitness;
+		err = writeMergedDestinationImageFile(args->destinationImagePath, &rasterizer, mergedColors, threadCount, &mergedFitness);
+		if (err != 0) {
+			printf("Encountered error during output image file writing with code %d\n", err);
+		}
+		else {
+			fitness = (float)mergedFitness;
+			printf("Fitness of merged tiles %f\n", fitness);
+		}
+	}
+
+	if (err == 0) {
+		outputDiagram = mergedDiagram;
+		outputColors = mergedColors;
+	}
+	else {
+		delete mergedDiagram;
+		delete[] mergedColors;
+	}
+	return err;
 }
 
-int Compressor::readSourceImageFile() {
-	FILE* file;
-	errno_t err = fopen_s(
-		&file,
-		args->sourceImagePath,
-		"rb");
-	if (err != 0 || file == NULL) {
-		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+void Compressor::compressTiles(vector<Tile> * tiles, atomic<int> * nextTileIndex, double maxComputationTimeSecsPerPoint) {
+	for (int tileIndex = (*nextTileIndex)++; tileIndex < (int)tiles->size(); tileIndex = (*nextTileIndex)++) {
+		Tile * tile = &(*tiles)[tileIndex];
+		compressTile(tile, maxComputationTimeSecsPerPoint * tile->pointsCount);
 	}
+}
 
-	// Read 14 bytes of Bitmap File Header
-	bitmapFileHeader = new int8_t[BITMAP_FILE_HEADER_SIZE];
-	fread(bitmapFileHeader, 1, BITMAP_FILE_HEADER_SIZE, file);
+void Compressor::compressTile(Tile * tile, double maxComputationTimeSecs) {
+	if (tile->pointsCount == 0) {
+		return;
+	}
 
-	uint32_t totalFileSize = *(int32_t*)&bitmapFileHeader[2];
+	// Tile is extended by the overlap into its neighbours, the overlap gets as many points per pixel as the tile
+	int32_t overlap = args->compressionTileOverlap;
+	int32_t left = Utils::max(0, tile->x - overlap);
+	int32_t top = Utils::max(0, tile->y - overlap);
+	int32_t width = min(sourceWidth, tile->x + tile->width + overlap) - left;
+	int32_t height = min(sourceHeight, tile->y + tile->height + overlap) - top;
+	int pointsCount = (int)((double)tile->pointsCount * width * height / ((double)tile->width * tile->height) + 0.5);
 
-	// Figure where pixel data start
-	int32_t rawDataStartOffset = *(int32_t*)&bitmapFileHeader[10];
+	// Pixels are copied, so only the part of the mapped file under the tile is read
+	int tileRowWidthInBytes = width * PixelFormatUtils::getBytesPerPixel(compressedPixelFormat);
+	uint8_t * tileData = new uint8_t[(int64_t)height * tileRowWidthInBytes];
+	copySourcePixels(left, top, width, height, tileData, tileRowWidthInBytes);
 
-	// Read the rest until pixel data start
-	bitmapInfoHeaderAndRestSize = rawDataStartOffset - BITMAP_FILE_HEADER_SIZE;
-	bitmapInfoHeaderAndRest = new int8_t[bitmapInfoHeaderAndRestSize];
-	fread(bitmapInfoHeaderAndRest, 1, bitmapInfoHeaderAndRestSize, file);
-	
-	int32_t bitmapInfoHeaderSize = *(int32_t*)&bitmapInfoHeaderAndRest[0];
-	if (bitmapInfoHeaderSize != BITMAP_INFO_HEADER_SIZE) {
-		fclose(file);
-		return ERROR_FILE_READING_INVALID_BMP_HEADER;
+	CpuFitnessEvaluator * cpuFitnessEvaluator = new CpuFitnessEvaluator(
+		width, height, pointsCount, tileData, tileRowWidthInBytes, compressedPixelFormat);
+	FitnessEvaluator * fitnessEvaluator = cpuFitnessEvaluator;
+	if (args->useCuda) {
+		fitnessEvaluator = new CudaFitnessEvaluator(
+			width, height, pointsCount, tileData, tileRowWidthInBytes, compressedPixelFormat);
 	}
 
-	sourceWidth = *(int32_t*)&bitmapInfoHeaderAndRest[4];
-	sourceHeight = *(int32_t*)&bitmapInfoHeaderAndRest[8];
+	CompressorAlgorithm::Args algorithmArgs;
+	algorithmArgs.sourceWidth = width;
+	algorithmArgs.sourceHeight = height;
+	algorithmArgs.sourceImageData = tileData;
+	algorithmArgs.sourceDataRowWidthInBytes = tileRowWidthInBytes;
+	algorithmArgs.sourcePixelFormat = compressedPixelFormat;
+	fillAlgorithmArgs(&algorithmArgs);
+	// Logs and progress of tiles compressed in parallel would be mixed
+	algorithmArgs.logFileName = NULL;
+	algorithmArgs.logImprovementToConsole = false;
+	algorithmArgs.progressCallback = NULL;
+	algorithmArgs.changedBlocks = NULL;
+	algorithmArgs.maxComputationTimeSecs = maxComputationTimeSecs;
+	algorithmArgs.diagramPointsCount = pointsCount;
+	algorithmArgs.fitnessEvaluator = fitnessEvaluator;
+	algorithmArgs.cpuFitnessEvaluator = cpuFitnessEvaluator;
 
-	uint16_t sourceColorDepth = *(uint16_t*)&bitmapInfoHeaderAndRest[14];
-	if (sourceColorDepth != SUPPORTED_COLOR_DEPTH) {
-		fclose(file);
-		return ERROR_FILE_READING_UNSUPPORTED_COLOR_DEPTH;
+	VoronoiDiagram * diagram = new VoronoiDiagram(pointsCount);
+	Color24bit * colors = new Color24bit[pointsCount];
+	int * pixelPointAssignment = new int[(int64_t)height * width];
+	CompressorAlgorithm * compressAlgorithm = createCompressorAlgorithm(&algorithmArgs);
+	tile->err = compressAlgorithm->compress(diagram, colors, pixelPointAssignment);
+	tile->stopReason = compressAlgorithm->getStopReason();
+	if (tile->err == 0 && tile->stopReason == CompressorAlgorithm::StopReason::CANCELLED) {
+		tile->err = ERROR_CANCELLED;
 	}
+	tile->fitnessEvaluationsCount = fitnessEvaluator->getFitnessEvaluationsCount();
+	tile->stats = compressAlgorithm->getStats();
+	float fitness = compressAlgorithm->getBestFitness();
+	delete compressAlgorithm;
+
+	if (tile->err == 0) {
+		// Points in the overlap belong to the neighbouring tiles, if no point is in the tile the one closest to its center is kept
+		vector<int> tilePoints;
+		int closestToCenterIndex = 0;
+		double closestToCenterSquareDistance = -1;
+		for (int i = 0; i < pointsCount; ++i) {
+			int32_t x = left + diagram->x(i);
+			int32_t y = top + diagram->y(i);
+			if (x >= tile->x && x < tile->x + tile->width && y >= tile->y && y < tile->y + tile->height) {
+				tilePoints.push_back(i);
+			}
+			double squareDistance = Utils::calculateSquareDistance(x, y, tile->x + tile->width / 2, tile->y + tile->height / 2);
+			if (closestToCenterSquareDistance < 0 || squareDistance < closestToCenterSquareDistance) {
+				closestToCenterIndex = i;
+				closestToCenterSquareDistance = squareDistance;
+			}
+		}
+		if (tilePoints.empty()) {
+			tilePoints.push_back(closestToCenterIndex);
+		}
 
-	uint32_t compressionMethod = *(uint16_t*)&bitmapInfoHeaderAndRest[16];
-	if (compressionMethod != 0) {
-		fclose(file);
-		return ERROR_FILE_READING_UNSUPPORTED_IMAGE_COMPRESSION;
+		// Evenly spread subset is kept if more points than the tile's share are in the tile
+		int keptPointsCount = min((int)tilePoints.size(), tile->pointsCount);
+		for (int i = 0; i < keptPointsCount; ++i) {
+			int pointIndex = tilePoints[(int)((int64_t)i * tilePoints.size() / keptPointsCount)];
+			tile->xCoordinates.push_back(left + diagram->x(pointIndex));
+			tile->yCoordinates.push_back(top + diagram->y(pointIndex));
+		}
+		printf("Tile at (%d, %d) reached fitness %f, %d points are kept\n", tile->x, tile->y, fitness, keptPointsCount);
 	}
 
-	// Read the raw pixel data
-	rowWidthInBytes = ((sourceColorDepth * sourceWidth + 31) / 32) * 4;
-	rowOffsetWidthInBytes = rowWidthInBytes % 4;
-	rowDataWidthInBytes = rowWidthInBytes - rowOffsetWidthInBytes;
+	delete diagram;
+	delete[] colors;
+	delete[] pixelPointAssignment;
+	if (fitnessEvaluator != cpuFitnessEvaluator) {
+		delete fitnessEvaluator;
+	}
+	delete cpuFitnessEvaluator;
+	delete[] tileData;
+}
 
-	sourceImageData = new uint8_t[sourceHeight * rowDataWidthInBytes];
+void Compressor::calculateMergedColors(Rasterizer * rasterizer, int diagramPointsCount, Color24bit * colors, int threadCount) {
+	// Every thread sums colors of a band of rows into its own sums
+	vector<vector<double>> channelSums(threadCount, vector<double>((size_t)diagramPointsCount * 3, 0));
+	vector<vector<double>> weightSums(threadCount, vector<double>(diagramPointsCount, 0));
+	vector<thread> threads;
+	for (int i = 1; i < threadCount; ++i) {
+		int32_t startRow = (int32_t)((int64_t)sourceHeight * i / threadCount);
+		int32_t endRow = (int32_t)((int64_t)sourceHeight * (i + 1) / threadCount);
+		threads.push_back(thread(&Compressor::sumMergedColorRows, this, rasterizer, startRow, endRow,
+			channelSums[i].data(), weightSums[i].data()));
+	}
+	sumMergedColorRows(rasterizer, 0, (int32_t)((int64_t)sourceHeight / threadCount),
+		channelSums[0].data(), weightSums[0].data());
+	for (int i = 0; i < threads.size(); ++i) {
+		threads[i].join();
+	}
 
-	// Used to read row offset
-	uint8_t * rowOffset = new uint8_t[rowOffsetWidthInBytes];
-	// Pixel values are stored by rows from bottom to top, we store them from top to bottom
-	for (int i = sourceHeight - 1; i >= 0; --i) {
-		fread(sourceImageData + (i * rowWidthInBytes), 1, rowDataWidthInBytes, file);
-		if (rowOffsetWidthInBytes > 0) {
-			fread(rowOffset, 1, rowOffsetWidthInBytes, file);
+	// Points without any weight get black color
+	for (int i = 0; i < diagramPointsCount; ++i) {
+		double pointChannelSums[3] = { 0, 0, 0 };
+		double pointWeightSum = 0;
+		for (int t = 0; t < threadCount; ++t) {
+			for (int c = 0; c < 3; ++c) {
+				pointChannelSums[c] += channelSums[t][i * 3 + c];
+			}
+			pointWeightSum += weightSums[t][i];
+		}
+		uint8_t means[3];
+		for (int c = 0; c < 3; ++c) {
+			means[c] = (uint8_t)(pointWeightSum > 0 ? pointChannelSums[c] / pointWeightSum + 0.5 : 0);
 		}
+		colors[i].b = means[0];
+		colors[i].g = means[1];
+		colors[i].r = means[2];
 	}
-	delete[] rowOffset;
+}
 
-	sourceImageFileRestSize = totalFileSize
-		- BITMAP_FILE_HEADER_SIZE 
-		- bitmapInfoHeaderAndRestSize 
-		- (sourceHeight * rowWidthInBytes);
-	if (sourceImageFileRestSize > 0) {
-		sourceImageFileRest = new int8_t[sourceImageFileRestSize];
-		fread(sourceImageFileRest, 1, sourceImageFileRestSize, file);
-	}
+void Compressor::sumMergedColorRows(Rasterizer * rasterizer, int32_t startRow, int32_t endRow,
+	double * channelSums, double * weightSums) {
 
-	fclose(file);
-	return 0;
+	int bytesPerPixel = PixelFormatUtils::getBytesPerPixel(sourcePixelFormat);
+	for (int32_t i = startRow; i < endRow; ++i) {
+		uint8_t * row = sourceImageData + (int64_t)i * rowWidthInBytes;
+		for (int32_t j = 0; j < sourceWidth; ++j) {
+			uint8_t * pixel = row + (int64_t)j * bytesPerPixel;
+			int pointIndex = rasterizer->findClosestPoint(j, i);
+			Color24bit color = PixelFormatUtils::readColor(sourcePixelFormat, pixel);
+			double weight = PixelFormatUtils::getWeight(sourcePixelFormat, pixel);
+			channelSums[pointIndex * 3] += weight * color.b;
+			channelSums[pointIndex * 3 + 1] += weight * color.g;
+			channelSums[pointIndex * 3 + 2] += weight * color.r;
+			weightSums[pointIndex] += weight;
+		}
+	}
 }
 
-int Compressor::writeDestinationImageFile() {
-	FILE* file;
-	errno_t err = fopen_s(
-		&file,
-		args->destinationImagePath,
-		"wb");
-	if (err != 0 || file == NULL) {
-		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+int Compressor::writeMergedDestinationImageFile(const char * path, Rasterizer * rasterizer, Color24bit * colors,
+	int threadCount, double * fitness) {
+
+	FILE * file = NULL;
+	if (path != NULL) {
+		int err = BmpFile::beginWrite(path, sourceWidth, sourceHeight, &file);
+		if (err != 0) {
+			return err;
+		}
 	}
 
-	fwrite(bitmapFileHeader, 1, BITMAP_FILE_HEADER_SIZE, file);
-	fwrite(bitmapInfoHeaderAndRest, 1, bitmapInfoHeaderAndRestSize, file);
+	int bandRowWidthInBytes = BmpFile::calculateRowWidthInBytes(sourceWidth);
+	vector<uint8_t> bandData((size_t)TILED_OUTPUT_BAND_HEIGHT * bandRowWidthInBytes);
+	int bytesPerPixel = PixelFormatUtils::getBytesPerPixel(sourcePixelFormat);
+	double deviationsSum = 0;
+	for (int32_t bandTop = 0; bandTop < sourceHeight; bandTop += TILED_OUTPUT_BAND_HEIGHT) {
+		int32_t bandHeight = min(TILED_OUTPUT_BAND_HEIGHT, sourceHeight - bandTop);
+		rasterizer->rasterize(colors, sourceWidth, bandHeight, 0, bandTop, sourceWidth, bandHeight, 1,
+			bandData.data(), bandRowWidthInBytes, threadCount);
 
-	for (int i = sourceHeight - 1; i >= 0; --i) {
-		fwrite(sourceImageData + i * rowWidthInBytes, 1, rowDataWidthInBytes, file);
-		if (rowOffsetWidthInBytes > 0) {
-			fwrite(sourceImageData, 1, rowOffsetWidthInBytes, file);
+		for (int32_t i = 0; i < bandHeight; ++i) {
+			uint8_t * sourceRow = sourceImageData + (int64_t)(bandTop + i) * rowWidthInBytes;
+			uint8_t * bandRow = bandData.data() + (int64_t)i * bandRowWidthInBytes;
+			for (int32_t j = 0; j < sourceWidth; ++j) {
+				uint8_t * sourcePixel = sourceRow + (int64_t)j * bytesPerPixel;
+				Color24bit sourceColor = PixelFormatUtils::readColor(sourcePixelFormat, sourcePixel);
+				deviationsSum += PixelFormatUtils::getWeight(sourcePixelFormat, sourcePixel)
+					* (abs(sourceColor.b - bandRow[j * 3]) + abs(sourceColor.g - bandRow[j * 3 + 1])
+						+ abs(sourceColor.r - bandRow[j * 3 + 2]));
+			}
+		}
+		if (file != NULL) {
+			BmpFile::writeRows(file, sourceWidth, bandHeight, bandData.data(), bandRowWidthInBytes);
 		}
 	}
-	
-	if (sourceImageFileRestSize > 0) {
-		fwrite(sourceImageFileRest, 1, sourceImageFileRestSize, file);
+	if (file != NULL) {
+		BmpFile::endWrite(file);
 	}
 
-	fflush(file);
-	fclose(file);
+	*fitness = deviationsSum / ((double)sourceWidth * sourceHeight);
 	return 0;
 }
 
-int Compressor::writeCompressedFile(VoronoiDiagram * diagram, Color24bit * colors) {
-	FILE* file;
-	errno_t err = fopen_s(
-		&file,
-		args->destinationCompressedPath,
-		"wb");
-	if (err != 0 || file == NULL) {
+int Compressor::readSourceImage() {
+	int bytesPerPixel;
+	int err = args->sourcePixels != NULL ? useSourcePixels(&bytesPerPixel) : readSourceImageFile(&bytesPerPixel);
+	if (err != 0) {
+		return err;
+	}
+
+	if (bytesPerPixel == 1) {
+		sourcePixelFormat = PixelFormat::GRAY8;
+		compressedPixelFormat = sourcePixelFormat;
+		return 0;
+	}
+	if (bytesPerPixel == 4 && args->weightByAlpha) {
+		sourcePixelFormat = PixelFormat::BGRA32_ALPHA_WEIGHTED;
+		compressedPixelFormat = sourcePixelFormat;
+		return 0;
+	}
+	sourcePixelFormat = bytesPerPixel == 3 ? PixelFormat::BGR24 : PixelFormat::BGRA32;
+	compressedPixelFormat = sourcePixelFormat;
+	if (!isSourceImageGray()) {
+		return 0;
+	}
+
+	compressedPixelFormat = PixelFormat::GRAY8;
+	if (args->compressionTileSize > 0) {
+		// Every tile is converted when it is copied
+		return 0;
+	}
+	convertedSourceImageData = new uint8_t[(int64_t)sourceHeight * sourceWidth];
+	copySourcePixels(0, 0, sourceWidth, sourceHeight, convertedSourceImageData, sourceWidth);
+	sourceImageData = convertedSourceImageData;
+	rowWidthInBytes = sourceWidth;
+	sourcePixelFormat = PixelFormat::GRAY8;
+	return 0;
+}
+
+int Compressor::readSourceImageFile(int * bytesPerPixel) {
+	int err = sourceImageFile.open(args->sourceImagePath);
+	if (err != 0) {
 		return ERROR_FILE_COULD_NOT_OPEN_FILE;
 	}
 
-	// TODO file is smaller than should be
-	int8_t * outputData = new int8_t[14];
-	((int32_t *)outputData)[0] = sourceWidth;
-	((int32_t *)outputData)[1] = sourceHeight;
-	((int16_t *)outputData)[4] = 24;
-	((int32_t *)&(outputData[10]))[0] = diagram->diagramPointsCount;
+	// Error codes of BmpFile are the same as reading error codes of this class
+	BmpFile::ImageLayout layout;
+	err = BmpFile::parse(sourceImageFile.getData(), sourceImageFile.getSize(), &layout);
+	if (err != 0) {
+		return err;
+	}
+	sourceWidth = layout.width;
+	sourceHeight = layout.height;
 
-	fwrite(outputData, 1, 14, file);
-	
-	for (int i = 0; i < diagram->diagramPointsCount; ++i) {
-		((int32_t *)outputData)[0] = diagram->x(i);
-		((int32_t *)outputData)[1] = diagram->y(i);
-		((uint8_t *)outputData)[8] = colors[i].b;
-		((uint8_t *)outputData)[9] = colors[i].g;
-		((uint8_t *)outputData)[10] = colors[i].r;
+	// Pixels are used directly from the mapped file in any row order
+	sourceImageData = layout.topRowData;
+	rowWidthInBytes = layout.rowStrideInBytes;
+	*bytesPerPixel = layout.bytesPerPixel;
+	return 0;
+}
+
+int Compressor::useSourcePixels(int * bytesPerPixel) {
+	// Format may come from a request, so it is checked before it is used
+	if (args->sourcePixelsFormat != PixelFormat::GRAY8 && args->sourcePixelsFormat != PixelFormat::BGR24
+		&& args->sourcePixelsFormat != PixelFormat::BGRA32 && args->sourcePixelsFormat != PixelFormat::BGRA32_ALPHA_WEIGHTED) {
+		return ERROR_INVALID_SOURCE_PIXELS;
+	}
+	*bytesPerPixel = PixelFormatUtils::getBytesPerPixel(args->sourcePixelsFormat);
+	int64_t minRowWidthInBytes = (int64_t)args->sourcePixelsWidth * *bytesPerPixel;
+	if (args->sourcePixelsWidth <= 0 || args->sourcePixelsHeight <= 0
+		|| abs((int64_t)args->sourcePixelsRowWidthInBytes) < minRowWidthInBytes) {
+		return ERROR_INVALID_SOURCE_PIXELS;
+	}
+	sourceWidth = args->sourcePixelsWidth;
+	sourceHeight = args->sourcePixelsHeight;
+	// Source pixels are only read, gray pixels are converted into a copy
+	sourceImageData = const_cast<uint8_t *>(args->sourcePixels);
+	rowWidthInBytes = args->sourcePixelsRowWidthInBytes;
+	return 0;
+}
+
+bool Compressor::isSourceImageGray() {
+	int bytesPerPixel = PixelFormatUtils::getBytesPerPixel(sourcePixelFormat);
+	for (int32_t i = 0; i < sourceHeight; ++i) {
+		uint8_t * row = sourceImageData + (int64_t)i * rowWidthInBytes;
+		for (int32_t j = 0; j < sourceWidth; ++j) {
+			uint8_t * pixel = row + j * bytesPerPixel;
+			if (pixel[0] != pixel[1] || pixel[0] != pixel[2]) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void Compressor::copySourcePixels(int32_t x, int32_t y, int32_t width, int32_t height,
+	uint8_t * output, int outputRowWidthInBytes) {
 
-		fwrite(outputData, 1, 11, file);
+	int bytesPerPixel = PixelFormatUtils::getBytesPerPixel(sourcePixelFormat);
+	for (int32_t i = 0; i < height; ++i) {
+		uint8_t * sourceRow = sourceImageData + (int64_t)(y + i) * rowWidthInBytes + (int64_t)x * bytesPerPixel;
+		uint8_t * outputRow = output + (int64_t)i * outputRowWidthInBytes;
+		if (compressedPixelFormat == sourcePixelFormat) {
+			memcpy(outputRow, sourceRow, (size_t)width * bytesPerPixel);
+			continue;
+		}
+		// Gray levels are taken from the blue channel
+		for (int32_t j = 0; j < width; ++j) {
+			outputRow[j] = sourceRow[j * bytesPerPixel];
+		}
+	}
+}
+
+int Compressor::writeDestinationImageFile(const char * path, uint8_t * imageData) {
+	if (path == NULL) {
+		return 0;
+	}
+	return BmpFile::write(path, sourceWidth, sourceHeight, imageData, BmpFile::calculateRowWidthInBytes(sourceWidth));
+}
+
+void Compressor::addStats(const CompressorAlgorithm::Stats & computationStats) {
+	stats.fitnessEvaluationsCount += computationStats.fitnessEvaluationsCount;
+	stats.computedFitnessEvaluationsCount += computationStats.computedFitnessEvaluationsCount;
+	stats.acceptedSolutionsCount += computationStats.acceptedSolutionsCount;
+	stats.fitnessCacheHitsCount += computationStats.fitnessCacheHitsCount;
+	stats.evaluatedPixelsCount += computationStats.evaluatedPixelsCount;
+	stats.elapsedTimeSecs += computationStats.elapsedTimeSecs;
+	stats.phaseTimes.assignmentSecs += computationStats.phaseTimes.assignmentSecs;
+	stats.phaseTimes.accumulationSecs += computationStats.phaseTimes.accumulationSecs;
+	stats.phaseTimes.averagingSecs += computationStats.phaseTimes.averagingSecs;
+	stats.phaseTimes.errorSecs += computationStats.phaseTimes.errorSecs;
+}
+
+int Compressor::writeStatsFile(const char * path) {
+	if (path == NULL) {
+		return 0;
+	}
+	FILE * file;
+	errno_t err = fopen_s(&file, path, "w");
+	if (err != 0 || file == NULL) {
+		printf("Stats file %s could not be open\n", path);
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
 	}
 
+	// Phases are also reported per evaluated pixel, so images of different sizes can be compared
+	const FitnessEvaluator::PhaseTimes & phaseTimes = stats.phaseTimes;
+	double nanosPerPixel = stats.evaluatedPixelsCount > 0 ? 1e9 / stats.evaluatedPixelsCount : 0;
+	fprintf(file, "{\n");
+	fprintf(file, "  \"width\": %d,\n", sourceWidth);
+	fprintf(file, "  \"height\": %d,\n", sourceHeight);
+	fprintf(file, "  \"algorithm\": \"%s\",\n", getComputationTypeName(args->computationType));
+	fprintf(file, "  \"cuda\": %s,\n", args->useCuda ? "true" : "false");
+	fprintf(file, "  \"fitness_evaluations\": %d,\n", stats.fitnessEvaluationsCount);
+	fprintf(file, "  \"computed_fitness_evaluations\": %d,\n", stats.computedFitnessEvaluationsCount);
+	fprintf(file, "  \"accepted_solutions\": %d,\n", stats.acceptedSolutionsCount);
+	fprintf(file, "  \"fitness_cache_hits\": %d,\n", stats.fitnessCacheHitsCount);
+	fprintf(file, "  \"computation_time_secs\": %.6f,\n", stats.elapsedTimeSecs);
+	fprintf(file, "  \"phase_secs\": {\"assignment\": %.6f, \"accumulation\": %.6f, \"averaging\": %.6f, \"error\": %.6f},\n",
+		phaseTimes.assignmentSecs, phaseTimes.accumulationSecs, phaseTimes.averagingSecs, phaseTimes.errorSecs);
+	fprintf(file, "  \"phase_ns_per_pixel\": {\"assignment\": %.4f, \"accumulation\": %.4f, \"averaging\": %.4f, \"error\": %.4f}\n",
+		phaseTimes.assignmentSecs * nanosPerPixel, phaseTimes.accumulationSecs * nanosPerPixel,
+		phaseTimes.averagingSecs * nanosPerPixel, phaseTimes.errorSecs * nanosPerPixel);
+	fprintf(file, "}\n");
+
 	fflush(file);
 	fclose(file);
 	return 0;
 }
 
+int Compressor::writeCompressedFile(const char * path, vector<uint8_t> * compressedData,
+	VoronoiDiagram * diagram, Color24bit * colors, Color24bit * palette, int * colorPaletteIndices) {
+
+	vector<uint8_t> data;
+	int err;
+	int channelsCount = PixelFormatUtils::getChannelsCount(compressedPixelFormat);
+	if (args->progressive) {
+		err = VorFormat::encodeProgressive(sourceWidth, sourceHeight, diagram, colors,
+			sourceImageData, rowWidthInBytes, sourcePixelFormat, &data);
+	}
+	else if (palette != NULL) {
+		err = VorFormat::encode(sourceWidth, sourceHeight, diagram,
+			palette, paletteSize, colorPaletteIndices, &data, args->indexTileSize, channelsCount);
+	}
+	else {
+		err = VorFormat::encode(sourceWidth, sourceHeight, diagram, colors, &data, args->indexTileSize, channelsCount);
+	}
+
+	if (err == 0 && path != NULL) {
+		err = VorFormat::writeData(path, &data);
+	}
+	if (err == 0 && compressedData != NULL) {
+		compressedData->swap(data);
+	}
+	return err;
+}
+
 void Compressor::releaseMemory() {
-	if (bitmapFileHeader != NULL) {
-		delete[] bitmapFileHeader;
+	if (convertedSourceImageData != NULL) {
+		delete[] convertedSourceImageData;
+		convertedSourceImageData = NULL;
 	}
-	if (bitmapInfoHeaderAndRest != NULL) {
-		delete[] bitmapInfoHeaderAndRest;
+	sourceImageData = NULL;
+	sourceImageFile.close();
+	delete seedDiagram;
+	seedDiagram = NULL;
+}
+
+void Compressor::releaseOutput() {
+	delete outputDiagram;
+	delete[] outputColors;
+	outputDiagram = NULL;
+	outputColors = NULL;
+}
+
+Compressor::~Compressor() {
+	releaseOutput();
+}
+
+bool Compressor::parseComputationType(const char * name, ComputationType * computationType) {
+	const ComputationType computationTypes[] = {
+		ComputationType::LOCAL_SEARCH,
+		ComputationType::EVOLUTIONARY,
+		ComputationType::MEMETIC,
+		ComputationType::ITERATED_LOCAL_SEARCH,
+		ComputationType::DIFFERENTIAL_EVOLUTION
+	};
+	for (int i = 0; i < sizeof(computationTypes) / sizeof(computationTypes[0]); ++i) {
+		if (strcmp(name, getComputationTypeName(computationTypes[i])) == 0) {
+			*computationType = computationTypes[i];
+			return true;
+		}
 	}
-	if (sourceImageData != NULL) {
-		delete[] sourceImageData;
+	return false;
+}
+
+const char * Compressor::getComputationTypeName(ComputationType computationType) {
+	switch (computationType) {
+	case ComputationType::EVOLUTIONARY:
+		return "evolutionary";
+	case ComputationType::MEMETIC:
+		return "memetic";
+	case ComputationType::ITERATED_LOCAL_SEARCH:
+		return "iterated_local_search";
+	case ComputationType::DIFFERENTIAL_EVOLUTION:
+		return "differential_evolution";
+	default:
+		return "local_search";
 	}
-}
\ No newline at end of file
+}
+
+CompressorAlgorithm::StopReason Compressor::getStopReason() {
+	return stopReason;
+}
+
+float Compressor::getFitness() {
+	return fitness;
+}
+
+int Compressor::getFitnessEvaluationsCount() {
+	return fitnessEvaluationsCount;
+}
+
+CompressorAlgorithm::Stats Compressor::getStats() {
+	return stats;
+}
+
+VoronoiDiagram * Compressor::getDiagram() {
+	return outputDiagram;
+}
+
+Color24bit * Compressor::getColors() {
+	return outputColors;
+}
@@ -3,23 +3,33 @@
 #include <string>
 #include <cstdint>
 #include "compressoralgorithm.h"
+#include "bmpfile.h"
+#include "rasterizer.h"
+#include "mappedfile.h"
+#include "checkpoint.h"
 #include <string>
+#include <vector>
+#include <atomic>
 
 namespace lossycompressor {
 	
 	/// Class compressing image files into voronoi diagram.
 	/**
-		Currently only images in BMP format with 24 bit color depth are supported.
-
-		Compressed file has following format:
-		4 bytes - image width,
-		4 bytes - image height,
-		2 bytes - image color depth,
-		4 bytes - count of points in diagram.
-		Rest of the file contains diagram points in following format:
-			4 bytes - point x coordinate,
-			4 bytes - point y coordinate,
-			3 bytes - point color.
+		Currently only images in BMP format with 24 or 32 bit color depth and 8 bit gray images are supported,
+		alpha channel of 32 bit images is ignored unless pixels are weighted by it.
+		Images with only gray pixels are compressed as gray, so only one channel is evaluated and stored.
+		Compressed files are written in the format described in VorFormat.
+
+		Images too large to be compressed at once can be split into overlapping tiles compressed
+		independently in parallel threads. Only points in the tile itself are kept from every tile,
+		so a point near the tile edge is placed knowing the pixels behind it. Kept points are merged
+		into one diagram whose colors are calculated from the whole image. Memory used by the computation
+		is then bounded by the tile size, the source file is mapped into memory and the reconstructed image
+		is written by bands of rows.
+
+		Source image can also be passed as pixels in memory and the compressed file can be returned
+		as bytes instead of being written, so the compressor can be embedded without temporary files.
+		Compressor keeps no global state, so more instances can compress in parallel threads.
 	*/
 	class Compressor {
 	public:
@@ -27,7 +37,9 @@ namespace lossycompressor {
 		enum ComputationType {
 			LOCAL_SEARCH,	///< Local search.
 			EVOLUTIONARY,	///< Evolutionary algorithm.
-			MEMETIC			///< Memetic algorithm.
+			MEMETIC,		///< Memetic algorithm.
+			ITERATED_LOCAL_SEARCH,	///< Local search restarted from perturbed best solution when it stagnates.
+			DIFFERENTIAL_EVOLUTION	///< Self-adaptive differential evolution over point coordinates.
 		};
 
 		/// Type of computation limit.
@@ -36,11 +48,33 @@ namespace lossycompressor {
 			FITNESS_COUNT	///< Computation is limited by the count of fitness function evaluation. Limit must be passed in arguments.
 		};
 
+		/// Compressed output of the image.
+		struct Output {
+			uint32_t maxCompressedSizeBytes;		///< Maximum size of compressed file in bytes.
+			const char * destinationCompressedPath;	///< Output path of the compressed file.
+			const char * destinationImagePath;		///< Output path of the image file reconstructed from the compressed file.
+			std::vector<uint8_t> * destinationCompressedData = NULL;	///< Bytes of the compressed file are stored here if not NULL.
+		};
+
+		/// Fitness evaluators kept between compressions of more images, so their buffers are allocated only once.
+		/**
+			Evaluators whose buffers are too small for the compressed image are replaced by larger ones.
+			Owner of this structure deletes the evaluators by release().
+		*/
+		struct ReusedFitnessEvaluators {
+			CpuFitnessEvaluator * cpuFitnessEvaluator = NULL;	///< Evaluator using CPU.
+			FitnessEvaluator * fitnessEvaluator = NULL;			///< Evaluator used by computations, the same as cpuFitnessEvaluator if CUDA is not used.
+
+			/// Deletes the evaluators.
+			void release();
+		};
+
 		/// Instance of this class is passed as a parameter into Compressor. Contains compression input data and compression settings.
 		struct Args {
-			const char * sourceImagePath;										///< Path of the source image.
-			const char * destinationCompressedPath;								///< Output path of the compressed file.
-			const char * destinationImagePath;									///< Output path of the image file reconstructed from the compressed file.
+			const char * sourceImagePath;										///< Path of the source image, not used if source pixels are set.
+			const char * destinationCompressedPath;								///< Output path of the compressed file, file is not written if NULL.
+			const char * destinationImagePath;									///< Output path of the image file reconstructed from the compressed file, file is not written if NULL.
+			std::vector<uint8_t> * destinationCompressedData = NULL;			///< Bytes of the compressed file are stored here if not NULL.
 			uint32_t maxCompressedSizeBytes;									///< Maximum size of compressed file in bytes.
 			ComputationType computationType = ComputationType::LOCAL_SEARCH;	///< Type of computation.
 			ComputationLimit computationLimit = ComputationLimit::TIME;			///< Type of computation limit.
@@ -49,55 +83,217 @@ namespace lossycompressor {
 			bool useCuda = false;												///< True if CUDA acceleration should be used, false otherwise.
 			char * logFileName = NULL;											///< Path to file into which log of fitness values will be written. Log will be appended to the end of this file. No log will be written if pointer is equal to NULL.
 			bool logImprovementToConsole;										///< True if computation should log current fitness into console, false otherwise.
+			const char * traceFileName = NULL;									///< Path of the file into which trace of fitness evaluations of all computations is written by a background thread, see ConvergenceTrace. Not written if NULL, tiles are not traced.
+			ConvergenceTrace::Format traceFormat = ConvergenceTrace::Format::CSV;	///< Format of the trace file.
+			int traceDecimation = 1;											///< Every traceDecimation-th evaluation is traced together with all improvements of the best solution.
+			const char * statsFileName = NULL;									///< Path of the JSON file into which counters and phase timers of all computations are written at the end of the compression, see getStats(). Not written if NULL.
+
+			// Additional stopping criteria, computation stops when any of the enabled criteria or the computation limit is met
+			float targetFitness = -1;											///< Computation stops when best fitness is lower or equal to this value. Disabled if negative.
+			double targetPsnr = -1;												///< Computation stops when PSNR of the best solution in decibels is greater or equal to this value. Disabled if negative.
+			int stagnationFitnessEvaluationCount = 0;							///< Computation stops after this many fitness evaluations without significant improvement. Disabled if 0.
+			double stagnationTimeSecs = 0;										///< Computation stops after this many seconds without significant improvement. Disabled if 0.
+			float stagnationMinRelativeImprovement = 0.001f;					///< Minimal relative improvement of best fitness that is considered significant by the stagnation criteria.
+
+			Output * additionalOutputs = NULL;									///< Outputs with other sizes compressed in the same run. Every larger output starts from the smaller one and computation limits are split among outputs by their count of points.
+			int additionalOutputsCount = 0;										///< Count of additional outputs.
+
+			int paletteSize = 0;												///< Count of colors in palette into which colors of points are quantized. Colors are stored in every point if 0. Saved bytes are used for more points.
+			bool progressive = false;											///< True if points are written in the compressed file by their contribution to the image, so its beginning can be drawn. Palette and tile index can not be used then.
+			int32_t indexTileSize = 0;											///< Size of tiles in pixels of tile index stored in compressed file for drawing windows of the image without reading whole file. No index is stored if 0.
+
+			bool weightByAlpha = false;											///< True if colors and deviations of pixels of 32 bit images are weighted by their alpha, so transparent pixels do not affect the compression.
+
+			bool searchMinimumSize = false;										///< True if the smallest compressed file reaching targetFitness should be searched for. maxCompressedSizeBytes is then the upper bound of the size and computation limits apply to every search step. Additional outputs are ignored.
+
+			int32_t compressionTileSize = 0;									///< Size of tiles in pixels that are compressed independently and merged into one diagram. Whole image is compressed at once if 0. Palette, progressive file, additional outputs and minimum size search can not be used with tiles.
+			int32_t compressionTileOverlap = 32;								///< Count of pixels by which compressed tiles extend into their neighbours.
+			int threadCount = 0;												///< Count of threads compressing tiles, count of hardware threads if 0. Time limit is the limit of the whole computation, fitness evaluation limit applies to every tile.
+
+			ReusedFitnessEvaluators * reusedFitnessEvaluators = NULL;			///< Evaluators kept from previous compressions, evaluators are created and deleted by every compression if NULL. Tiles always use their own evaluators.
+
+			// Source image in memory, compressed instead of the source image file if not NULL
+			const uint8_t * sourcePixels = NULL;								///< Pixels stored by rows from left to right and top to bottom, they are only read and must live until compression ends.
+			int32_t sourcePixelsWidth = 0;										///< Width of the source image in pixels.
+			int32_t sourcePixelsHeight = 0;										///< Height of the source image in pixels.
+			int sourcePixelsRowWidthInBytes = 0;								///< Distance from the start of a row to the start of the row below it, negative if rows are stored from bottom to top in memory.
+			PixelFormat sourcePixelsFormat = PixelFormat::BGR24;				///< Format of source pixels, alpha of 32 bit pixels is weighted only if weightByAlpha is set.
+
+			CompressorAlgorithm::ProgressCallback progressCallback = NULL;		///< Called when the best solution of a computation improves, not called for tiles.
+			CompressorAlgorithm::CancelCallback cancelCallback = NULL;			///< Called before every step of computations, compression fails with ERROR_CANCELLED when it returns true. Outputs finished before the cancel stay written, as outputs are computed from the smallest. It is called from parallel threads in tiled compression.
+			void * callbackContext = NULL;										///< Passed to the callbacks.
+
+			const char * checkpointPath = NULL;									///< File into which the state of the computation is periodically written, so it can continue after interruption. Only local search, evolutionary and memetic computations of one output without tiles and minimum size search can use it.
+			double checkpointIntervalSecs = 60;									///< Time between writes of the checkpoint.
+			bool resumeFromCheckpoint = false;									///< True if the computation should continue from the checkpoint file, it starts from the beginning if the file does not exist.
+
+			const char * seedCompressedPath = NULL;								///< Compressed file whose diagram the computation starts from, so a similar image is compressed in a fraction of the time. Diagram is scaled to the source image and its points are trimmed or completed by random points. Tiled compression can not use it.
+			VoronoiDiagram * seedDiagram = NULL;								///< Sorted diagram in memory used instead of the seed file, it is only read.
+			int32_t seedDiagramWidth = 0;										///< Width of the image of the seed diagram.
+			int32_t seedDiagramHeight = 0;										///< Height of the image of the seed diagram.
+			const uint8_t * changedBlocks = NULL;								///< Mask of square blocks of the source image whose pixels changed against the seed, stored by rows from the top, nonzero for changed blocks. Tweaked points are taken from changed blocks when possible. Not used by tiles.
+			int32_t changedBlockSize = 16;										///< Size of blocks of the mask in pixels.
 		};
 	private:
-		const int SUPPORTED_COLOR_DEPTH = 24;
-		
-		const int COMPRESSED_FILE_HEADER_SIZE = 14;
-		const int COMPRESSED_FILE_POINT_POSITION_SIZE = 8;
+		// Relative difference of points counts at which the minimum size search stops
+		const float SIZE_SEARCH_PRECISION = 0.01f;
+		// Count of rows of the reconstructed image of tiled compression drawn at once
+		const int32_t TILED_OUTPUT_BAND_HEIGHT = 128;
 
-		const int BITMAP_FILE_HEADER_SIZE = 14;
-		const int BITMAP_INFO_HEADER_SIZE = 40;
+		// Part of the image compressed independently in tiled compression
+		struct Tile {
+			int32_t x;						// Position and size of the tile without the overlap
+			int32_t y;
+			int32_t width;
+			int32_t height;
+			int pointsCount;				// Count of points that can be kept from the tile
+			std::vector<int32_t> xCoordinates;	// Kept points in coordinates of the image
+			std::vector<int32_t> yCoordinates;
+			CompressorAlgorithm::StopReason stopReason;
+			int fitnessEvaluationsCount;
+			CompressorAlgorithm::Stats stats;
+			int err;
+		};
 
 		Compressor::Args* args;
 
 		// Information from source file's headers
 		int32_t sourceWidth;
 		int32_t sourceHeight;
-		// Raw image data (stored for later writing into the output file)
-		int8_t * bitmapFileHeader = NULL;
-		int bitmapInfoHeaderAndRestSize;
-		// Contains the BIH and rest of data until pixel data start
-		int8_t * bitmapInfoHeaderAndRest = NULL;
+		// Source image file mapped into memory, pixels are used in place
+		MappedFile sourceImageFile;
+		// Pixels converted to gray levels if a color image has only gray pixels
+		uint8_t * convertedSourceImageData = NULL;
 		// Pixel data stored by rows of pixels from left to right and top to bottom
-		int rowWidthInBytes;
-		int rowDataWidthInBytes;
-		int rowOffsetWidthInBytes;
 		uint8_t * sourceImageData = NULL;
-		// Rest of the file after pixel data
-		int sourceImageFileRestSize;
-		int8_t * sourceImageFileRest = NULL;
+		PixelFormat sourcePixelFormat;
+		// Format of compressed pixels, gray if the source image has only gray pixels
+		PixelFormat compressedPixelFormat;
+		// Distance from the start of a row to the start of the row below it, negative if rows are stored from bottom to top in memory
+		int rowWidthInBytes;
+
+		// Count of palette colors, reduced for gray images
+		int paletteSize;
 
 		// Compressed image representation
 		void * compressedImage;
 
-		int readSourceImageFile();
-		int writeDestinationImageFile();
-		int writeCompressedFile(VoronoiDiagram * diagram, Color24bit * colors);
+		CompressorAlgorithm::StopReason stopReason = CompressorAlgorithm::StopReason::NOT_STOPPED;
+		float fitness = -1;
+		int fitnessEvaluationsCount = 0;
+		CompressorAlgorithm::Stats stats;
+
+		// Diagram of the seed compressed file scaled to the source image, NULL if there is none
+		VoronoiDiagram * seedDiagram = NULL;
+
+		// Diagram and colors of the largest output of the last compression
+		VoronoiDiagram * outputDiagram = NULL;
+		Color24bit * outputColors = NULL;
+
+		// Reads the source image file or uses the source pixels from arguments
+		int readSourceImage();
+		int readSourceImageFile(int * bytesPerPixel);
+		int useSourcePixels(int * bytesPerPixel);
+		bool isSourceImageGray();
+		// Copies pixels of the source image in the compressed pixel format
+		void copySourcePixels(int32_t x, int32_t y, int32_t width, int32_t height,
+			uint8_t * output, int outputRowWidthInBytes);
+		int readSeedDiagram();
+		// Returns copy of the diagram with coordinates scaled from an image of given size to the source image
+		VoronoiDiagram * scaleSeedDiagram(VoronoiDiagram * diagram, int32_t width, int32_t height);
+		// Returns diagram with given count of points from which the computation starts, NULL if it starts from a random diagram
+		VoronoiDiagram * createInitialDiagram(VoronoiDiagram * previousDiagram, int diagramPointsCount);
+		// Sets computation settings of the algorithm that are the same for the whole image and for tiles
+		void fillAlgorithmArgs(CompressorAlgorithm::Args * algorithmArgs);
+		int calculateDiagramPointsCount(uint32_t maxCompressedSizeBytes);
+		// Returns evaluators of the source image, reused ones if the arguments contain them
+		void acquireFitnessEvaluators(int maxDiagramPointsCount,
+			CpuFitnessEvaluator ** cpuFitnessEvaluator, FitnessEvaluator ** fitnessEvaluator);
+		void createFitnessEvaluators(int maxDiagramPointsCount,
+			CpuFitnessEvaluator ** cpuFitnessEvaluator, FitnessEvaluator ** fitnessEvaluator);
+		// Deletes evaluators unless they are reused
+		void releaseFitnessEvaluators(CpuFitnessEvaluator * cpuFitnessEvaluator, FitnessEvaluator * fitnessEvaluator);
+		CompressorAlgorithm * createCompressorAlgorithm(CompressorAlgorithm::Args * algorithmArgs);
+		int runCompressorAlgorithm(CompressorAlgorithm::Args * algorithmArgs,
+			VoronoiDiagram * outputDiagram, Color24bit * colors, int * pixelPointAssignment,
+			float * fitness);
+		// Bisects the count of points to find the smallest diagram reaching the target fitness
+		int searchMinimumSize(CompressorAlgorithm::Args * algorithmArgs, int maxDiagramPointsCount,
+			VoronoiDiagram ** outputDiagram, Color24bit ** colors, int ** pixelPointAssignment);
+		int compressTiled();
+		// Compresses tiles taken from the shared counter until all tiles are taken
+		void compressTiles(std::vector<Tile> * tiles, std::atomic<int> * nextTileIndex, double maxComputationTimeSecsPerPoint);
+		void compressTile(Tile * tile, double maxComputationTimeSecs);
+		// Calculates colors of points of the merged diagram from the whole image
+		void calculateMergedColors(Rasterizer * rasterizer, int diagramPointsCount, Color24bit * colors, int threadCount);
+		void sumMergedColorRows(Rasterizer * rasterizer, int32_t startRow, int32_t endRow,
+			double * channelSums, double * weightSums);
+		// Draws the image reconstructed from the merged diagram by bands of rows, only the fitness is calculated if the path is NULL
+		int writeMergedDestinationImageFile(const char * path, Rasterizer * rasterizer, Color24bit * colors,
+			int threadCount, double * fitness);
+		int writeDestinationImageFile(const char * path, uint8_t * imageData);
+		// Adds counters and timers of a computation to the stats of the compression
+		void addStats(const CompressorAlgorithm::Stats & computationStats);
+		int writeStatsFile(const char * path);
+		// Writes the compressed file if the path is not NULL and stores its bytes if the data are not NULL,
+		// palette and indices of point colors in it are NULL if colors are stored in points
+		int writeCompressedFile(const char * path, std::vector<uint8_t> * compressedData,
+			VoronoiDiagram * diagram, Color24bit * colors, Color24bit * palette, int * colorPaletteIndices);
 		void releaseMemory();
+		void releaseOutput();
 	public:
 		static const int ERROR_FILE_COULD_NOT_OPEN_FILE = 2;					///< Compression error code. File could not be open.
-		static const int ERROR_FILE_READING_INVALID_BMP_HEADER = 3;				///< Compression error code. File has invalid header.
-		static const int ERROR_FILE_READING_UNSUPPORTED_COLOR_DEPTH = 4;		///< Compression error code. Input file has invalid color depth.
-		static const int ERROR_FILE_READING_UNSUPPORTED_IMAGE_COMPRESSION = 5;	///< Compression error code. Input file has unsupported image compression.
+		static const int ERROR_FILE_READING_INVALID_BMP_HEADER = BmpFile::ERROR_INVALID_BMP_HEADER;							///< Compression error code. File has invalid header.
+		static const int ERROR_FILE_READING_UNSUPPORTED_COLOR_DEPTH = BmpFile::ERROR_UNSUPPORTED_COLOR_DEPTH;				///< Compression error code. Input file has invalid color depth.
+		static const int ERROR_FILE_READING_UNSUPPORTED_IMAGE_COMPRESSION = BmpFile::ERROR_UNSUPPORTED_IMAGE_COMPRESSION;	///< Compression error code. Input file has unsupported image compression.
+		static const int ERROR_TILED_OPTIONS_CONFLICT = 13;					///< Compression error code. Tiled compression is combined with palette, progressive file, additional outputs, minimum size search or seed file, or tile size or overlap is negative.
+		static const int ERROR_INVALID_SOURCE_PIXELS = 15;					///< Compression error code. Source pixels have invalid size, row width or pixel format.
+		static const int ERROR_CANCELLED = 16;								///< Compression error code. Cancel callback stopped the compression, output being computed was not written, smaller outputs finished before it stay written.
+		static const int ERROR_CHECKPOINT_OPTIONS_CONFLICT = 19;			///< Compression error code. Checkpoint is combined with tiles, additional outputs, minimum size search or computation type that does not support it.
+		static const int ERROR_INVALID_CHECKPOINT = Checkpoint::ERROR_INVALID_CHECKPOINT;	///< Compression error code. Checkpoint file is damaged or it was written by a different computation.
+		static const int ERROR_SIZE_SEARCH_WITHOUT_TARGET = 21;				///< Compression error code. Minimum size search is used without target fitness.
+
+		/// Parses name of the computation type, one of local_search, evolutionary, memetic, iterated_local_search and differential_evolution.
+		/**
+			\return	True if the name is known, false otherwise.
+		*/
+		static bool parseComputationType(const char * name, ComputationType * computationType);
+
+		/// Returns name of the computation type, see parseComputationType().
+		static const char * getComputationTypeName(ComputationType computationType);
 
 		/// Construct a new Compressor with given arguments.
 		Compressor(Compressor::Args * args) : args(args) {};
+		~Compressor();
 
 		/// Do compression.
 		/**
 			\return	0 if compression was successfull. Error code if compression was interrupted with error.
 		*/
 		int compress();
+
+		/// Returns the reason why the last compression computation stopped.
+		CompressorAlgorithm::StopReason getStopReason();
+
+		/// Returns fitness of the largest output of the last compression calculated from its written colors, -1 if no output was written.
+		float getFitness();
+
+		/// Returns count of fitness evaluations of all computations of the last compression.
+		int getFitnessEvaluationsCount();
+
+		/// Returns sums of counters and timers of all computations of the last compression, tiles included.
+		CompressorAlgorithm::Stats getStats();
+
+		/// Returns diagram of the largest output of the last compression, NULL if it failed.
+		/**
+			Diagram is owned by the compressor and deleted by the next compression or with the compressor.
+		*/
+		VoronoiDiagram * getDiagram();
+
+		/// Returns colors of points of the diagram of the largest output, see getDiagram().
+		/**
+			Colors are replaced by the palette colors if the palette is used.
+		*/
+		Color24bit * getColors();
 	};
 }
\ No newline at end of file
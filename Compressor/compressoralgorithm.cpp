@@ -1,19 +1,31 @@
 #include "compressor.h"
 #include "compressoralgorithm.h"
 #include "cudafitnessevaluator.h"
+#include "compressorutils.h"
 #include "utils.h"
+#include "checkpoint.h"
+#include <cmath>
+#include <sstream>
 
 using namespace std;
 using namespace lossycompressor;
 
 CompressorAlgorithm::CompressorAlgorithm(CompressorAlgorithm::Args* args)
 : args(args) {
+	ownsFitnessEvaluators = args->fitnessEvaluator == NULL;
+	if (!ownsFitnessEvaluators) {
+		fitnessEvaluator = args->fitnessEvaluator;
+		cpuFitnessEvaluator = args->cpuFitnessEvaluator;
+		return;
+	}
+
 	cpuFitnessEvaluator = new CpuFitnessEvaluator(
 		args->sourceWidth, 
 		args->sourceHeight,
 		args->diagramPointsCount,
 		args->sourceImageData,
-		args->sourceDataRowWidthInBytes);
+		args->sourceDataRowWidthInBytes,
+		args->sourcePixelFormat);
 
 	if (args->useCuda) {
 		fitnessEvaluator = new CudaFitnessEvaluator(
@@ -21,7 +33,8 @@ CompressorAlgorithm::CompressorAlgorithm(CompressorAlgorithm::Args* args)
 			args->sourceHeight,
 			args->diagramPointsCount,
 			args->sourceImageData,
-			args->sourceDataRowWidthInBytes);
+			args->sourceDataRowWidthInBytes,
+			args->sourcePixelFormat);
 	}
 	else {
 		fitnessEvaluator = cpuFitnessEvaluator;
@@ -29,6 +42,9 @@ CompressorAlgorithm::CompressorAlgorithm(CompressorAlgorithm::Args* args)
 }
 
 CompressorAlgorithm::~CompressorAlgorithm() {
+	if (!ownsFitnessEvaluators) {
+		return;
+	}
 	if (fitnessEvaluator != cpuFitnessEvaluator) {
 		delete cpuFitnessEvaluator;
 	}
@@ -48,58 +64,286 @@ float CompressorAlgorithm::calculateFitness(VoronoiDiagram * diagram) {
 
 int CompressorAlgorithm::compress(VoronoiDiagram * outputDiagram,
 	Color24bit * colors, int * pixelPointAssignment) {
-	if (args->limitByTime) {
-		Utils::recordTime(&computationStartTime);
-	}
-	else {
-		fitnessEvaluator->resetFitnessCalculationCount();
-	}
+	Utils::recordTime(&computationStartTime);
+	lastCheckpointTime = computationStartTime;
+	fitnessEvaluator->resetFitnessCalculationCount();
+
+	// Evaluators may be shared with previous computations, so their counters are not reset
+	stats = Stats();
+	startFitnessCacheHitsCount = fitnessEvaluator->getFitnessCacheHitsCount();
+	startFitnessCacheMissesCount = fitnessEvaluator->getFitnessCacheMissesCount();
+	startPhaseTimes = fitnessEvaluator->getPhaseTimes();
 
 	// Open log file
 	if (args->logFileName != NULL) {
-		errno_t err = fopen_s(
-			&logFile,
-			args->logFileName,
-			"ab");
-		if (err != 0 || logFile == NULL) {
+		logTrace = new ConvergenceTrace();
+		int err = logTrace->open(args->logFileName, ConvergenceTrace::Format::FITNESS_LOG, 1, true);
+		if (err != 0) {
+			delete logTrace;
+			logTrace = NULL;
 			return Compressor::ERROR_FILE_COULD_NOT_OPEN_FILE;
 		}
 	}
 
 	int result = compressInternal(outputDiagram, colors, pixelPointAssignment);
-	if (args->logFileName != NULL) {
-		fprintf(logFile, "\n");
-		fflush(logFile);
-		fclose(logFile);
+
+	LARGE_INTEGER computationEndTime;
+	Utils::recordTime(&computationEndTime);
+	FitnessEvaluator::PhaseTimes phaseTimes = fitnessEvaluator->getPhaseTimes();
+	stats.computedFitnessEvaluationsCount = fitnessEvaluator->getFitnessCacheMissesCount() - startFitnessCacheMissesCount;
+	stats.fitnessCacheHitsCount = fitnessEvaluator->getFitnessCacheHitsCount() - startFitnessCacheHitsCount;
+	stats.fitnessEvaluationsCount = stats.computedFitnessEvaluationsCount + stats.fitnessCacheHitsCount;
+	stats.evaluatedPixelsCount = (double)stats.computedFitnessEvaluationsCount * args->sourceWidth * args->sourceHeight;
+	stats.elapsedTimeSecs = Utils::calculateInterval(&computationStartTime, &computationEndTime);
+	stats.phaseTimes.assignmentSecs = phaseTimes.assignmentSecs - startPhaseTimes.assignmentSecs;
+	stats.phaseTimes.accumulationSecs = phaseTimes.accumulationSecs - startPhaseTimes.accumulationSecs;
+	stats.phaseTimes.averagingSecs = phaseTimes.averagingSecs - startPhaseTimes.averagingSecs;
+	stats.phaseTimes.errorSecs = phaseTimes.errorSecs - startPhaseTimes.errorSecs;
+
+	if (logTrace != NULL) {
+		logTrace->close();
+		delete logTrace;
+		logTrace = NULL;
 	}
 	return result;
 }
 
 bool CompressorAlgorithm::canContinueComputing() {
-	if (args->limitByTime) {
-		LARGE_INTEGER currentTime;
+	StopReason reason = checkStopReason();
+	if (reason != StopReason::NOT_STOPPED) {
+		stopReason = reason;
+		return false;
+	}
+	return true;
+}
+
+CompressorAlgorithm::StopReason CompressorAlgorithm::checkStopReason() {
+	if (args->cancelCallback != NULL && args->cancelCallback(args->callbackContext)) {
+		return StopReason::CANCELLED;
+	}
+
+	LARGE_INTEGER currentTime;
+	if (args->limitByTime || args->stagnationTimeSecs > 0) {
 		Utils::recordTime(&currentTime);
-		return Utils::calculateInterval(&computationStartTime, &currentTime)
-			< args->maxComputationTimeSecs;
 	}
-	else {
-		return fitnessEvaluator->getFitnessEvaluationsCount() < args->maxFitnessEvaluationCount;
+
+	if (args->limitByTime) {
+		if (getElapsedTimeSecs(&currentTime) >= args->maxComputationTimeSecs) {
+			return StopReason::TIME_LIMIT;
+		}
+	}
+	else if (fitnessEvaluator->getFitnessEvaluationsCount() >= args->maxFitnessEvaluationCount) {
+		return StopReason::FITNESS_COUNT_LIMIT;
+	}
+
+	// Rest of the criteria need at least one evaluated solution
+	if (bestFitness == -1) {
+		return StopReason::NOT_STOPPED;
+	}
+
+	if (args->targetFitness >= 0 && bestFitness <= args->targetFitness) {
+		return StopReason::TARGET_FITNESS_REACHED;
+	}
+	if (args->targetPsnr >= 0 && calculatePsnr(bestMeanSquaredError) >= args->targetPsnr) {
+		return StopReason::TARGET_PSNR_REACHED;
+	}
+	if (args->stagnationFitnessEvaluationCount > 0
+		&& fitnessEvaluator->getFitnessEvaluationsCount() - lastSignificantImprovementEvaluation
+		>= args->stagnationFitnessEvaluationCount) {
+		return StopReason::STAGNATION_FITNESS_COUNT;
+	}
+	if (args->stagnationTimeSecs > 0
+		&& Utils::calculateInterval(&lastSignificantImprovementTime, &currentTime) >= args->stagnationTimeSecs) {
+		return StopReason::STAGNATION_TIME;
 	}
+	return StopReason::NOT_STOPPED;
 }
 
 void CompressorAlgorithm::onIteration(float fitness) {
 	bool isFirstIteration = bestFitness == -1;
-	if (isFirstIteration || fitness < bestFitness) {
+	bool isAccepted = isFirstIteration || fitness < bestFitness;
+	if (isAccepted) {
+		++stats.acceptedSolutionsCount;
 		bestFitness = fitness;
+		bestMeanSquaredError = fitnessEvaluator->getLastMeanSquaredError();
 		if (args->logImprovementToConsole) {
 			printf("Found better solution with fitness %f\n", bestFitness);
 		}
+		if (args->progressCallback != NULL) {
+			LARGE_INTEGER currentTime;
+			Utils::recordTime(&currentTime);
+			Progress progress;
+			progress.fitnessEvaluationsCount = fitnessEvaluator->getFitnessEvaluationsCount();
+			progress.elapsedTimeSecs = getElapsedTimeSecs(&currentTime);
+			progress.bestFitness = bestFitness;
+			args->progressCallback(&progress, args->callbackContext);
+		}
 	}
-	if (args->logFileName != NULL) {
-		fprintf(logFile, isFirstIteration ? "%f" : ";%f", bestFitness);
+	if (isFirstIteration
+		|| fitness < lastSignificantFitness * (1 - args->stagnationMinRelativeImprovement)) {
+		lastSignificantFitness = fitness;
+		lastSignificantImprovementEvaluation = fitnessEvaluator->getFitnessEvaluationsCount();
+		Utils::recordTime(&lastSignificantImprovementTime);
+	}
+	if (logTrace != NULL) {
+		logTrace->record(fitnessEvaluator->getFitnessEvaluationsCount(), fitness, bestFitness, isAccepted, candidateOperator);
+	}
+	if (args->trace != NULL) {
+		args->trace->record(fitnessEvaluator->getFitnessEvaluationsCount(), fitness, bestFitness, isAccepted, candidateOperator);
+	}
+}
+
+double CompressorAlgorithm::getElapsedTimeSecs(LARGE_INTEGER * currentTime) {
+	return resumedElapsedTimeSecs + Utils::calculateInterval(&computationStartTime, currentTime);
+}
+
+bool CompressorAlgorithm::isCheckpointDue() {
+	if (args->checkpointPath == NULL) {
+		return false;
+	}
+	LARGE_INTEGER currentTime;
+	Utils::recordTime(&currentTime);
+	return Utils::calculateInterval(&lastCheckpointTime, &currentTime) >= args->checkpointIntervalSecs;
+}
+
+void CompressorAlgorithm::writeCheckpoint(const char * algorithmName,
+	const vector<VoronoiDiagram*> & diagrams, const vector<float> & diagramsFitness) {
+
+	LARGE_INTEGER currentTime;
+	Utils::recordTime(&currentTime);
+	lastCheckpointTime = currentTime;
+
+	ostringstream randomGeneratorState;
+	randomGeneratorState << Utils::getRandomGenerator();
+
+	Checkpoint checkpoint;
+	checkpoint.algorithmName = algorithmName;
+	checkpoint.width = args->sourceWidth;
+	checkpoint.height = args->sourceHeight;
+	checkpoint.diagramPointsCount = args->diagramPointsCount;
+	checkpoint.fitnessEvaluationsCount = fitnessEvaluator->getFitnessEvaluationsCount();
+	checkpoint.elapsedTimeSecs = getElapsedTimeSecs(&currentTime);
+	checkpoint.bestFitness = bestFitness;
+	checkpoint.bestMeanSquaredError = bestMeanSquaredError;
+	checkpoint.randomGeneratorState = randomGeneratorState.str();
+	checkpoint.diagrams = diagrams;
+	checkpoint.diagramsFitness = diagramsFitness;
+
+	int err = checkpoint.write(args->checkpointPath);
+	// Diagrams are owned by the computation
+	checkpoint.diagrams.clear();
+	if (err != 0) {
+		printf("Checkpoint could not be written into %s\n", args->checkpointPath);
+	}
+}
+
+int CompressorAlgorithm::readCheckpoint(const char * algorithmName, int diagramsCount,
+	vector<VoronoiDiagram*> * diagrams, vector<float> * diagramsFitness, bool * isResumed) {
+
+	*isResumed = false;
+	if (args->checkpointPath == NULL || !args->resumeFromCheckpoint) {
+		return 0;
+	}
+
+	Checkpoint checkpoint;
+	int err = checkpoint.read(args->checkpointPath);
+	if (err == Checkpoint::ERROR_FILE_COULD_NOT_OPEN_FILE) {
+		// Computation starts from the beginning
+		return 0;
+	}
+	istringstream randomGeneratorState(checkpoint.randomGeneratorState);
+	mt19937 randomGenerator;
+	if (err != 0 || checkpoint.algorithmName != algorithmName
+		|| checkpoint.width != args->sourceWidth || checkpoint.height != args->sourceHeight
+		|| checkpoint.diagramPointsCount != args->diagramPointsCount
+		|| checkpoint.diagrams.size() != diagramsCount
+		|| !(randomGeneratorState >> randomGenerator)) {
+		printf("Checkpoint %s does not belong to this computation\n", args->checkpointPath);
+		return Checkpoint::ERROR_INVALID_CHECKPOINT;
+	}
+
+	Utils::getRandomGenerator() = randomGenerator;
+	fitnessEvaluator->setFitnessEvaluationsCount(checkpoint.fitnessEvaluationsCount);
+	resumedElapsedTimeSecs = checkpoint.elapsedTimeSecs;
+	bestFitness = checkpoint.bestFitness;
+	bestMeanSquaredError = checkpoint.bestMeanSquaredError;
+	lastSignificantFitness = bestFitness;
+	lastSignificantImprovementEvaluation = checkpoint.fitnessEvaluationsCount;
+	Utils::recordTime(&lastSignificantImprovementTime);
+
+	// Diagrams are taken over from the checkpoint
+	diagrams->insert(diagrams->end(), checkpoint.diagrams.begin(), checkpoint.diagrams.end());
+	diagramsFitness->insert(diagramsFitness->end(), checkpoint.diagramsFitness.begin(), checkpoint.diagramsFitness.end());
+	checkpoint.diagrams.clear();
+
+	printf("Resumed from checkpoint %s after %d fitness evaluations\n", args->checkpointPath, checkpoint.fitnessEvaluationsCount);
+	*isResumed = true;
+	return 0;
+}
+
+bool CompressorAlgorithm::isInChangedBlock(VoronoiDiagram * diagram, int pointIndex) {
+	if (args->changedBlocks == NULL) {
+		return true;
+	}
+	int32_t blocksWidth = (args->sourceWidth + args->changedBlockSize - 1) / args->changedBlockSize;
+	int32_t blockX = diagram->x(pointIndex) / args->changedBlockSize;
+	int32_t blockY = diagram->y(pointIndex) / args->changedBlockSize;
+	return args->changedBlocks[(int64_t)blockY * blocksWidth + blockX] != 0;
+}
+
+void CompressorAlgorithm::generateStartingDiagram(VoronoiDiagram * output) {
+	candidateOperator = ConvergenceTrace::Operator::INITIAL;
+	if (args->initialDiagram != NULL) {
+		CompressorUtils::copy(args->initialDiagram, output);
+	}
+	else {
+		CompressorUtils::generateRandomDiagram(output, args->sourceWidth, args->sourceHeight);
+	}
+}
+
+float CompressorAlgorithm::getBestFitness() {
+	return bestFitness;
+}
+
+CompressorAlgorithm::Stats CompressorAlgorithm::getStats() {
+	return stats;
+}
+
+CompressorAlgorithm::StopReason CompressorAlgorithm::getStopReason() {
+	return stopReason;
+}
+
+const char * CompressorAlgorithm::getStopReasonDescription(StopReason stopReason) {
+	switch (stopReason) {
+	case StopReason::TIME_LIMIT:
+		return "time limit reached";
+	case StopReason::FITNESS_COUNT_LIMIT:
+		return "fitness evaluation count limit reached";
+	case StopReason::TARGET_FITNESS_REACHED:
+		return "target fitness reached";
+	case StopReason::TARGET_PSNR_REACHED:
+		return "target PSNR reached";
+	case StopReason::STAGNATION_FITNESS_COUNT:
+		return "no significant improvement within fitness evaluation count limit";
+	case StopReason::STAGNATION_TIME:
+		return "no significant improvement within time limit";
+	case StopReason::CANCELLED:
+		return "cancelled";
+	default:
+		return "not stopped";
+	}
+}
+
+double CompressorAlgorithm::calculatePsnr(float meanSquaredError) {
+	if (meanSquaredError <= 0) {
+		return INFINITY;
 	}
+	return 10 * log10(255.0 * 255.0 / meanSquaredError);
 }
 
 void CompressorAlgorithm::onBestSolutionFound(float bestFitness) {
 	printf("Found best solution with fitness %f\n", bestFitness);
+	printf("Fitness cache hits %d, misses %d\n",
+		fitnessEvaluator->getFitnessCacheHitsCount(),
+		fitnessEvaluator->getFitnessCacheMissesCount());
 }
@@ -2,8 +2,10 @@
 
 #include <cstdint>
 #include <memory>
+#include <vector>
 #include "voronoidiagram.h"
 #include "cpufitnessevaluator.h"
+#include "convergencetrace.h"
 #include "color.h"
 
 #define NOMINMAX
@@ -27,30 +29,112 @@ namespace lossycompressor {
 		*/
 	class CompressorAlgorithm {
 	public:
+		/// Progress of the computation passed to the progress callback.
+		struct Progress {
+			int fitnessEvaluationsCount;	///< Count of fitness evaluations done by the computation so far.
+			double elapsedTimeSecs;			///< Time since the start of the computation.
+			float bestFitness;				///< Fitness of the best solution found so far.
+		};
+
+		/// Counters and timers of the computation.
+		struct Stats {
+			int fitnessEvaluationsCount = 0;		///< Count of fitness evaluations, including those found in the cache.
+			int computedFitnessEvaluationsCount = 0;	///< Count of fitness values computed by the evaluator, without those found in the cache.
+			int acceptedSolutionsCount = 0;			///< Count of evaluated solutions that became the best solution.
+			int fitnessCacheHitsCount = 0;			///< Count of fitness values found in the cache.
+			double evaluatedPixelsCount = 0;		///< Count of pixels in all computed fitness values, evaluated image may be a tile.
+			double elapsedTimeSecs = 0;				///< Time the computation ran, without the time before it was resumed.
+			FitnessEvaluator::PhaseTimes phaseTimes;	///< Time spent in the phases of fitness calculation.
+		};
+
+		/// Function called with the progress of the computation whenever its best solution improves.
+		typedef void (*ProgressCallback)(const Progress * progress, void * callbackContext);
+
+		/// Function called before every step of the computation, computation stops if it returns true.
+		typedef bool (*CancelCallback)(void * callbackContext);
+
 		/// Instance of this class is passed as a parameter into CompressorAlgorithm. Contains compression input data and compression settings.
 		struct Args {
 			int32_t sourceWidth;
 			int32_t sourceHeight;
 			uint8_t * sourceImageData;
 			int sourceDataRowWidthInBytes;
+			PixelFormat sourcePixelFormat = PixelFormat::BGR24;
 			int diagramPointsCount;
 			bool limitByTime; // True is algorithm should be limited by time, false if algorithm should be limited by fitness evaluation count
 			double maxComputationTimeSecs;
 			int maxFitnessEvaluationCount;
 			bool useCuda;
 			char * logFileName;
+			ConvergenceTrace * trace = NULL;				// Open trace into which every fitness evaluation is recorded, it must be used by one thread at a time, not recorded if NULL
 			bool logImprovementToConsole;
+			float targetFitness = -1;						// Computation stops when best fitness is lower or equal, disabled if negative
+			double targetPsnr = -1;							// Computation stops when PSNR of the best solution is greater or equal, disabled if negative
+			int stagnationFitnessEvaluationCount = 0;		// Computation stops after this many fitness evaluations without significant improvement, disabled if 0
+			double stagnationTimeSecs = 0;					// Computation stops after this many seconds without significant improvement, disabled if 0
+			float stagnationMinRelativeImprovement = 0.001f;	// Relative improvement of best fitness that is considered significant
+			VoronoiDiagram * initialDiagram = NULL;			// Sorted diagram with diagramPointsCount points from which computation starts, random diagram is used if NULL
+			FitnessEvaluator * fitnessEvaluator = NULL;		// Evaluator shared with other computations, algorithm creates its own evaluators if NULL
+			CpuFitnessEvaluator * cpuFitnessEvaluator = NULL;	// CPU evaluator shared with other computations, must be set if fitnessEvaluator is set
+			ProgressCallback progressCallback = NULL;		// Called when the best solution improves, not called if NULL
+			CancelCallback cancelCallback = NULL;			// Called before every step, computation is cancelled when it returns true, not called if NULL
+			void * callbackContext = NULL;					// Passed to the callbacks
+			const char * checkpointPath = NULL;				// File into which the state of the computation is periodically written, not written if NULL
+			double checkpointIntervalSecs = 60;				// Time between writes of the checkpoint
+			bool resumeFromCheckpoint = false;				// True if the computation should continue from the checkpoint file if it exists
+			const uint8_t * changedBlocks = NULL;			// Square blocks of the image whose pixels changed against the initial diagram by rows from the top, nonzero if changed, all blocks are searched if NULL
+			int32_t changedBlockSize = 16;					// Size of blocks in pixels
+		};
+
+		/// Reason why computation stopped.
+		enum StopReason {
+			NOT_STOPPED,				///< Computation did not stop yet.
+			TIME_LIMIT,					///< Time limit was reached.
+			FITNESS_COUNT_LIMIT,		///< Limit on fitness evaluation count was reached.
+			TARGET_FITNESS_REACHED,		///< Best solution reached the target fitness.
+			TARGET_PSNR_REACHED,		///< Best solution reached the target PSNR.
+			STAGNATION_FITNESS_COUNT,	///< Best solution did not significantly improve for given count of fitness evaluations.
+			STAGNATION_TIME,			///< Best solution did not significantly improve for given time.
+			CANCELLED					///< Cancel callback requested the computation to stop.
 		};
 	private:
 		LARGE_INTEGER computationStartTime;
 
 		FitnessEvaluator * fitnessEvaluator;
+
+		// True if evaluators were created by this algorithm and should be deleted with it
+		bool ownsFitnessEvaluators;
 		
-		FILE* logFile;
+		// Trace writing the log file
+		ConvergenceTrace * logTrace = NULL;
 
 		float bestFitness = -1;
+		float bestMeanSquaredError = -1;
+
+		// Best fitness at the time of the last significant improvement and when it happened
+		float lastSignificantFitness = -1;
+		int lastSignificantImprovementEvaluation = 0;
+		LARGE_INTEGER lastSignificantImprovementTime;
+
+		StopReason stopReason = StopReason::NOT_STOPPED;
+
+		// Counters of the evaluator at the start of the computation, stats are the differences from them
+		int startFitnessCacheHitsCount;
+		int startFitnessCacheMissesCount;
+		FitnessEvaluator::PhaseTimes startPhaseTimes;
+		Stats stats;
+
+		// Time the computation ran before it was resumed from a checkpoint
+		double resumedElapsedTimeSecs = 0;
+		LARGE_INTEGER lastCheckpointTime;
 
 		void onIteration(float bestFitness);
+
+		// Returns time the computation ran including the time before it was resumed
+		double getElapsedTimeSecs(LARGE_INTEGER * currentTime);
+
+		// Returns reason why computation should stop or NOT_STOPPED if it can continue
+		StopReason checkStopReason();
 	protected:
 		/// Compression arguments.
 		CompressorAlgorithm::Args * args;
@@ -58,6 +142,9 @@ namespace lossycompressor {
 		/// Fitness evaluator using CPU.
 		CpuFitnessEvaluator * cpuFitnessEvaluator;
 
+		/// Operator that created the diagram evaluated next, recorded in traces.
+		ConvergenceTrace::Operator candidateOperator = ConvergenceTrace::Operator::INITIAL;
+
 		// Calculate fitness of given diagram/
 		/**
 			Returned fitness is always
@@ -70,9 +157,44 @@ namespace lossycompressor {
 		*/
 		bool canContinueComputing();
 
+		/// Generates diagram from which the computation starts.
+		/**
+			Copies the initial diagram from arguments if there is one, otherwise generates random diagram.
+		*/
+		void generateStartingDiagram(VoronoiDiagram * output);
+
+		/// Returns true if there is no mask of changed blocks or the point on given index lies in a changed block.
+		bool isInChangedBlock(VoronoiDiagram * diagram, int pointIndex);
+
 		/// Must be called when computation found the best solution and will terminate.
 		void onBestSolutionFound(float bestFitness);
 
+		/// Returns true if checkpoints are enabled and checkpointIntervalSecs passed since the last one.
+		bool isCheckpointDue();
+
+		/// Writes diagrams of the computation together with its progress and state of the random number generator into the checkpoint file.
+		/**
+			Failed write is reported to the console and the computation continues.
+		*/
+		void writeCheckpoint(const char * algorithmName,
+			const std::vector<VoronoiDiagram*> & diagrams,
+			const std::vector<float> & diagramsFitness);
+
+		/// Continues the computation from the checkpoint file if resuming is enabled.
+		/**
+			Restores the progress of the computation and the state of the random number generator,
+			diagrams are allocated and appended into given vectors.
+
+			\param[in] algorithmName			Name of the algorithm, must match the one in the checkpoint.
+			\param[in] diagramsCount			Count of diagrams the algorithm keeps, must match the one in the checkpoint.
+			\param[out] isResumed				Set to true if the computation was resumed, false if resuming is disabled or the file does not exist.
+			\return	0 if successfull, Checkpoint::ERROR_INVALID_CHECKPOINT if the checkpoint can not be used.
+		*/
+		int readCheckpoint(const char * algorithmName, int diagramsCount,
+			std::vector<VoronoiDiagram*> * diagrams,
+			std::vector<float> * diagramsFitness,
+			bool * isResumed);
+
 		/// Implement this method to provide the compression calculation.
 		virtual int compressInternal(VoronoiDiagram * outputDiagram,
 			Color24bit * colors,
@@ -91,5 +213,20 @@ namespace lossycompressor {
 		int compress(VoronoiDiagram * outputDiagram,
 			Color24bit * colors,
 			int * pixelPointAssignment);
+
+		/// Returns the reason why the computation stopped.
+		StopReason getStopReason();
+
+		/// Returns fitness of the best solution found by the computation.
+		float getBestFitness();
+
+		/// Returns counters and timers of the computation, they are complete when compress() returns.
+		Stats getStats();
+
+		/// Returns human readable description of given stop reason.
+		static const char * getStopReasonDescription(StopReason stopReason);
+
+		/// Calculates PSNR in decibels from mean squared error of color channels.
+		static double calculatePsnr(float meanSquaredError);
 	};
 }
\ No newline at end of file
@@ -6,31 +6,76 @@ using namespace std;
 using namespace lossycompressor;
 
 void CompressorUtils::copyPoint(VoronoiDiagram * source, VoronoiDiagram * destination, int index) {
-	destination->diagramPointsXCoordinates[index] = source->diagramPointsXCoordinates[index];
-	destination->diagramPointsYCoordinates[index] = source->diagramPointsYCoordinates[index];
+	destination->setPoint(index, source->x(index), source->y(index));
 }
 
 void CompressorUtils::copy(VoronoiDiagram * source, VoronoiDiagram * destination) {
 	for (int i = 0; i < source->diagramPointsCount; ++i) {
-		copyPoint(source, destination, i);
+		destination->diagramPointsXCoordinates[i] = source->diagramPointsXCoordinates[i];
+		destination->diagramPointsYCoordinates[i] = source->diagramPointsYCoordinates[i];
 	}
+	destination->copyHash(source);
 }
 
 void CompressorUtils::generateRandomDiagram(VoronoiDiagram * output,
 	int32_t sourceWidth, int32_t sourceHeight) {
 
-	random_device rd;
-	float widthMultiplier = ((float)(sourceWidth - 1)) / rd.max();
-	float heightMultiplier = ((float)(sourceHeight - 1)) / rd.max();
+	mt19937 & generator = Utils::getRandomGenerator();
+	float widthMultiplier = ((float)(sourceWidth - 1)) / generator.max();
+	float heightMultiplier = ((float)(sourceHeight - 1)) / generator.max();
 
 	for (int i = 0; i < output->diagramPointsCount; ++i) {
-		output->diagramPointsXCoordinates[i] = (int32_t)(rd() * widthMultiplier + 0.5f);
-		output->diagramPointsYCoordinates[i] = (int32_t)(rd() * heightMultiplier + 0.5f);
+		output->setPoint(i,
+			(int32_t)(generator() * widthMultiplier + 0.5f),
+			(int32_t)(generator() * heightMultiplier + 0.5f));
 	}
 
 	quicksortDiagramPoints(output, 0, output->diagramPointsCount);
 }
 
+void CompressorUtils::resizeDiagram(VoronoiDiagram * source, VoronoiDiagram * destination,
+	int32_t sourceWidth, int32_t sourceHeight) {
+
+	int sourceCount = source->diagramPointsCount;
+	int destinationCount = destination->diagramPointsCount;
+	for (int i = 0; i < destinationCount; ++i) {
+		if (destinationCount <= sourceCount) {
+			int sourceIndex = (int)(((int64_t)i * sourceCount) / destinationCount);
+			destination->setPoint(i, source->x(sourceIndex), source->y(sourceIndex));
+		}
+		else if (i < sourceCount) {
+			destination->setPoint(i, source->x(i), source->y(i));
+		}
+		else {
+			destination->setPoint(i,
+				Utils::generateRandom(sourceWidth - 1),
+				Utils::generateRandom(sourceHeight - 1));
+		}
+	}
+
+	if (destinationCount > sourceCount) {
+		// Sort the random points and merge them with the already sorted source points
+		quicksortDiagramPoints(destination, sourceCount, destinationCount);
+
+		int32_t * xCoordinates = new int32_t[destinationCount];
+		int32_t * yCoordinates = new int32_t[destinationCount];
+		int first = 0, second = sourceCount;
+		for (int i = 0; i < destinationCount; ++i) {
+			bool takeFirst = second >= destinationCount
+				|| (first < sourceCount && compare(destination, first, second) <= 0);
+			int index = takeFirst ? first++ : second++;
+			xCoordinates[i] = destination->x(index);
+			yCoordinates[i] = destination->y(index);
+		}
+		for (int i = 0; i < destinationCount; ++i) {
+			destination->diagramPointsXCoordinates[i] = xCoordinates[i];
+			destination->diagramPointsYCoordinates[i] = yCoordinates[i];
+		}
+		delete[] xCoordinates;
+		delete[] yCoordinates;
+	}
+}
+
 void CompressorUtils::quicksortDiagramPoints(
 	VoronoiDiagram * diagram, int start, int end) {
 
@@ -52,6 +97,21 @@ void CompressorUtils::quicksortDiagramPoints(
 	}
 }
 
+void CompressorUtils::sortDiagramPoints(VoronoiDiagram * diagram) {
+	for (int i = 1; i < diagram->diagramPointsCount; ++i) {
+		int32_t x = diagram->x(i);
+		int32_t y = diagram->y(i);
+		int j = i - 1;
+		while (j >= 0 && compare(diagram->x(j), diagram->y(j), x, y) > 0) {
+			diagram->diagramPointsXCoordinates[j + 1] = diagram->diagramPointsXCoordinates[j];
+			diagram->diagramPointsYCoordinates[j + 1] = diagram->diagramPointsYCoordinates[j];
+			--j;
+		}
+		diagram->diagramPointsXCoordinates[j + 1] = x;
+		diagram->diagramPointsYCoordinates[j + 1] = y;
+	}
+}
+
 void CompressorUtils::swap(VoronoiDiagram ** first, VoronoiDiagram ** second) {
 	VoronoiDiagram * tmp = *first;
 	*first = *second;
@@ -18,6 +18,21 @@ namespace lossycompressor {
 		static void generateRandomDiagram(VoronoiDiagram * output,
 			int32_t sourceWidth, int32_t sourceHeight);
 
+		/// Copies the source diagram into destination diagram with different count of points.
+		/**
+			If destination has fewer points, evenly spread subset of source points is copied.
+			If destination has more points, all source points are copied and the rest
+			of points is placed randomly. Destination diagram is sorted.
+		*/
+		static void resizeDiagram(VoronoiDiagram * source, VoronoiDiagram * destination,
+			int32_t sourceWidth, int32_t sourceHeight);
+
+		/// Sorts points of given diagram according to their horizontal (x) coordinate.
+		/**
+			Uses insertion sort, so it is fast for diagrams that are already nearly sorted.
+		*/
+		static void sortDiagramPoints(VoronoiDiagram * diagram);
+
 		/// Swap two diagrams on given pointers.
 		static void swap(VoronoiDiagram ** first, VoronoiDiagram ** second);
 
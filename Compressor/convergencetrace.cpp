@@ -0,0 +1,133 @@
+#include "convergencetrace.h"
+#include "utils.h"
+#include <chrono>
+
+using namespace std;
+using namespace lossycompressor;
+
+ConvergenceTrace::ConvergenceTrace()
+: writeIndex(0), readIndex(0), isClosing(false) {
+	records = new Record[CAPACITY];
+}
+
+ConvergenceTrace::~ConvergenceTrace() {
+	close();
+	delete[] records;
+}
+
+int ConvergenceTrace::open(const char * path, Format format, int decimation, bool append) {
+	close();
+	errno_t err = fopen_s(&file, path, append ? "ab" : "wb");
+	if (err != 0 || file == NULL) {
+		file = NULL;
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+	// Writer thread writes large blocks
+	setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+	this->format = format;
+	this->decimation = decimation;
+	writtenRecordsCount = 0;
+	droppedRecordsCount = 0;
+	writeIndex.store(0);
+	readIndex.store(0);
+	isClosing.store(false);
+	Utils::recordTime(&startTime);
+
+	if (format == Format::CSV) {
+		fprintf(file, "evaluation,time_secs,fitness,best_fitness,accepted,operator\n");
+	}
+	else if (format == Format::BINARY) {
+		uint8_t version = FORMAT_VERSION;
+		fwrite("VTR", 1, 3, file);
+		fwrite(&version, 1, 1, file);
+	}
+
+	writer = thread(&ConvergenceTrace::runWriter, this);
+	return 0;
+}
+
+void ConvergenceTrace::close() {
+	if (file == NULL) {
+		return;
+	}
+	isClosing.store(true, memory_order_release);
+	writer.join();
+
+	if (format == Format::FITNESS_LOG) {
+		fprintf(file, "\n");
+	}
+	fflush(file);
+	fclose(file);
+	file = NULL;
+	if (droppedRecordsCount > 0) {
+		printf("Trace writer fell behind, %d records were dropped\n", droppedRecordsCount);
+	}
+}
+
+void ConvergenceTrace::runWriter() {
+	while (true) {
+		// Records written before closing are drained after the flag is seen
+		bool isLast = isClosing.load(memory_order_acquire);
+		bool hasWritten = writeRecords();
+		if (isLast) {
+			break;
+		}
+		if (!hasWritten) {
+			// Copy of the constant, so it is not bound to a reference
+			int sleepMilliseconds = WRITER_SLEEP_MILLISECONDS;
+			this_thread::sleep_for(chrono::milliseconds(sleepMilliseconds));
+		}
+	}
+}
+
+bool ConvergenceTrace::writeRecords() {
+	size_t index = readIndex.load(memory_order_relaxed);
+	size_t endIndex = writeIndex.load(memory_order_acquire);
+	if (index == endIndex) {
+		return false;
+	}
+	for (; index != endIndex; ++index) {
+		writeRecord(records[index & (CAPACITY - 1)]);
+	}
+	readIndex.store(endIndex, memory_order_release);
+	return true;
+}
+
+void ConvergenceTrace::writeRecord(const Record & record) {
+	LARGE_INTEGER time = record.time;
+	double elapsedTimeSecs = Utils::calculateInterval(&startTime, &time);
+	if (format == Format::FITNESS_LOG) {
+		fprintf(file, writtenRecordsCount == 0 ? "%f" : ";%f", record.bestFitness);
+	}
+	else if (format == Format::CSV) {
+		fprintf(file, "%d,%.6f,%f,%f,%d,%s\n", record.evaluationIndex, elapsedTimeSecs,
+			record.fitness, record.bestFitness, record.isAccepted ? 1 : 0, getOperatorName(record.candidateOperator));
+	}
+	else {
+		uint8_t isAccepted = record.isAccepted ? 1 : 0;
+		uint8_t candidateOperator = record.candidateOperator;
+		fwrite(&record.evaluationIndex, 4, 1, file);
+		fwrite(&elapsedTimeSecs, 8, 1, file);
+		fwrite(&record.fitness, 4, 1, file);
+		fwrite(&record.bestFitness, 4, 1, file);
+		fwrite(&isAccepted, 1, 1, file);
+		fwrite(&candidateOperator, 1, 1, file);
+	}
+	++writtenRecordsCount;
+}
+
+const char * ConvergenceTrace::getOperatorName(Operator candidateOperator) {
+	switch (candidateOperator) {
+	case Operator::TWEAK:
+		return "tweak";
+	case Operator::PERTURBATION:
+		return "perturbation";
+	case Operator::CROSSOVER:
+		return "crossover";
+	case Operator::DIFFERENTIAL_TRIAL:
+		return "differential_trial";
+	default:
+		return "initial";
+	}
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include "utils.h"
+
+namespace lossycompressor {
+
+	/// Trace of fitness evaluations of computations written into a file by a background thread.
+	/**
+		Evaluations are recorded into a lock-free ring buffer with a single producer, the thread
+		running the computations, and a single consumer, the writer thread, so recording costs
+		only a copy of the record. When the writer falls behind and the buffer is full, records
+		are dropped and their count is reported when the trace is closed, except for FITNESS_LOG,
+		whose records wait until the writer frees space.
+
+		With decimation N only every N-th evaluation is recorded together with all evaluations
+		that improved the best solution. Files have one of the following formats:
+
+			FITNESS_LOG - best fitness after every evaluation separated by semicolons, one line per trace,
+			CSV - header and one line per record,
+			BINARY - characters "VTR", format version (1) and records of 22 bytes in native byte order:
+				4 bytes evaluation index, 8 bytes elapsed seconds, 4 bytes fitness, 4 bytes best fitness,
+				1 byte accepted flag, 1 byte operator.
+	*/
+	class ConvergenceTrace {
+	public:
+		/// Format of the trace file.
+		enum Format {
+			FITNESS_LOG,		///< Best fitness after every evaluation separated by semicolons.
+			CSV,				///< Comma separated values with a header.
+			BINARY				///< Fixed size binary records.
+		};
+
+		/// Operator that created the evaluated diagram.
+		enum Operator : uint8_t {
+			INITIAL,			///< Starting diagram or member of the initial population.
+			TWEAK,				///< Small move of one point.
+			PERTURBATION,		///< Move of several points anywhere in the image.
+			CROSSOVER,			///< Exchange of points between two parents.
+			DIFFERENTIAL_TRIAL	///< Trial diagram of differential evolution.
+		};
+	private:
+		static const uint8_t FORMAT_VERSION = 1;
+		static const size_t CAPACITY = 1 << 16;
+		static const int WRITER_SLEEP_MILLISECONDS = 5;
+
+		struct Record {
+			int32_t evaluationIndex;
+			float fitness;
+			float bestFitness;
+			bool isAccepted;
+			Operator candidateOperator;
+			LARGE_INTEGER time;
+		};
+
+		Format format;
+		int decimation;
+		FILE * file = NULL;
+		LARGE_INTEGER startTime;
+		int writtenRecordsCount = 0;
+
+		Record * records;
+		// Written only by the producer and the writer respectively, indices grow without wrapping
+		std::atomic<size_t> writeIndex;
+		std::atomic<size_t> readIndex;
+		std::atomic<bool> isClosing;
+		int droppedRecordsCount = 0;
+		std::thread writer;
+
+		void runWriter();
+		// Writes all records in the buffer, returns false if it was empty
+		bool writeRecords();
+		void writeRecord(const Record & record);
+		static const char * getOperatorName(Operator candidateOperator);
+	public:
+		static const int ERROR_FILE_COULD_NOT_OPEN_FILE = 2;	///< Error code. File could not be open.
+
+		/// Construct a new trace, nothing is recorded until it is open.
+		ConvergenceTrace();
+		~ConvergenceTrace();
+
+		/// Open the trace file and start the writer thread.
+		/**
+			\param[in] path			Path of the trace file.
+			\param[in] format		Format of the file.
+			\param[in] decimation	Every decimation-th evaluation is recorded together with all improvements, every evaluation if 1 or less.
+			\param[in] append		True if the file should be appended, false if it should be overwritten.
+			\return 0 if successfull, error code otherwise.
+		*/
+		int open(const char * path, Format format, int decimation, bool append);
+
+		/// Record one fitness evaluation, must be called from one thread at a time.
+		inline void record(int32_t evaluationIndex, float fitness, float bestFitness, bool isAccepted, Operator candidateOperator) {
+			if (!isAccepted && decimation > 1 && evaluationIndex % decimation != 0) {
+				return;
+			}
+			size_t index = writeIndex.load(std::memory_order_relaxed);
+			while (index - readIndex.load(std::memory_order_acquire) >= CAPACITY) {
+				// Positions in the fitness log are evaluations, so its records wait for the writer instead of being dropped
+				if (format != Format::FITNESS_LOG) {
+					++droppedRecordsCount;
+					return;
+				}
+				std::this_thread::yield();
+			}
+			Record & record = records[index & (CAPACITY - 1)];
+			record.evaluationIndex = evaluationIndex;
+			record.fitness = fitness;
+			record.bestFitness = bestFitness;
+			record.isAccepted = isAccepted;
+			record.candidateOperator = candidateOperator;
+			Utils::recordTime(&record.time);
+			writeIndex.store(index + 1, std::memory_order_release);
+		}
+
+		/// Write remaining records, stop the writer thread and close the file.
+		void close();
+	};
+}
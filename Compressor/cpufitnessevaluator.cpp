@@ -10,81 +10,162 @@ using namespace lossycompressor;
 
 CpuFitnessEvaluator::CpuFitnessEvaluator(
 	int sourceWidth, int sourceHeight,
-	int diagramPointsCount, 
-	uint8_t * sourceImageData, int sourceDataRowWidthInBytes)
-	: FitnessEvaluator(sourceWidth, sourceHeight, diagramPointsCount, sourceImageData, sourceDataRowWidthInBytes),
-	rSums(new float[diagramPointsCount]),
-	gSums(new float[diagramPointsCount]),
-	bSums(new float[diagramPointsCount]),
-	pixelPerPointCounts(new int[diagramPointsCount]),
-	colorsTmp(new Color24bit[diagramPointsCount]),
-	pixelPointAssignment(new int[sourceHeight * sourceWidth]) {};
+	int maxDiagramPointsCount, 
+	uint8_t * sourceImageData, int sourceDataRowWidthInBytes,
+	PixelFormat sourcePixelFormat)
+	: FitnessEvaluator(sourceWidth, sourceHeight, maxDiagramPointsCount, sourceImageData, sourceDataRowWidthInBytes, sourcePixelFormat),
+	channelSums(new float[maxDiagramPointsCount * MAX_CHANNELS_COUNT]),
+	weightSums(new float[maxDiagramPointsCount]),
+	colorsTmp(new Color24bit[maxDiagramPointsCount]),
+	pixelPointAssignment(new int[(int64_t)sourceHeight * sourceWidth]),
+	pixelsCapacity((int64_t)sourceHeight * sourceWidth),
+	pointsCapacity(maxDiagramPointsCount) {};
 
 CpuFitnessEvaluator::~CpuFitnessEvaluator() {
-	delete[] rSums;
-	delete[] gSums;
-	delete[] bSums;
+	delete[] channelSums;
+	delete[] weightSums;
 	delete[] colorsTmp;
 	delete[] pixelPointAssignment;
 }
 
+bool CpuFitnessEvaluator::resetSourceImage(int sourceWidth, int sourceHeight,
+	int maxDiagramPointsCount,
+	uint8_t * sourceImageData, int sourceDataRowWidthInBytes,
+	PixelFormat sourcePixelFormat) {
+
+	if ((int64_t)sourceHeight * sourceWidth > pixelsCapacity || maxDiagramPointsCount > pointsCapacity) {
+		return false;
+	}
+	setSourceImage(sourceWidth, sourceHeight, maxDiagramPointsCount,
+		sourceImageData, sourceDataRowWidthInBytes, sourcePixelFormat);
+	return true;
+}
+
 float CpuFitnessEvaluator::calculateFitnessInternal(VoronoiDiagram * diagram) {
-	calculateColors(diagram, colorsTmp, pixelPointAssignment);
+	switch (sourcePixelFormat) {
+	case PixelFormat::GRAY8:
+		return calculateFitnessForFormat<Gray8Pixel>(diagram);
+	case PixelFormat::BGRA32:
+		return calculateFitnessForFormat<Bgra32Pixel>(diagram);
+	case PixelFormat::BGRA32_ALPHA_WEIGHTED:
+		return calculateFitnessForFormat<Bgra32AlphaWeightedPixel>(diagram);
+	default:
+		return calculateFitnessForFormat<Bgr24Pixel>(diagram);
+	}
+}
+
+template <class Pixel>
+float CpuFitnessEvaluator::calculateFitnessForFormat(VoronoiDiagram * diagram) {
+	calculateColorsForFormat<Pixel>(diagram, colorsTmp, pixelPointAssignment);
 
+	LARGE_INTEGER errorStartTime;
+	Utils::recordTime(&errorStartTime);
 	float fitness = 0;
+	float squaredError = 0;
 	for (int i = 0; i < sourceHeight; ++i) {
 		for (int j = 0; j < sourceWidth; ++j) {
-			int pointIndex = pixelPointAssignment[i * sourceWidth + j];
+			int pointIndex = pixelPointAssignment[(int64_t)i * sourceWidth + j];
 			Color24bit color = colorsTmp[pointIndex];
-			int colorStartIndexInSourceData = i * sourceDataRowWidthInBytes + j * 3;
+			uint8_t * pixel = sourceImageData + (int64_t)i * sourceDataRowWidthInBytes + j * Pixel::BYTES_PER_PIXEL;
 
-			float pixelDeviation
-				= (abs((float)(sourceImageData[colorStartIndexInSourceData] - color.b)) // Absolute red color deviation
-				+ abs((float)(sourceImageData[colorStartIndexInSourceData + 1] - color.g)) // Absolute green color deviation
-				+ abs((float)(sourceImageData[colorStartIndexInSourceData + 2] - color.r))); // Absolute blue color deviation
+			float pixelDeviation = 0;
+			float pixelSquaredError = 0;
+			for (int c = 0; c < Pixel::CHANNELS_COUNT; ++c) {
+				float deviation = (float)(Pixel::channel(pixel, c) - Pixel::colorChannel(color, c));
+				pixelDeviation += abs(deviation);
+				pixelSquaredError += deviation * deviation;
+			}
 
-			fitness += pixelDeviation;
+			float weight = Pixel::weight(pixel) * Pixel::CHANNEL_COPIES;
+			fitness += weight * pixelDeviation;
+			squaredError += weight * pixelSquaredError;
 		}
 	}
-	return fitness / (sourceWidth * sourceHeight);
+	LARGE_INTEGER errorEndTime;
+	Utils::recordTime(&errorEndTime);
+	phaseTimes.errorSecs += Utils::calculateInterval(&errorStartTime, &errorEndTime);
+
+	lastMeanSquaredError = squaredError / ((float)sourceWidth * sourceHeight * 3);
+	return fitness / ((float)sourceWidth * sourceHeight);
 }
 
 void CpuFitnessEvaluator::calculateColors(VoronoiDiagram * diagram,
 	Color24bit * colors,
 	int * pixelPointAssignment) {
 
-	for (int i = 0; i < diagramPointsCount; ++i) {
-		rSums[i] = 0;
-		gSums[i] = 0;
-		bSums[i] = 0;
-		pixelPerPointCounts[i] = 0;
+	switch (sourcePixelFormat) {
+	case PixelFormat::GRAY8:
+		calculateColorsForFormat<Gray8Pixel>(diagram, colors, pixelPointAssignment);
+		break;
+	case PixelFormat::BGRA32:
+		calculateColorsForFormat<Bgra32Pixel>(diagram, colors, pixelPointAssignment);
+		break;
+	case PixelFormat::BGRA32_ALPHA_WEIGHTED:
+		calculateColorsForFormat<Bgra32AlphaWeightedPixel>(diagram, colors, pixelPointAssignment);
+		break;
+	default:
+		calculateColorsForFormat<Bgr24Pixel>(diagram, colors, pixelPointAssignment);
+		break;
 	}
+}
+
+template <class Pixel>
+void CpuFitnessEvaluator::calculateColorsForFormat(VoronoiDiagram * diagram,
+	Color24bit * colors,
+	int * pixelPointAssignment) {
+
+	// Phases are separate passes, so they can be timed
+	LARGE_INTEGER assignmentStartTime, accumulationStartTime, averagingStartTime, averagingEndTime;
+	Utils::recordTime(&assignmentStartTime);
 
 	for (int i = 0; i < sourceWidth; ++i) {
 		for (int j = 0; j < sourceHeight; ++j) {
 			int pointIndex = calculateDiagramPointIndexForPixel(diagram, i, j);
 			assert(pointIndex >= 0);
-			pixelPointAssignment[i + j * sourceWidth] = pointIndex;
+			pixelPointAssignment[i + (int64_t)j * sourceWidth] = pointIndex;
+		}
+	}
+	Utils::recordTime(&accumulationStartTime);
 
-			int colorStartIndexInSourceData = i * 3 + j * sourceDataRowWidthInBytes;
-			bSums[pointIndex] += sourceImageData[colorStartIndexInSourceData];
-			gSums[pointIndex] += sourceImageData[colorStartIndexInSourceData + 1];
-			rSums[pointIndex] += sourceImageData[colorStartIndexInSourceData + 2];
-			pixelPerPointCounts[pointIndex] += 1;
+	int diagramPointsCount = diagram->diagramPointsCount;
+	for (int i = 0; i < diagramPointsCount * MAX_CHANNELS_COUNT; ++i) {
+		channelSums[i] = 0;
+	}
+	for (int i = 0; i < diagramPointsCount; ++i) {
+		weightSums[i] = 0;
+	}
+	for (int i = 0; i < sourceHeight; ++i) {
+		for (int j = 0; j < sourceWidth; ++j) {
+			int pointIndex = pixelPointAssignment[(int64_t)i * sourceWidth + j];
+			uint8_t * pixel = sourceImageData + (int64_t)i * sourceDataRowWidthInBytes + j * Pixel::BYTES_PER_PIXEL;
+			float weight = Pixel::weight(pixel);
+			float * pointChannelSums = &channelSums[pointIndex * MAX_CHANNELS_COUNT];
+			for (int c = 0; c < Pixel::CHANNELS_COUNT; ++c) {
+				pointChannelSums[c] += weight * Pixel::channel(pixel, c);
+			}
+			weightSums[pointIndex] += weight;
 		}
 	}
+	Utils::recordTime(&averagingStartTime);
 
+	// Points without any weight get black color
 	for (int i = 0; i < diagramPointsCount; ++i) {
-		Color24bit * color = &colors[i];
-		color->b = (uint8_t)(bSums[i] / pixelPerPointCounts[i] + 0.5);
-		color->g = (uint8_t)(gSums[i] / pixelPerPointCounts[i] + 0.5);
-		color->r = (uint8_t)(rSums[i] / pixelPerPointCounts[i] + 0.5);
+		for (int c = 0; c < Pixel::CHANNELS_COUNT; ++c) {
+			float mean = weightSums[i] > 0 ? channelSums[i * MAX_CHANNELS_COUNT + c] / weightSums[i] : 0;
+			Pixel::setColorChannel(&colors[i], c, (uint8_t)(mean + 0.5));
+		}
 	}
+	Utils::recordTime(&averagingEndTime);
+
+	phaseTimes.assignmentSecs += Utils::calculateInterval(&assignmentStartTime, &accumulationStartTime);
+	phaseTimes.accumulationSecs += Utils::calculateInterval(&accumulationStartTime, &averagingStartTime);
+	phaseTimes.averagingSecs += Utils::calculateInterval(&averagingStartTime, &averagingEndTime);
 }
 
 int CpuFitnessEvaluator::calculateDiagramPointIndexForPixel(VoronoiDiagram * diagram,
 	int pixelXCoord, int pixelYCoord) {
 
+	int diagramPointsCount = diagram->diagramPointsCount;
 	int startIndex = findClosestHorizontalPoint(diagram, pixelXCoord, pixelYCoord);
 	int currentClosestPointIndex = startIndex;
 	double squareDistanceToClosest = Utils::calculateSquareDistance(
@@ -120,7 +201,9 @@ int CpuFitnessEvaluator::calculateDiagramPointIndexForPixel(VoronoiDiagram * dia
 			diagram->x(currentIndex), diagram->y(currentIndex),
 			pixelXCoord, pixelYCoord);
 
-		if (squareDistanceToCurrent < squareDistanceToClosest) {
+		// Points with the same distance are resolved by lower index, same as in Rasterizer
+		if (squareDistanceToCurrent < squareDistanceToClosest
+			|| (squareDistanceToCurrent == squareDistanceToClosest && currentIndex < currentClosestPointIndex)) {
 			currentClosestPointIndex = currentIndex;
 			squareDistanceToClosest = squareDistanceToCurrent;
 			unacceptableLowerFound = false;
@@ -140,6 +223,7 @@ int CpuFitnessEvaluator::calculateDiagramPointIndexForPixel(VoronoiDiagram * dia
 }
 
 int CpuFitnessEvaluator::findClosestHorizontalPoint(VoronoiDiagram * diagram, int pixelX, int pixelY) {
+	int diagramPointsCount = diagram->diagramPointsCount;
 	if (diagramPointsCount == 1) {
 		return 0;
 	}
@@ -162,12 +246,12 @@ int CpuFitnessEvaluator::findClosestHorizontalPoint(VoronoiDiagram * diagram, in
 	assert(start == end - 2);
 
 	double startPixelSquareDist = Utils::calculateSquareDistance(pixelX, pixelY, diagram->x(start), diagram->y(start));
-	double endPixelSquareDist = Utils::calculateSquareDistance(pixelX, pixelY, diagram->x(end), diagram->y(end));
+	double endPixelSquareDist = Utils::calculateSquareDistance(pixelX, pixelY, diagram->x(end - 1), diagram->y(end - 1));
 	if (startPixelSquareDist < endPixelSquareDist) {
 		return start;
 	}
 	else {
-		return end;
+		return end - 1;
 	}
 }
 
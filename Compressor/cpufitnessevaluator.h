@@ -7,17 +7,25 @@
 namespace lossycompressor {
 
 	/// Calculates fitness using only CPU.
+	/**
+		Inner loops are compiled for every pixel format, so gray images go through one channel only.
+	*/
 	class CpuFitnessEvaluator : public FitnessEvaluator {
-		float * rSums;
-		float * gSums;
-		float * bSums;
-		int * pixelPerPointCounts;
+		// Sums of color channels, channel c of point i is at i * MAX_CHANNELS_COUNT + c
+		static const int MAX_CHANNELS_COUNT = 3;
+		float * channelSums;
+		// Counts of pixels or sums of their weights
+		float * weightSums;
 
 		// Array used to store assignment of color to diagram points
 		Color24bit * colorsTmp;
 
 		// 2 dimensional array used to hold assignments of pixels to diagram points
 		int * pixelPointAssignment;
+
+		// Sizes of allocated buffers
+		int64_t pixelsCapacity;
+		int pointsCapacity;
 		
 		/*
 		Does binary search for closet value in the sorted diagram points.
@@ -29,17 +37,29 @@ namespace lossycompressor {
 		int calculateDiagramPointIndexForPixel(VoronoiDiagram * diagram,
 			int pixelXCoord, int pixelYCoord);
 
+		template <class Pixel>
+		float calculateFitnessForFormat(VoronoiDiagram * diagram);
+
+		template <class Pixel>
+		void calculateColorsForFormat(VoronoiDiagram * diagram, Color24bit * colors, int * pixelPointAssignment);
+
 	protected:
 		virtual float calculateFitnessInternal(VoronoiDiagram * diagram);
 
 		virtual bool isCuda();
 	public:
 		CpuFitnessEvaluator(int sourceWidth, int sourceHeight, 
-			int diagramPointsCount, 
-			uint8_t * sourceImageData, int sourceDataRowWidthInBytes);
+			int maxDiagramPointsCount, 
+			uint8_t * sourceImageData, int sourceDataRowWidthInBytes,
+			PixelFormat sourcePixelFormat);
 
 		~CpuFitnessEvaluator();
 
+		virtual bool resetSourceImage(int sourceWidth, int sourceHeight,
+			int maxDiagramPointsCount,
+			uint8_t * sourceImageData, int sourceDataRowWidthInBytes,
+			PixelFormat sourcePixelFormat);
+
 		/// Calculates average colors of all points in diagram into the colors array.
 		void calculateColors(VoronoiDiagram * diagram,
 			Color24bit * colors,
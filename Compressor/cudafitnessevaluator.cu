@@ -22,37 +22,87 @@ static void HandleError(cudaError_t error, const char *file, int line) {
 
 CudaFitnessEvaluator::CudaFitnessEvaluator(
 	int sourceWidth, int sourceHeight,
-	int diagramPointsCount,
-	uint8_t * sourceImageData, int sourceDataRowWidthInBytes)
-	: FitnessEvaluator(sourceWidth, sourceHeight, diagramPointsCount, sourceImageData, sourceDataRowWidthInBytes) {
+	int maxDiagramPointsCount,
+	uint8_t * sourceImageData, int sourceDataRowWidthInBytes,
+	PixelFormat sourcePixelFormat)
+	: FitnessEvaluator(sourceWidth, sourceHeight, maxDiagramPointsCount, sourceImageData, sourceDataRowWidthInBytes, sourcePixelFormat) {
 
-	CHECK_ERROR(cudaMalloc((void**)&rSums, diagramPointsCount*sizeof(float)));
-	CHECK_ERROR(cudaMalloc((void**)&gSums, diagramPointsCount*sizeof(float)));
-	CHECK_ERROR(cudaMalloc((void**)&bSums, diagramPointsCount*sizeof(float)));
-	CHECK_ERROR(cudaMalloc((void**)&pixelPerPointCounts, diagramPointsCount*sizeof(int)));
+	CHECK_ERROR(cudaMalloc((void**)&channelSums, maxDiagramPointsCount*MAX_CHANNELS_COUNT*sizeof(float)));
+	CHECK_ERROR(cudaMalloc((void**)&weightSums, maxDiagramPointsCount*sizeof(float)));
 
-	CHECK_ERROR(cudaMalloc((void**)&colors, diagramPointsCount*sizeof(Color24bit)));
-	CHECK_ERROR(cudaMalloc((void**)&pixelPointAssignment, sourceHeight*sourceWidth*sizeof(int)));
+	CHECK_ERROR(cudaMalloc((void**)&colors, maxDiagramPointsCount*sizeof(Color24bit)));
+	CHECK_ERROR(cudaMalloc((void**)&pixelPointAssignment, (size_t)sourceHeight*sourceWidth*sizeof(int)));
+	pixelsCapacity = (int64_t)sourceHeight * sourceWidth;
+	pointsCapacity = maxDiagramPointsCount;
 
-	int sourceDataSize = sourceHeight*sourceWidth * 3 * sizeof(uint8_t);
-	CHECK_ERROR(cudaMalloc((void**)&devSourceImageData, sourceDataSize));
-	CHECK_ERROR(cudaMemcpy(devSourceImageData, sourceImageData, sourceDataSize, cudaMemcpyHostToDevice));
+	size_t topRowOffset;
+	sourceDataCapacity = calculateSourceDataSize(sourceHeight, sourceDataRowWidthInBytes, &topRowOffset);
+	CHECK_ERROR(cudaMalloc((void**)&devSourceImageAllocation, sourceDataCapacity));
+	copySourceImageData();
 
 	// Allocate arrays for voronoi diagram saved on device
-	diagramPointsCoordinatesSize = diagramPointsCount * sizeof(int32_t);
+	int diagramPointsCoordinatesSize = maxDiagramPointsCount * sizeof(int32_t);
 	int32_t * devDiagramPointsXCoordinates;
 	CHECK_ERROR(cudaMalloc((void**)&devDiagramPointsXCoordinates, diagramPointsCoordinatesSize));
 	int32_t * devDiagramPointsYCoordinates;
 	CHECK_ERROR(cudaMalloc((void**)&devDiagramPointsYCoordinates, diagramPointsCoordinatesSize));
 
-	diagram = new VoronoiDiagram(diagramPointsCount, devDiagramPointsXCoordinates, devDiagramPointsYCoordinates);
+	diagram = new VoronoiDiagram(maxDiagramPointsCount, devDiagramPointsXCoordinates, devDiagramPointsYCoordinates);
 	CHECK_ERROR(cudaMalloc((void**)&devDiagram, sizeof(VoronoiDiagram)));
 	CHECK_ERROR(cudaMemcpy(devDiagram, diagram, sizeof(VoronoiDiagram), cudaMemcpyHostToDevice));
 
-	// TODO release all these
+	CHECK_ERROR(cudaMalloc((void**)&devFitness, 2 * sizeof(float)));
+	for (int i = 0; i < PHASE_EVENTS_COUNT; ++i) {
+		CHECK_ERROR(cudaEventCreate(&phaseEvents[i]));
+	}
+}
+
+CudaFitnessEvaluator::~CudaFitnessEvaluator() {
+	CHECK_ERROR(cudaFree(channelSums));
+	CHECK_ERROR(cudaFree(weightSums));
+	CHECK_ERROR(cudaFree(colors));
+	CHECK_ERROR(cudaFree(pixelPointAssignment));
+	CHECK_ERROR(cudaFree(devSourceImageAllocation));
+	CHECK_ERROR(cudaFree(diagram->diagramPointsXCoordinates));
+	CHECK_ERROR(cudaFree(diagram->diagramPointsYCoordinates));
+	CHECK_ERROR(cudaFree(devDiagram));
+	CHECK_ERROR(cudaFree(devFitness));
+	for (int i = 0; i < PHASE_EVENTS_COUNT; ++i) {
+		CHECK_ERROR(cudaEventDestroy(phaseEvents[i]));
+	}
+	delete diagram;
+}
+
+bool CudaFitnessEvaluator::resetSourceImage(int sourceWidth, int sourceHeight,
+	int maxDiagramPointsCount,
+	uint8_t * sourceImageData, int sourceDataRowWidthInBytes,
+	PixelFormat sourcePixelFormat) {
+
+	size_t topRowOffset;
+	if ((int64_t)sourceHeight * sourceWidth > pixelsCapacity || maxDiagramPointsCount > pointsCapacity
+		|| calculateSourceDataSize(sourceHeight, sourceDataRowWidthInBytes, &topRowOffset) > sourceDataCapacity) {
+		return false;
+	}
+	setSourceImage(sourceWidth, sourceHeight, maxDiagramPointsCount,
+		sourceImageData, sourceDataRowWidthInBytes, sourcePixelFormat);
+	copySourceImageData();
+	return true;
+}
+
+size_t CudaFitnessEvaluator::calculateSourceDataSize(int sourceHeight, int sourceDataRowWidthInBytes, size_t * topRowOffset) {
+	// Rows are copied with their stride, rows stored from bottom to top have negative stride
+	// and the data start at the bottom row in memory
+	int rowStrideInBytes = sourceDataRowWidthInBytes < 0 ? -sourceDataRowWidthInBytes : sourceDataRowWidthInBytes;
+	*topRowOffset = sourceDataRowWidthInBytes < 0 ? (size_t)(sourceHeight - 1) * rowStrideInBytes : 0;
+	return (size_t)sourceHeight * rowStrideInBytes * sizeof(uint8_t);
 }
 
-CudaFitnessEvaluator::~CudaFitnessEvaluator() {}
+void CudaFitnessEvaluator::copySourceImageData() {
+	size_t topRowOffset;
+	size_t sourceDataSize = calculateSourceDataSize(sourceHeight, sourceDataRowWidthInBytes, &topRowOffset);
+	CHECK_ERROR(cudaMemcpy(devSourceImageAllocation, sourceImageData - topRowOffset, sourceDataSize, cudaMemcpyHostToDevice));
+	devSourceImageData = devSourceImageAllocation + topRowOffset;
+}
 
 __device__ int compare(int firstX, int firstY, int secondX, int secondY) {
 	if (firstX == secondX && firstY == secondY) {
@@ -100,12 +150,12 @@ __device__ int findClosestHorizontalPoint(int diagramPointsCount, VoronoiDiagram
 	}
 
 	double startPixelSquareDist = calculateSquareDistance(pixelX, pixelY, x(diagram, start), y(diagram, start));
-	double endPixelSquareDist = calculateSquareDistance(pixelX, pixelY, x(diagram, end), y(diagram, end));
+	double endPixelSquareDist = calculateSquareDistance(pixelX, pixelY, x(diagram, end - 1), y(diagram, end - 1));
 	if (startPixelSquareDist < endPixelSquareDist) {
 		return start;
 	}
 	else {
-		return end;
+		return end - 1;
 	}
 }
 
@@ -148,7 +198,9 @@ __device__ int calculateDiagramPointIndexForPixel(int diagramPointsCount, Vorono
 			x(diagram, currentIndex), y(diagram, currentIndex),
 			pixelXCoord, pixelYCoord);
 
-		if (squareDistanceToCurrent < squareDistanceToClosest) {
+		// Points with the same distance are resolved by lower index, same as in Rasterizer
+		if (squareDistanceToCurrent < squareDistanceToClosest
+			|| (squareDistanceToCurrent == squareDistanceToClosest && currentIndex < currentClosestPointIndex)) {
 			currentClosestPointIndex = currentIndex;
 			squareDistanceToClosest = squareDistanceToCurrent;
 			unacceptableLowerFound = false;
@@ -171,31 +223,24 @@ __global__ void resetWorkVarsKernel(
 	int diagramPointsCount,
 	int sourceWidth,
 	int sourceHeight,
-	float * rSums,
-	float * gSums,
-	float * bSums,
-	int * pixelPerPointCounts) {
+	float * channelSums,
+	int maxChannelsCount,
+	float * weightSums) {
 
 	int index = threadIdx.x + blockIdx.x * blockDim.x;
 	if (index < diagramPointsCount) {
-		rSums[index] = 0;
-		gSums[index] = 0;
-		bSums[index] = 0;
-		pixelPerPointCounts[index] = 0;
+		for (int c = 0; c < maxChannelsCount; ++c) {
+			channelSums[index * maxChannelsCount + c] = 0;
+		}
+		weightSums[index] = 0;
 	}
 }
 
-__global__ void calculateColorsSumsKernel(
+__global__ void calculatePixelPointAssignmentKernel(
 	VoronoiDiagram * devDiagram,
 	int diagramPointsCount,
 	int sourceWidth,
 	int sourceHeight,
-	uint8_t * devSourceImageData,
-	int sourceDataRowWidthInBytes,
-	float * rSums,
-	float * gSums,
-	float * bSums,
-	int * pixelPerPointCounts,
 	int * pixelPointAssignment) {
 
 	int pixelHorizontal = blockIdx.x * blockDim.x + threadIdx.x;
@@ -203,42 +248,64 @@ __global__ void calculateColorsSumsKernel(
 
 	// If pixel of this thread is in the image
 	if (pixelHorizontal < sourceWidth && pixelVertical < sourceHeight) {
-		int linearIndex = pixelHorizontal + sourceWidth * pixelVertical;
-		int colorStartIndexInSourceData = pixelHorizontal * 3 + pixelVertical * sourceDataRowWidthInBytes;
+		int64_t linearIndex = pixelHorizontal + (int64_t)sourceWidth * pixelVertical;
+		pixelPointAssignment[linearIndex] = calculateDiagramPointIndexForPixel(diagramPointsCount, devDiagram, pixelHorizontal, pixelVertical);
+	}
+}
 
-		// Find diagram points for all pixels and calculate colors of individual points
-		int pointIndex = calculateDiagramPointIndexForPixel(diagramPointsCount, devDiagram, pixelHorizontal, pixelVertical);
+template <class Pixel>
+__global__ void calculateColorsSumsKernel(
+	int sourceWidth,
+	int sourceHeight,
+	uint8_t * devSourceImageData,
+	int sourceDataRowWidthInBytes,
+	float * channelSums,
+	int maxChannelsCount,
+	float * weightSums,
+	int * pixelPointAssignment) {
 
-		pixelPointAssignment[linearIndex] = pointIndex;
+	int pixelHorizontal = blockIdx.x * blockDim.x + threadIdx.x;
+	int pixelVertical = blockIdx.y * blockDim.y + threadIdx.y;
 
-		atomicAdd(bSums + pointIndex, devSourceImageData[colorStartIndexInSourceData]);
-		atomicAdd(gSums + pointIndex, devSourceImageData[colorStartIndexInSourceData + 1]);
-		atomicAdd(rSums + pointIndex, devSourceImageData[colorStartIndexInSourceData + 2]);
-		atomicAdd(pixelPerPointCounts + pointIndex, 1);
+	// If pixel of this thread is in the image
+	if (pixelHorizontal < sourceWidth && pixelVertical < sourceHeight) {
+		int64_t linearIndex = pixelHorizontal + (int64_t)sourceWidth * pixelVertical;
+		uint8_t * pixel = devSourceImageData + pixelHorizontal * Pixel::BYTES_PER_PIXEL + (int64_t)pixelVertical * sourceDataRowWidthInBytes;
+
+		// Sum colors of pixels of every point
+		int pointIndex = pixelPointAssignment[linearIndex];
+		float weight = Pixel::weight(pixel);
+		for (int c = 0; c < Pixel::CHANNELS_COUNT; ++c) {
+			atomicAdd(channelSums + pointIndex * maxChannelsCount + c, weight * Pixel::channel(pixel, c));
+		}
+		atomicAdd(weightSums + pointIndex, weight);
 	}
 }
 
+template <class Pixel>
 __global__ void calculateColorsKernel(
 	int diagramPointsCount,
 	int sourceWidth,
 	int sourceHeight,
-	float * rSums,
-	float * gSums,
-	float * bSums,
-	int * pixelPerPointCounts,
+	float * channelSums,
+	int maxChannelsCount,
+	float * weightSums,
 	Color24bit * colors) {
 
 	int index = threadIdx.x + blockIdx.x * blockDim.x;
 	if (index < diagramPointsCount) {
-		Color24bit * color = &colors[index];
-		color->b = (uint8_t)(bSums[index] / pixelPerPointCounts[index] + 0.5);
-		color->g = (uint8_t)(gSums[index] / pixelPerPointCounts[index] + 0.5);
-		color->r = (uint8_t)(rSums[index] / pixelPerPointCounts[index] + 0.5);
+		// Points without any weight get black color
+		for (int c = 0; c < Pixel::CHANNELS_COUNT; ++c) {
+			float mean = weightSums[index] > 0 ? channelSums[index * maxChannelsCount + c] / weightSums[index] : 0;
+			Pixel::setColorChannel(&colors[index], c, (uint8_t)(mean + 0.5));
+		}
 	}
 }
 
+template <class Pixel>
 __global__ void calculateFitnessKernel(
 	float * outputFitness,
+	float * outputSquaredError,
 	int sourceWidth,
 	int sourceHeight,
 	uint8_t * devSourceImageData,
@@ -246,42 +313,49 @@ __global__ void calculateFitnessKernel(
 	Color24bit * colors,
 	int * pixelPointAssignment) {
 
+	// Sums of the block, added to the outputs by a single thread, so outputs are not contended by every pixel
+	__shared__ float blockFitness;
+	__shared__ float blockSquaredError;
+	bool isFirstThread = threadIdx.x == 0 && threadIdx.y == 0;
+	if (isFirstThread) {
+		blockFitness = 0;
+		blockSquaredError = 0;
+	}
+	__syncthreads();
+
 	int pixelHorizontal = blockIdx.x * blockDim.x + threadIdx.x;
 	int pixelVertical = blockIdx.y * blockDim.y + threadIdx.y;
 
 	// If pixel of this thread is in images
 	if (pixelHorizontal < sourceWidth && pixelVertical < sourceHeight) {
-		int linearIndex = pixelHorizontal + pixelVertical * sourceWidth;
-		int colorStartIndexInSourceData = pixelVertical * sourceDataRowWidthInBytes + pixelHorizontal * 3;
+		int64_t linearIndex = pixelHorizontal + (int64_t)pixelVertical * sourceWidth;
+		uint8_t * pixel = devSourceImageData + (int64_t)pixelVertical * sourceDataRowWidthInBytes + pixelHorizontal * Pixel::BYTES_PER_PIXEL;
 
 		int pointIndex = pixelPointAssignment[linearIndex];
 		Color24bit color = colors[pointIndex];
 
-		float pixelDeviation
-			= (fabsf((float)(devSourceImageData[colorStartIndexInSourceData] - color.b)) // Absolute red color deviation
-			+ fabsf((float)(devSourceImageData[colorStartIndexInSourceData + 1] - color.g)) // Absolute green color deviation
-			+ fabsf((float)(devSourceImageData[colorStartIndexInSourceData + 2] - color.r))); // Absolute blue color deviation
+		float pixelDeviation = 0;
+		float pixelSquaredError = 0;
+		for (int c = 0; c < Pixel::CHANNELS_COUNT; ++c) {
+			float deviation = (float)(Pixel::channel(pixel, c) - Pixel::colorChannel(color, c));
+			pixelDeviation += fabsf(deviation);
+			pixelSquaredError += deviation * deviation;
+		}
 
-		atomicAdd(outputFitness, pixelDeviation);
+		float weight = Pixel::weight(pixel) * Pixel::CHANNEL_COPIES;
+		atomicAdd(&blockFitness, weight * pixelDeviation);
+		atomicAdd(&blockSquaredError, weight * pixelSquaredError);
 	}
-}
-
-float CudaFitnessEvaluator::calculateFitnessInternal(VoronoiDiagram * diagram) {
-	//cudaEvent_t start, middle, stop;
-	//cudaEventCreate(&start);
-	//cudaEventCreate(&middle);
-	//cudaEventCreate(&stop);
-
-	
-	float * devFitness;
-	CHECK_ERROR(cudaMalloc((void**)&devFitness, sizeof(float)));
-	CHECK_ERROR(cudaMemset((void*)devFitness, 0, sizeof(float)));
 
-	CHECK_ERROR(cudaMemcpy(this->diagram->diagramPointsXCoordinates, diagram->diagramPointsXCoordinates,
-		diagramPointsCoordinatesSize, cudaMemcpyHostToDevice));
-	CHECK_ERROR(cudaMemcpy(this->diagram->diagramPointsYCoordinates, diagram->diagramPointsYCoordinates,
-		diagramPointsCoordinatesSize, cudaMemcpyHostToDevice));
+	__syncthreads();
+	if (isFirstThread) {
+		atomicAdd(outputFitness, blockFitness);
+		atomicAdd(outputSquaredError, blockSquaredError);
+	}
+}
 
+template <class Pixel>
+void CudaFitnessEvaluator::runKernels(int diagramPointsCount) {
 	int everyPointThreadCount = BLOCK_SIZE * BLOCK_SIZE;
 	int everyPointBlocksCount = diagramPointsCount / everyPointThreadCount;
 	if (diagramPointsCount - everyPointBlocksCount * everyPointThreadCount > 0) {
@@ -300,58 +374,84 @@ float CudaFitnessEvaluator::calculateFitnessInternal(VoronoiDiagram * diagram) {
 	dim3 everyPixelBlocks(gridWidth, gridHeight);
 	dim3 everyPixelThreads(BLOCK_SIZE, BLOCK_SIZE);
 
+	CHECK_ERROR(cudaEventRecord(phaseEvents[0], 0));
+	calculatePixelPointAssignmentKernel << <everyPixelBlocks, everyPixelThreads >> >(
+		devDiagram, diagramPointsCount,
+		sourceWidth, sourceHeight,
+		pixelPointAssignment);
+
+	CHECK_ERROR(cudaEventRecord(phaseEvents[1], 0));
 	resetWorkVarsKernel << <everyPointBlocksCount, everyPointThreadCount >> >(
 		diagramPointsCount,
 		sourceWidth, sourceHeight,
-		rSums, gSums, bSums, pixelPerPointCounts);
-
-
-	//cudaEventRecord(start, 0);
+		channelSums, MAX_CHANNELS_COUNT, weightSums);
 
-
-	calculateColorsSumsKernel << <everyPixelBlocks, everyPixelThreads >> >(
-		devDiagram, diagramPointsCount,
+	calculateColorsSumsKernel<Pixel> << <everyPixelBlocks, everyPixelThreads >> >(
 		sourceWidth, sourceHeight,
 		devSourceImageData, sourceDataRowWidthInBytes,
-		rSums, gSums, bSums, pixelPerPointCounts,
+		channelSums, MAX_CHANNELS_COUNT, weightSums,
 		pixelPointAssignment);
 
-
-	//cudaEventRecord(middle, 0);
-
-
-	calculateColorsKernel << <everyPointBlocksCount, everyPointThreadCount >> >(
+	CHECK_ERROR(cudaEventRecord(phaseEvents[2], 0));
+	calculateColorsKernel<Pixel> << <everyPointBlocksCount, everyPointThreadCount >> >(
 		diagramPointsCount,
 		sourceWidth, sourceHeight,
-		rSums, gSums, bSums, pixelPerPointCounts,
+		channelSums, MAX_CHANNELS_COUNT, weightSums,
 		colors);
 
-	calculateFitnessKernel << <everyPixelBlocks, everyPixelThreads >> >(
+	CHECK_ERROR(cudaEventRecord(phaseEvents[3], 0));
+	calculateFitnessKernel<Pixel> << <everyPixelBlocks, everyPixelThreads >> >(
 		devFitness,
+		devFitness + 1,
 		sourceWidth, sourceHeight,
 		devSourceImageData,
 		sourceDataRowWidthInBytes,
 		colors, pixelPointAssignment);
+	CHECK_ERROR(cudaEventRecord(phaseEvents[4], 0));
+}
+
+float CudaFitnessEvaluator::calculateFitnessInternal(VoronoiDiagram * diagram) {
+	CHECK_ERROR(cudaMemset((void*)devFitness, 0, 2 * sizeof(float)));
+
+	int diagramPointsCount = diagram->diagramPointsCount;
+	int diagramPointsCoordinatesSize = diagramPointsCount * sizeof(int32_t);
+	CHECK_ERROR(cudaMemcpy(this->diagram->diagramPointsXCoordinates, diagram->diagramPointsXCoordinates,
+		diagramPointsCoordinatesSize, cudaMemcpyHostToDevice));
+	CHECK_ERROR(cudaMemcpy(this->diagram->diagramPointsYCoordinates, diagram->diagramPointsYCoordinates,
+		diagramPointsCoordinatesSize, cudaMemcpyHostToDevice));
+
+	switch (sourcePixelFormat) {
+	case PixelFormat::GRAY8:
+		runKernels<Gray8Pixel>(diagramPointsCount);
+		break;
+	case PixelFormat::BGRA32:
+		runKernels<Bgra32Pixel>(diagramPointsCount);
+		break;
+	case PixelFormat::BGRA32_ALPHA_WEIGHTED:
+		runKernels<Bgra32AlphaWeightedPixel>(diagramPointsCount);
+		break;
+	default:
+		runKernels<Bgr24Pixel>(diagramPointsCount);
+		break;
+	}
 
 	// Copy back result fitness
-	float fitness = 0;
-	CHECK_ERROR(cudaMemcpy(&fitness, devFitness, sizeof(float), cudaMemcpyDeviceToHost));
-
-	
-	//cudaEventRecord(stop, 0);
-	//cudaEventSynchronize(stop);
-	//float elapsedTimeToMiddle;
-	//float elapsedTimeAfterMiddle;
-	//cudaEventElapsedTime(&elapsedTimeToMiddle, start, middle);
-	//cudaEventElapsedTime(&elapsedTimeAfterMiddle, middle, stop);
-	//printf("%3.1f %3.1f\n", elapsedTimeToMiddle, elapsedTimeAfterMiddle);
-	//// zruen udlost start a stop
-	//cudaEventDestroy(start);
-	//cudaEventDestroy(middle);
-	//cudaEventDestroy(stop);
-
-	
-	return fitness / (sourceWidth * sourceHeight);
+	float fitnessAndSquaredError[2];
+	CHECK_ERROR(cudaMemcpy(fitnessAndSquaredError, devFitness, 2 * sizeof(float), cudaMemcpyDeviceToHost));
+	float fitness = fitnessAndSquaredError[0];
+	lastMeanSquaredError = fitnessAndSquaredError[1] / ((float)sourceWidth * sourceHeight * 3);
+
+	// Copy of the result waited for the kernels, so all events are recorded
+	float phaseMillis[PHASE_EVENTS_COUNT - 1];
+	for (int i = 0; i < PHASE_EVENTS_COUNT - 1; ++i) {
+		CHECK_ERROR(cudaEventElapsedTime(&phaseMillis[i], phaseEvents[i], phaseEvents[i + 1]));
+	}
+	phaseTimes.assignmentSecs += phaseMillis[0] / 1000.0;
+	phaseTimes.accumulationSecs += phaseMillis[1] / 1000.0;
+	phaseTimes.averagingSecs += phaseMillis[2] / 1000.0;
+	phaseTimes.errorSecs += phaseMillis[3] / 1000.0;
+
+	return fitness / ((float)sourceWidth * sourceHeight);
 }
 
 bool CudaFitnessEvaluator::isCuda() {
@@ -4,19 +4,30 @@
 #include "voronoidiagram.h"
 #include "color.h"
 
+// Type of CUDA events, same as cudaEvent_t, so the header does not need CUDA headers
+struct CUevent_st;
+
 namespace lossycompressor {
 
 	/// Calculates fitness. The calculation is accelerated by CUDA.
+	/**
+		Kernels are compiled for every pixel format, so gray images go through one channel only.
+	*/
 	class CudaFitnessEvaluator : public FitnessEvaluator {
-		int diagramPointsCoordinatesSize;
-		
 		// All pointers to work variables point to device (GPU) memory
 
-		// Holds sums of colors and counts of pixels
-		float * rSums;
-		float * gSums;
-		float * bSums;
-		int * pixelPerPointCounts;
+		// Events recorded at the start of every phase of fitness calculation and at the end of the last one
+		static const int PHASE_EVENTS_COUNT = 5;
+		CUevent_st * phaseEvents[PHASE_EVENTS_COUNT];
+
+		// Holds sum of absolute deviations followed by sum of squared deviations
+		float * devFitness;
+
+		// Holds sums of color channels, channel c of point i is at i * MAX_CHANNELS_COUNT + c
+		static const int MAX_CHANNELS_COUNT = 3;
+		float * channelSums;
+		// Holds counts of pixels or sums of their weights
+		float * weightSums;
 
 		// Array used to store assignment of color to diagram points
 		Color24bit * colors;
@@ -24,20 +35,42 @@ namespace lossycompressor {
 		// array used to hold assignments of pixels to diagram points
 		int * pixelPointAssignment;
 
-		// Image data on device
+		// Image data on device, rows stored from bottom to top start after the beginning of the allocation
 		uint8_t * devSourceImageData;
+		uint8_t * devSourceImageAllocation;
+
+		// Sizes of allocated buffers
+		int64_t pixelsCapacity;
+		int pointsCapacity;
+		size_t sourceDataCapacity;
 
 		VoronoiDiagram * diagram;
 		VoronoiDiagram * devDiagram;
+
+		// Returns size of source image data copied to device and offset of its top row
+		static size_t calculateSourceDataSize(int sourceHeight, int sourceDataRowWidthInBytes, size_t * topRowOffset);
+
+		// Copies source image data into device memory
+		void copySourceImageData();
+
+		// Runs kernels calculating colors and deviations of all pixels into devFitness, records phase events before and after them
+		template <class Pixel>
+		void runKernels(int diagramPointsCount);
 	protected:
 		virtual float calculateFitnessInternal(VoronoiDiagram * diagram);
 
 		virtual bool isCuda();
 	public:
 		CudaFitnessEvaluator(int sourceWidth, int sourceHeight,
-			int diagramPointsCount,
-			uint8_t * sourceImageData, int sourceDataRowWidthInBytes);
+			int maxDiagramPointsCount,
+			uint8_t * sourceImageData, int sourceDataRowWidthInBytes,
+			PixelFormat sourcePixelFormat);
 
 		~CudaFitnessEvaluator();
+
+		virtual bool resetSourceImage(int sourceWidth, int sourceHeight,
+			int maxDiagramPointsCount,
+			uint8_t * sourceImageData, int sourceDataRowWidthInBytes,
+			PixelFormat sourcePixelFormat);
 	};
 }
\ No newline at end of file
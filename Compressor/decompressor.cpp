@@ -0,0 +1,88 @@
+#include "decompressor.h"
+#include "vorformat.h"
+#include "rasterizer.h"
+#include "bmpfile.h"
+#include "utils.h"
+#include <cstdio>
+
+using namespace std;
+using namespace lossycompressor;
+
+int Decompressor::decompress() {
+	int32_t width;
+	int32_t height;
+	VoronoiDiagram * diagram;
+	Color24bit * colors;
+	int err;
+	if (args->maxReadSizeBytes > 0) {
+		err = VorFormat::readPrefix(args->compressedPath, args->maxReadSizeBytes, &width, &height, &diagram, &colors);
+	}
+	else if (args->windowWidth != 0 && args->windowHeight != 0) {
+		// Only points of the window are read if the file has tile index
+		err = VorFormat::readRegion(args->compressedPath, args->windowX, args->windowY,
+			args->windowWidth, args->windowHeight, &width, &height, &diagram, &colors);
+	}
+	else {
+		err = VorFormat::read(args->compressedPath, &width, &height, &diagram, &colors);
+	}
+	if (err != 0) {
+		printf("Encountered error during compressed file reading with code %d\n", err);
+		return err;
+	}
+
+	int32_t windowX = args->windowX;
+	int32_t windowY = args->windowY;
+	int32_t windowWidth = args->windowWidth;
+	int32_t windowHeight = args->windowHeight;
+	if (windowWidth == 0 || windowHeight == 0) {
+		windowX = 0;
+		windowY = 0;
+		windowWidth = width;
+		windowHeight = height;
+	}
+
+	int32_t outputWidth = args->outputWidth;
+	int32_t outputHeight = args->outputHeight;
+	if (outputWidth == 0 && outputHeight == 0) {
+		outputWidth = windowWidth;
+		outputHeight = windowHeight;
+	}
+	else if (outputWidth == 0) {
+		outputWidth = Utils::max(1, (int)((int64_t)outputHeight * windowWidth / windowHeight));
+	}
+	else if (outputHeight == 0) {
+		outputHeight = Utils::max(1, (int)((int64_t)outputWidth * windowHeight / windowWidth));
+	}
+
+	if (windowX < 0 || windowY < 0 || windowWidth < 0 || windowHeight < 0
+		|| windowX + (int64_t)windowWidth > width || windowY + (int64_t)windowHeight > height
+		|| outputWidth <= 0 || outputHeight <= 0 || args->samplesPerAxis < 1) {
+		printf("Drawn window must be inside the %dx%d image and output size must be positive\n", width, height);
+		delete diagram;
+		delete[] colors;
+		return ERROR_INVALID_WINDOW;
+	}
+
+	int rowWidthInBytes = BmpFile::calculateRowWidthInBytes(outputWidth);
+	uint8_t * imageData = new uint8_t[(int64_t)rowWidthInBytes * outputHeight];
+
+	Rasterizer rasterizer(diagram, width, height);
+	rasterizer.rasterize(colors, outputWidth, outputHeight,
+		windowX, windowY, windowWidth, windowHeight, args->samplesPerAxis,
+		imageData, rowWidthInBytes, args->threadCount);
+
+	if (args->outputFormat == OutputFormat::RAW) {
+		err = BmpFile::writeRaw(args->destinationImagePath, outputWidth, outputHeight, imageData, rowWidthInBytes);
+	}
+	else {
+		err = BmpFile::write(args->destinationImagePath, outputWidth, outputHeight, imageData, rowWidthInBytes);
+	}
+	if (err != 0) {
+		printf("Encountered error during output image file writing with code %d\n", err);
+	}
+
+	delete[] imageData;
+	delete diagram;
+	delete[] colors;
+	return err;
+}
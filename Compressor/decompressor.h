@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+
+namespace lossycompressor {
+
+	/// Class decompressing compressed files created by Compressor back into images.
+	/**
+		Compressed file is read by VorFormat and the diagram is drawn by Rasterizer.
+	*/
+	class Decompressor {
+	public:
+		/// Format of the decompressed image file.
+		enum OutputFormat {
+			BMP,	///< BMP file with 24 bit color depth.
+			RAW		///< Pixels (b, g, r) stored by rows from top to bottom without any header or padding.
+		};
+
+		/// Instance of this class is passed as a parameter into Decompressor.
+		struct Args {
+			const char * compressedPath;						///< Path of the compressed file.
+			const char * destinationImagePath;					///< Output path of the decompressed image.
+			OutputFormat outputFormat = OutputFormat::BMP;		///< Format of the decompressed image.
+			int threadCount = 0;								///< Count of threads used for drawing, count of hardware threads if 0.
+
+			// Drawn window of the source image, whole image is drawn if the width or height is 0
+			int32_t windowX = 0;								///< X coordinate of the left edge of the drawn window in source pixels.
+			int32_t windowY = 0;								///< Y coordinate of the top edge of the drawn window in source pixels.
+			int32_t windowWidth = 0;							///< Width of the drawn window in source pixels.
+			int32_t windowHeight = 0;							///< Height of the drawn window in source pixels.
+
+			// Size of the decompressed image, if one is 0 it keeps the aspect ratio of the window, window size is used if both are 0
+			int32_t outputWidth = 0;							///< Width of the decompressed image.
+			int32_t outputHeight = 0;							///< Height of the decompressed image.
+
+			uint32_t maxReadSizeBytes = 0;						///< Only this many bytes from the beginning of the compressed file are read, progressive file is drawn from its levels read completely. Whole file is read if 0.
+
+			int samplesPerAxis = 1;								///< Count of samples of every pixel in each axis used for anti-aliasing, 1 disables anti-aliasing.
+		};
+	private:
+		Decompressor::Args * args;
+	public:
+		static const int ERROR_INVALID_WINDOW = 10;				///< Decompression error code. Drawn window is not inside the image or output size is invalid.
+
+		/// Construct a new Decompressor with given arguments.
+		Decompressor(Decompressor::Args * args) : args(args) {};
+
+		/// Do decompression.
+		/**
+			\return	0 if decompression was successfull. Error code of this class, VorFormat or BmpFile otherwise.
+		*/
+		int decompress();
+	};
+}
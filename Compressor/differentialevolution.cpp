@@ -0,0 +1,178 @@
+#include "differentialevolution.h"
+#include "compressorutils.h"
+#include "utils.h"
+#include <algorithm>
+#include <random>
+#include <utility>
+
+using namespace std;
+using namespace lossycompressor;
+
+int32_t DifferentialEvolution::clampCoordinate(float coordinate, int32_t size) {
+	int32_t result = (int32_t)(coordinate + 0.5f);
+	if (result < 0) {
+		return 0;
+	}
+	else if (result > size - 1) {
+		return size - 1;
+	}
+	return result;
+}
+
+void DifferentialEvolution::scatter(VoronoiDiagram * source, VoronoiDiagram * destination) {
+	float maxHorizontalMovement = args->sourceWidth * INITIAL_SCATTER_RATE;
+	float maxVerticalMovement = args->sourceHeight * INITIAL_SCATTER_RATE;
+
+	for (int i = 0; i < args->diagramPointsCount; ++i) {
+		destination->setPoint(i,
+			clampCoordinate(source->x(i) + (2 * Utils::generateRandomFloat() - 1) * maxHorizontalMovement, args->sourceWidth),
+			clampCoordinate(source->y(i) + (2 * Utils::generateRandomFloat() - 1) * maxVerticalMovement, args->sourceHeight));
+	}
+
+	CompressorUtils::sortDiagramPoints(destination);
+}
+
+void DifferentialEvolution::createTrial(VoronoiDiagram * target,
+	VoronoiDiagram * first, VoronoiDiagram * second, VoronoiDiagram * third,
+	float differentialWeight, float crossoverRate,
+	VoronoiDiagram * trial) {
+
+	candidateOperator = ConvergenceTrace::Operator::DIFFERENTIAL_TRIAL;
+
+	// Mutant replaces a block of consecutive points, so only points close to each other
+	// in the horizontal direction are changed at once. Block has at least one point and
+	// it is prolonged by another point with probability given by crossover rate.
+	int blockStart = Utils::generateRandom(args->diagramPointsCount - 1);
+	int blockLength = 1;
+	while (blockLength < args->diagramPointsCount && Utils::generateRandomFloat() < crossoverRate) {
+		++blockLength;
+	}
+
+	CompressorUtils::copy(target, trial);
+	for (int j = 0; j < blockLength; ++j) {
+		int i = (blockStart + j) % args->diagramPointsCount;
+		trial->setPoint(i,
+			clampCoordinate(first->x(i) + differentialWeight * (second->x(i) - third->x(i)), args->sourceWidth),
+			clampCoordinate(first->y(i) + differentialWeight * (second->y(i) - third->y(i)), args->sourceHeight));
+	}
+
+	CompressorUtils::sortDiagramPoints(trial);
+}
+
+int DifferentialEvolution::compressInternal(VoronoiDiagram * outputDiagram,
+	Color24bit * colors, int * pixelPointAssignment) {
+
+	vector<VoronoiDiagram*> population;
+	vector<float> populationFitness;
+	vector<float> differentialWeights;
+	vector<float> crossoverRates;
+
+	VoronoiDiagram * trial = new VoronoiDiagram(args->diagramPointsCount);
+
+	// First member is always evaluated, so there is a best solution even if the computation stops at once
+	int bestIndex = 0;
+	for (int i = 0; i < POPULATION_SIZE && (i == 0 || canContinueComputing()); ++i) {
+		VoronoiDiagram * populationMember = new VoronoiDiagram(args->diagramPointsCount);
+		if (i == 0) {
+			generateStartingDiagram(populationMember);
+		}
+		else {
+			scatter(population[0], populationMember);
+		}
+		float memberFitness = calculateFitness(populationMember);
+
+		population.push_back(populationMember);
+		populationFitness.push_back(memberFitness);
+		differentialWeights.push_back(INITIAL_DIFFERENTIAL_WEIGHT);
+		crossoverRates.push_back(INITIAL_CROSSOVER_RATE);
+
+		if (memberFitness < populationFitness[bestIndex]) {
+			bestIndex = i;
+		}
+	}
+
+	// Mutation needs three population members distinct from the target
+	bool canEvolve = population.size() >= 4;
+	mt19937 & generator = Utils::getRandomGenerator();
+	vector<int> donorIndices;
+	while (canEvolve && canContinueComputing()) {
+		for (int i = 0; i < population.size() && canContinueComputing(); ++i) {
+			// Donors are the first three members other than the target after a partial shuffle
+			donorIndices.clear();
+			for (int j = 0; j < population.size(); ++j) {
+				if (j != i) {
+					donorIndices.push_back(j);
+				}
+			}
+			for (int j = 0; j < 3; ++j) {
+				uniform_int_distribution<int> distribution(j, (int)donorIndices.size() - 1);
+				swap(donorIndices[j], donorIndices[distribution(generator)]);
+			}
+			int firstIndex = donorIndices[0];
+			int secondIndex = donorIndices[1];
+			int thirdIndex = donorIndices[2];
+
+			float differentialWeight = differentialWeights[i];
+			if (Utils::generateRandomFloat() < DIFFERENTIAL_WEIGHT_ADAPTATION_RATE) {
+				differentialWeight = MIN_DIFFERENTIAL_WEIGHT
+					+ Utils::generateRandomFloat() * (MAX_DIFFERENTIAL_WEIGHT - MIN_DIFFERENTIAL_WEIGHT);
+			}
+			float crossoverRate = crossoverRates[i];
+			if (Utils::generateRandomFloat() < CROSSOVER_RATE_ADAPTATION_RATE) {
+				crossoverRate = Utils::generateRandomFloat() * MAX_CROSSOVER_RATE;
+			}
+
+			createTrial(population[i],
+				population[firstIndex], population[secondIndex], population[thirdIndex],
+				differentialWeight, crossoverRate, trial);
+			float trialFitness = calculateFitness(trial);
+
+			if (trialFitness <= populationFitness[i]) {
+				// Trial replaces the target together with its parameters
+				VoronoiDiagram * replaced = population[i];
+				population[i] = trial;
+				trial = replaced;
+				populationFitness[i] = trialFitness;
+				differentialWeights[i] = differentialWeight;
+				crossoverRates[i] = crossoverRate;
+
+				if (trialFitness < populationFitness[bestIndex]) {
+					bestIndex = i;
+				}
+			}
+		}
+
+		// Trials replacing targets of the same fitness collapse the population into copies of one diagram,
+		// whose trials are the same diagram again, so the other members are scattered around the best one
+		auto fitnessRange = minmax_element(populationFitness.begin(), populationFitness.end());
+		if (*fitnessRange.first == *fitnessRange.second) {
+			candidateOperator = ConvergenceTrace::Operator::INITIAL;
+			VoronoiDiagram * best = population[bestIndex];
+			for (int i = 0; i < population.size() && canContinueComputing(); ++i) {
+				if (population[i] == best) {
+					continue;
+				}
+				scatter(best, population[i]);
+				populationFitness[i] = calculateFitness(population[i]);
+				differentialWeights[i] = INITIAL_DIFFERENTIAL_WEIGHT;
+				crossoverRates[i] = INITIAL_CROSSOVER_RATE;
+				if (populationFitness[i] < populationFitness[bestIndex]) {
+					bestIndex = i;
+				}
+			}
+		}
+	}
+
+	onBestSolutionFound(populationFitness[bestIndex]);
+
+	// Copy the coordinates of points from the result diagram we obtained to the output diagram
+	CompressorUtils::copy(population[bestIndex], outputDiagram);
+	cpuFitnessEvaluator->calculateColors(outputDiagram, colors, pixelPointAssignment);
+
+	for (int i = 0; i < population.size(); ++i) {
+		delete population[i];
+	}
+	delete trial;
+
+	return 0;
+}
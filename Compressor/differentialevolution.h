@@ -0,0 +1,66 @@
+#pragma once
+
+#include "compressoralgorithm.h"
+#include <vector>
+
+using namespace std;
+
+namespace lossycompressor {
+	/// Uses differential evolution to come up with best position of diagram points.
+	/**
+		Diagram is treated as a continuous vector of point coordinates. Trial
+		diagram is created from the target diagram by replacing a block of its consecutive
+		points with points given by difference of two population members added to a third one
+		(DE/rand/1/exp). Points on the same index are corresponding since points in
+		all diagrams are sorted by their horizontal coordinate. Trial diagram is sorted
+		again before its evaluation.
+
+		Initial population is scattered around a single random diagram, so the difference
+		vectors work as step sizes that shrink as the population converges. When all members
+		reach the same fitness, the other members are scattered around the best one again.
+
+		Differential weight and crossover rate are kept for every population member
+		and adapted during the computation (jDE self-adaptation): new values are generated
+		randomly for trial diagram and survive only if the trial diagram replaces the target.
+	*/
+	class DifferentialEvolution : public CompressorAlgorithm {
+		const int POPULATION_SIZE = 10;
+
+		// Initial differential weight and crossover rate of population members
+		const float INITIAL_DIFFERENTIAL_WEIGHT = 0.5f;
+		const float INITIAL_CROSSOVER_RATE = 0.3f;
+
+		// Probabilities that new differential weight or crossover rate will be generated for trial diagram
+		const float DIFFERENTIAL_WEIGHT_ADAPTATION_RATE = 0.1f;
+		const float CROSSOVER_RATE_ADAPTATION_RATE = 0.1f;
+
+		// Bounds of newly generated differential weight and crossover rate
+		const float MIN_DIFFERENTIAL_WEIGHT = 0.1f;
+		const float MAX_DIFFERENTIAL_WEIGHT = 1.0f;
+		const float MAX_CROSSOVER_RATE = 0.6f;
+
+		// Maximal movement of points in initial population relative to image size
+		const float INITIAL_SCATTER_RATE = 0.1f;
+
+		int32_t clampCoordinate(float coordinate, int32_t size);
+	protected:
+		/// Copies the source diagram into destination diagram with all points randomly moved by a small distance.
+		void scatter(VoronoiDiagram * source, VoronoiDiagram * destination);
+
+		/// Creates trial diagram from the target diagram and three other distinct population members.
+		void createTrial(VoronoiDiagram * target,
+			VoronoiDiagram * first,
+			VoronoiDiagram * second,
+			VoronoiDiagram * third,
+			float differentialWeight,
+			float crossoverRate,
+			VoronoiDiagram * trial);
+
+		virtual int compressInternal(VoronoiDiagram * outputDiagram,
+			Color24bit * colors,
+			int * pixelPointAssignment) override;
+	public:
+		DifferentialEvolution(CompressorAlgorithm::Args* args)
+			: CompressorAlgorithm(args) {};
+	};
+}
@@ -2,6 +2,7 @@
 #include "compressorutils.h"
 #include "utils.h"
 #include <random>
+#include <utility>
 
 using namespace std;
 using namespace lossycompressor;
@@ -12,10 +13,20 @@ void EvolutionaryAlgorithm::generateInitialPopulation(int populationSize,
 	float * bestFitness,
 	VoronoiDiagram ** best) {
 
-	for (int i = 0; i < populationSize && canContinueComputing(); ++i) {
+	// First member is always evaluated, so there is a best solution even if the computation stops at once
+	for (int i = 0; i < populationSize && (i == 0 || canContinueComputing()); ++i) {
 		VoronoiDiagram * populationMember = new VoronoiDiagram(args->diagramPointsCount);
 		population->push_back(populationMember);
-		CompressorUtils::generateRandomDiagram(populationMember, args->sourceWidth, args->sourceHeight);
+		if (i == 0) {
+			generateStartingDiagram(populationMember);
+		}
+		else if (args->initialDiagram != NULL) {
+			// Keep the population around the initial diagram
+			perturb((*population)[0], populationMember, INITIAL_POPULATION_PERTURBED_POINTS_COUNT);
+		}
+		else {
+			CompressorUtils::generateRandomDiagram(populationMember, args->sourceWidth, args->sourceHeight);
+		}
 
 		float memberFitness = calculateFitness(populationMember);
 		populationFitness->push_back(memberFitness);
@@ -27,6 +38,31 @@ void EvolutionaryAlgorithm::generateInitialPopulation(int populationSize,
 	}
 }
 
+int EvolutionaryAlgorithm::startPopulation(const char * algorithmName, int populationSize,
+	vector<VoronoiDiagram*> * population,
+	vector<float> * populationFitness,
+	float * bestFitness,
+	VoronoiDiagram ** best) {
+
+	bool isResumed;
+	int err = readCheckpoint(algorithmName, populationSize, population, populationFitness, &isResumed);
+	if (err != 0) {
+		return err;
+	}
+	if (!isResumed) {
+		generateInitialPopulation(populationSize, population, populationFitness, bestFitness, best);
+		return 0;
+	}
+
+	for (int i = 0; i < population->size(); ++i) {
+		if (*best == NULL || (*populationFitness)[i] < *bestFitness) {
+			*best = (*population)[i];
+			*bestFitness = (*populationFitness)[i];
+		}
+	}
+	return 0;
+}
+
 void EvolutionaryAlgorithm::selection(int selectionSize,
 	vector<VoronoiDiagram*> * population,
 	vector<float> * populationFitness,
@@ -146,24 +182,107 @@ void EvolutionaryAlgorithm::crossover(
 	VoronoiDiagram * firstParent, VoronoiDiagram * secondParent,
 	VoronoiDiagram * firstChild, VoronoiDiagram * secondChild) {
 
-	int crossoverStartIndex = Utils::generateRandom(args->diagramPointsCount - 1);
-	int crossoverLength = Utils::generateRandom(args->diagramPointsCount - 1) + 1;
+	candidateOperator = ConvergenceTrace::Operator::CROSSOVER;
+
+	// Pick random rectangle, points of parents inside of it will be exchanged
+	CrossoverRegion region;
+	region.left = Utils::generateRandom(args->sourceWidth - 1);
+	region.right = Utils::generateRandom(args->sourceWidth - 1);
+	if (region.left > region.right) {
+		std::swap(region.left, region.right);
+	}
+	region.bottom = Utils::generateRandom(args->sourceHeight - 1);
+	region.top = Utils::generateRandom(args->sourceHeight - 1);
+	if (region.bottom > region.top) {
+		std::swap(region.bottom, region.top);
+	}
+
+	int firstInsideCount = countPointsInRegion(firstParent, &region);
+	int secondInsideCount = countPointsInRegion(secondParent, &region);
 
-	int crossoverLastIndexOverlapping = crossoverStartIndex + crossoverLength;
-	int crossoverLastIndex = crossoverLastIndexOverlapping % args->diagramPointsCount;
+	// Children must have the same count of points as parents. Parent with more points
+	// inside of the rectangle therefore keeps the surplus in its own child.
+	region.firstParentKeptCount = Utils::max(firstInsideCount - secondInsideCount, 0);
+	region.firstParentInsideCount = firstInsideCount;
+	region.secondParentKeptCount = Utils::max(secondInsideCount - firstInsideCount, 0);
+	region.secondParentInsideCount = secondInsideCount;
 
-	for (int i = 0; i < args->diagramPointsCount; ++i) {
-		bool isCrossoverIndex = (i >= crossoverStartIndex && i <= crossoverLastIndexOverlapping)
-			|| (crossoverLastIndex < crossoverStartIndex && i <= crossoverLastIndex);
+	mergeChild(firstParent, secondParent, &region, true, firstChild);
+	mergeChild(secondParent, firstParent, &region, false, secondChild);
+}
 
-		if (isCrossoverIndex) {
-			CompressorUtils::copyPoint(firstParent, secondChild, i);
-			CompressorUtils::copyPoint(secondParent, firstChild, i);
+int EvolutionaryAlgorithm::countPointsInRegion(VoronoiDiagram * diagram, CrossoverRegion * region) {
+	int count = 0;
+	for (int i = 0; i < diagram->diagramPointsCount && diagram->x(i) <= region->right; ++i) {
+		if (isInRegion(diagram, i, region)) {
+			++count;
+		}
+	}
+	return count;
+}
+
+bool EvolutionaryAlgorithm::isInRegion(VoronoiDiagram * diagram, int index, CrossoverRegion * region) {
+	return diagram->x(index) >= region->left && diagram->x(index) <= region->right
+		&& diagram->y(index) >= region->bottom && diagram->y(index) <= region->top;
+}
+
+bool EvolutionaryAlgorithm::isExchanged(int insideIndex, int insideCount, int keptCount) {
+	// Kept points are spread evenly among points inside of the region
+	return ((insideIndex + 1) * keptCount) / insideCount == (insideIndex * keptCount) / insideCount;
+}
+
+void EvolutionaryAlgorithm::mergeChild(VoronoiDiagram * parent, VoronoiDiagram * otherParent,
+	CrossoverRegion * region, bool isFirstParent, VoronoiDiagram * child) {
+
+	int parentInsideCount = isFirstParent ? region->firstParentInsideCount : region->secondParentInsideCount;
+	int parentKeptCount = isFirstParent ? region->firstParentKeptCount : region->secondParentKeptCount;
+	int otherInsideCount = isFirstParent ? region->secondParentInsideCount : region->firstParentInsideCount;
+	int otherKeptCount = isFirstParent ? region->secondParentKeptCount : region->firstParentKeptCount;
+
+	// Child gets points of the parent that are not exchanged and points of the other
+	// parent that are exchanged. Both sequences are sorted, so they are merged in linear time.
+	int parentIndex = 0, parentInsideIndex = 0;
+	int otherIndex = 0, otherInsideIndex = 0;
+	int childIndex = 0;
+	while (childIndex < child->diagramPointsCount) {
+		// Skip points of parent that go to the other child
+		while (parentIndex < parent->diagramPointsCount && isInRegion(parent, parentIndex, region)
+			&& isExchanged(parentInsideIndex, parentInsideCount, parentKeptCount)) {
+			++parentIndex;
+			++parentInsideIndex;
+		}
+		// Skip points of the other parent that stay in its own child
+		while (otherIndex < otherParent->diagramPointsCount) {
+			if (!isInRegion(otherParent, otherIndex, region)) {
+				++otherIndex;
+			}
+			else if (!isExchanged(otherInsideIndex, otherInsideCount, otherKeptCount)) {
+				++otherIndex;
+				++otherInsideIndex;
+			}
+			else {
+				break;
+			}
+		}
+
+		bool takeFromParent = otherIndex >= otherParent->diagramPointsCount
+			|| (parentIndex < parent->diagramPointsCount
+			&& CompressorUtils::compare(parent->x(parentIndex), parent->y(parentIndex),
+			otherParent->x(otherIndex), otherParent->y(otherIndex)) <= 0);
+
+		if (takeFromParent) {
+			if (isInRegion(parent, parentIndex, region)) {
+				++parentInsideIndex;
+			}
+			child->setPoint(childIndex, parent->x(parentIndex), parent->y(parentIndex));
+			++parentIndex;
 		}
 		else {
-			CompressorUtils::copyPoint(firstParent, firstChild, i);
-			CompressorUtils::copyPoint(secondParent, secondChild, i);
+			child->setPoint(childIndex, otherParent->x(otherIndex), otherParent->y(otherIndex));
+			++otherIndex;
+			++otherInsideIndex;
 		}
+		++childIndex;
 	}
 }
 
@@ -183,11 +302,19 @@ int EvolutionaryAlgorithm::compressInternal(VoronoiDiagram * outputDiagram,
 	VoronoiDiagram * best = NULL;
 	float bestFitness;
 
-	generateInitialPopulation(POPULATION_SIZE,
+	int err = startPopulation("evolutionary", POPULATION_SIZE,
 		&population, &populationFitness,
 		&bestFitness, &best);
+	if (err != 0) {
+		delete diagramPool[0];
+		return err;
+	}
 
 	while (canContinueComputing()) {
+		if (isCheckpointDue()) {
+			writeCheckpoint("evolutionary", population, populationFitness);
+		}
+
 		selection(selectionSize, &population, &populationFitness, &diagramPool);
 		int selectedPopSize = population.size();
 
@@ -14,8 +14,40 @@ namespace lossycompressor {
 		const float SELECTION_RATE = 0.5f;
 		// Percentage of individuals filled into population by crossover instead of mutation
 		const float CROSSOVER_RATE = 0.5f;
+
+		// Count of points moved in members of initial population generated from the initial diagram
+		const int INITIAL_POPULATION_PERTURBED_POINTS_COUNT = 3;
+
+		// Rectangle used in crossover together with counts of parents' points inside of it
+		struct CrossoverRegion {
+			int32_t left;
+			int32_t right;
+			int32_t bottom;
+			int32_t top;
+			int firstParentInsideCount;
+			int firstParentKeptCount;
+			int secondParentInsideCount;
+			int secondParentKeptCount;
+		};
+
+		int countPointsInRegion(VoronoiDiagram * diagram, CrossoverRegion * region);
+
+		bool isInRegion(VoronoiDiagram * diagram, int index, CrossoverRegion * region);
+
+		// Returns true if point with given index among the parent's points inside of the region goes to the other child
+		bool isExchanged(int insideIndex, int insideCount, int keptCount);
+
+		// Merges points kept from the parent and points exchanged from the other parent into the child
+		void mergeChild(VoronoiDiagram * parent, VoronoiDiagram * otherParent,
+			CrossoverRegion * region, bool isFirstParent, VoronoiDiagram * child);
 	protected:
 		/// Does crossover of given parents and stores the results into given children.
+		/**
+			Points of parents inside of a random rectangle are exchanged between the children.
+			If parents have different count of points inside of the rectangle, parent with
+			more of them keeps the surplus in its own child. Children are merged from
+			the sorted parents in linear time, so they stay sorted.
+		*/
 		void crossover(VoronoiDiagram * firstParent,
 			VoronoiDiagram * secondParent,
 			VoronoiDiagram * firstChild,
@@ -35,6 +67,17 @@ namespace lossycompressor {
 			float * bestFitness,
 			VoronoiDiagram ** best);
 
+		/// Continues with the population from the checkpoint if the computation is resumed, generates initial population otherwise.
+		/**
+			/param[in] algorithmName	Name of the algorithm stored in the checkpoint.
+			\return 0 if successfull, error code of readCheckpoint() otherwise.
+		*/
+		int startPopulation(const char * algorithmName, int populationSize,
+			vector<VoronoiDiagram*> * population,
+			vector<float> * populationFitness,
+			float * bestFitness,
+			VoronoiDiagram ** best);
+
 		/// Does selection on given population.
 		void selection(int selectionSize, 
 			vector<VoronoiDiagram*> * population,
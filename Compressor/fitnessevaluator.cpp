@@ -6,39 +6,91 @@ using namespace lossycompressor;
 
 FitnessEvaluator::FitnessEvaluator(
 	int sourceWidth, int sourceHeight,
-	int diagramPointsCount,
-	uint8_t * sourceImageData, int sourceDataRowWidthInBytes)
+	int maxDiagramPointsCount,
+	uint8_t * sourceImageData, int sourceDataRowWidthInBytes,
+	PixelFormat sourcePixelFormat)
 	: sourceWidth(sourceWidth),
 	sourceHeight(sourceHeight),
-	diagramPointsCount(diagramPointsCount),
+	maxDiagramPointsCount(maxDiagramPointsCount),
 	sourceImageData(sourceImageData),
+	sourcePixelFormat(sourcePixelFormat),
 	sourceDataRowWidthInBytes(sourceDataRowWidthInBytes) {}
 
 FitnessEvaluator::~FitnessEvaluator() {}
 
-double fitnessCalculationLengthsSum = 0;
+void FitnessEvaluator::setSourceImage(int sourceWidth, int sourceHeight,
+	int maxDiagramPointsCount,
+	uint8_t * sourceImageData, int sourceDataRowWidthInBytes,
+	PixelFormat sourcePixelFormat) {
 
-float FitnessEvaluator::calculateFitness(VoronoiDiagram * diagram) {
-	//LARGE_INTEGER startTime, endTime;
-	//Utils::recordTime(&startTime);
+	this->sourceWidth = sourceWidth;
+	this->sourceHeight = sourceHeight;
+	this->maxDiagramPointsCount = maxDiagramPointsCount;
+	this->sourceImageData = sourceImageData;
+	this->sourceDataRowWidthInBytes = sourceDataRowWidthInBytes;
+	this->sourcePixelFormat = sourcePixelFormat;
+	fitnessCache.clear();
+	fitnessCacheMap.clear();
+	fitnessEvaluationsCount = 0;
+	fitnessCacheHitsCount = 0;
+	fitnessCacheMissesCount = 0;
+	phaseTimes = PhaseTimes();
+}
 
-	float fitness = calculateFitnessInternal(diagram);
+float FitnessEvaluator::calculateFitness(VoronoiDiagram * diagram) {
+	// Cached diagrams are counted too, so computations producing only known diagrams reach their limits
 	++fitnessEvaluationsCount;
+	uint64_t hash = diagram->getHash();
+	auto cached = fitnessCacheMap.find(hash);
+	if (cached != fitnessCacheMap.end()) {
+		// Move the entry to the front of the cache as the most recently used
+		fitnessCache.splice(fitnessCache.begin(), fitnessCache, cached->second);
+		++fitnessCacheHitsCount;
+		lastMeanSquaredError = cached->second->meanSquaredError;
+		return cached->second->fitness;
+	}
+	++fitnessCacheMissesCount;
 
-	//Utils::recordTime(&endTime);
-	//double calculationTotalTime = Utils::calculateInterval(&startTime, &endTime);
+	float fitness = calculateFitnessInternal(diagram);
 
-	//fitnessCalculationLengthsSum += calculationTotalTime;
-	//std::printf("Calculating fitness took %.4f seconds, average time is %.4f\n",
-	//	calculationTotalTime, fitnessCalculationLengthsSum / fitnessEvaluationsCount);
+	CachedFitness cacheEntry;
+	cacheEntry.hash = hash;
+	cacheEntry.fitness = fitness;
+	cacheEntry.meanSquaredError = lastMeanSquaredError;
+	fitnessCache.push_front(cacheEntry);
+	fitnessCacheMap[hash] = fitnessCache.begin();
+	if (fitnessCache.size() > FITNESS_CACHE_CAPACITY) {
+		fitnessCacheMap.erase(fitnessCache.back().hash);
+		fitnessCache.pop_back();
+	}
 
 	return fitness;
 }
 
+float FitnessEvaluator::getLastMeanSquaredError() {
+	return lastMeanSquaredError;
+}
+
 int FitnessEvaluator::getFitnessEvaluationsCount() {
 	return fitnessEvaluationsCount;
 }
 
 void FitnessEvaluator::resetFitnessCalculationCount() {
 	fitnessEvaluationsCount = 0;
-}
\ No newline at end of file
+}
+
+void FitnessEvaluator::setFitnessEvaluationsCount(int fitnessEvaluationsCount) {
+	this->fitnessEvaluationsCount = fitnessEvaluationsCount;
+}
+
+int FitnessEvaluator::getFitnessCacheHitsCount() {
+	return fitnessCacheHitsCount;
+}
+
+int FitnessEvaluator::getFitnessCacheMissesCount() {
+	return fitnessCacheMissesCount;
+}
+
+FitnessEvaluator::PhaseTimes FitnessEvaluator::getPhaseTimes() {
+	return phaseTimes;
+}
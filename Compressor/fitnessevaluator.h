@@ -1,41 +1,126 @@
 #pragma once
 
 #include "voronoidiagram.h"
+#include "pixelformat.h"
+#include <list>
+#include <unordered_map>
+#include <utility>
 
 namespace lossycompressor {
 
 	/// Base class for fitness evaluator. Subclasses must provide concrete fitness calculation methods.
+	/**
+		Fitness values of recently evaluated diagrams are cached by the diagram hash,
+		so diagrams that were already evaluated are not evaluated again. Every call of
+		calculateFitness() is counted as a fitness evaluation, evaluations that were computed
+		are counted separately as cache misses.
+
+		Subclasses measure time spent in the phases of fitness calculation into phaseTimes.
+	*/
 	class FitnessEvaluator {
+	public:
+		/// Time spent in the phases of fitness calculation.
+		struct PhaseTimes {
+			double assignmentSecs = 0;		///< Search for the closest point of every pixel.
+			double accumulationSecs = 0;	///< Summing of color channels of pixels of every point.
+			double averagingSecs = 0;		///< Division of the sums into average colors of points.
+			double errorSecs = 0;			///< Summing of deviations of pixels from colors of their points.
+		};
+	private:
+		// Maximal count of fitness values held in the cache
+		const int FITNESS_CACHE_CAPACITY = 1024;
+
 		int fitnessEvaluationsCount = 0;
+
+		int fitnessCacheHitsCount = 0;
+		int fitnessCacheMissesCount = 0;
+
+		// Fitness and mean squared error of a cached diagram
+		struct CachedFitness {
+			uint64_t hash;
+			float fitness;
+			float meanSquaredError;
+		};
+
+		// Cached fitness values ordered from the most recently used, map points into this list
+		std::list<CachedFitness> fitnessCache;
+		std::unordered_map<uint64_t, std::list<CachedFitness>::iterator> fitnessCacheMap;
 	protected:
 		int sourceWidth;				///< Width of source image.
 		int sourceHeight;				///< Height of source image.
-		int diagramPointsCount;			///< Count of points in diagram.
+		int maxDiagramPointsCount;		///< Maximal count of points in evaluated diagrams.
 		uint8_t * sourceImageData;		///< Data of source image.
-		int sourceDataRowWidthInBytes;	///< Length of a row in source image data.
+		PixelFormat sourcePixelFormat;	///< Format of pixels in source image data.
+		int sourceDataRowWidthInBytes;	///< Distance from the start of a row to the start of the row below it in source image data, negative if rows are stored from bottom to top.
+
+		/// Mean squared error of color channels of the last diagram evaluated by calculateFitnessInternal().
+		float lastMeanSquaredError = 0;
+
+		/// Time spent in the phases of all calculations since the source image was set, subclasses add to it.
+		PhaseTimes phaseTimes;
 
 		/// Calculates fitness of given diagram.
 		/**
 			Subclasses must implement this method to provide their way of fitness ccalculation.
+			Implementations must also set lastMeanSquaredError.
 		*/
 		virtual float calculateFitnessInternal(VoronoiDiagram * diagram) = 0;
 
 		/// Return true if computation of fitness is accelerated by CUDA.
 		virtual bool isCuda() = 0;
+
+		/// Sets the evaluated source image and clears the cache, which holds fitness values of the previous image.
+		void setSourceImage(int sourceWidth, int sourceHeight,
+			int maxDiagramPointsCount,
+			uint8_t * sourceImageData, int sourceDataRowWidthInBytes,
+			PixelFormat sourcePixelFormat);
 	public:
 		/// Construct a new FitnessEvaluator.
+		/**
+			Evaluator can evaluate diagrams with any count of points up to maxDiagramPointsCount.
+			Fitness is the mean over pixels of the sum of absolute deviations of (b, g, r) channels,
+			gray level counts as all three channels.
+		*/
 		FitnessEvaluator(int sourceWidth, int sourceHeight,
-			int diagramPointsCount, 
-			uint8_t * sourceImageData, int sourceDataRowWidthInBytes);
+			int maxDiagramPointsCount, 
+			uint8_t * sourceImageData, int sourceDataRowWidthInBytes,
+			PixelFormat sourcePixelFormat);
 		virtual ~FitnessEvaluator();
 
 		/// Calculates fitness of given diagram.
 		float calculateFitness(VoronoiDiagram * diagram);
 
-		/// Returns count of fitness evaluations done by this evaluator.
+		/// Prepares the evaluator for another source image, so its buffers are reused.
+		/**
+			Parameters are the same as in the constructor.
+
+			\return True if buffers of the evaluator are large enough for the image and the count of points,
+				false otherwise and the evaluator is not changed then.
+		*/
+		virtual bool resetSourceImage(int sourceWidth, int sourceHeight,
+			int maxDiagramPointsCount,
+			uint8_t * sourceImageData, int sourceDataRowWidthInBytes,
+			PixelFormat sourcePixelFormat) = 0;
+
+		/// Returns mean squared error of color channels of the diagram passed to the last calculateFitness() call.
+		float getLastMeanSquaredError();
+
+		/// Returns count of fitness evaluations done by this evaluator, including those found in the cache.
 		int getFitnessEvaluationsCount();
 
 		/// Resets the fitness evaluations count.
 		void resetFitnessCalculationCount();
+
+		/// Sets the fitness evaluations count, used when a computation continues from a checkpoint.
+		void setFitnessEvaluationsCount(int fitnessEvaluationsCount);
+
+		/// Returns count of fitness calculations that were answered from the cache.
+		int getFitnessCacheHitsCount();
+
+		/// Returns count of fitness calculations that were not found in the cache.
+		int getFitnessCacheMissesCount();
+
+		/// Returns time spent in the phases of fitness calculation since the source image was set.
+		PhaseTimes getPhaseTimes();
 	};
 }
\ No newline at end of file
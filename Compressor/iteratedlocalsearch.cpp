@@ -0,0 +1,69 @@
+#include "iteratedlocalsearch.h"
+#include "compressorutils.h"
+#include "utils.h"
+
+using namespace std;
+using namespace lossycompressor;
+
+int IteratedLocalSearch::compressInternal(VoronoiDiagram * outputDiagram,
+	Color24bit * colors, int * pixelPointAssignment) {
+
+	int stagnationEvaluationsLimit = STAGNATION_EVALUATIONS_PER_POINT * args->diagramPointsCount;
+	int perturbedPointsCount = Utils::max(2, (int)(args->diagramPointsCount * PERTURBATION_RATE));
+
+	VoronoiDiagram * best = new VoronoiDiagram(args->diagramPointsCount);
+	float bestFitness = -1;
+
+	VoronoiDiagram * current = new VoronoiDiagram(args->diagramPointsCount);
+	float currentFitness = -1;
+
+	VoronoiDiagram * next = new VoronoiDiagram(args->diagramPointsCount);
+	float nextFitness = -1;
+
+	// Generate random diagram or take the initial one as our starting position
+	generateStartingDiagram(current);
+	currentFitness = calculateFitness(current);
+
+	CompressorUtils::copy(current, best);
+	bestFitness = currentFitness;
+
+	int evaluationsSinceImprovement = 0;
+	while (canContinueComputing()) {
+		if (evaluationsSinceImprovement > stagnationEvaluationsLimit) {
+			// Restart the hill-climbing from perturbed best solution
+			perturb(best, current, perturbedPointsCount);
+			currentFitness = calculateFitness(current);
+			evaluationsSinceImprovement = 0;
+		}
+		else {
+			tweak(current, next);
+			nextFitness = calculateFitness(next);
+
+			if (nextFitness < currentFitness) {
+				CompressorUtils::swap(&current, &next);
+				currentFitness = nextFitness;
+				evaluationsSinceImprovement = 0;
+			}
+			else {
+				++evaluationsSinceImprovement;
+			}
+		}
+
+		if (currentFitness < bestFitness) {
+			CompressorUtils::copy(current, best);
+			bestFitness = currentFitness;
+		}
+	}
+
+	onBestSolutionFound(bestFitness);
+
+	// Copy the coordinates of points from the result diagram we obtained to the output diagram
+	CompressorUtils::copy(best, outputDiagram);
+	cpuFitnessEvaluator->calculateColors(outputDiagram, colors, pixelPointAssignment);
+
+	delete best;
+	delete current;
+	delete next;
+
+	return 0;
+}
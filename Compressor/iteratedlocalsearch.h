@@ -0,0 +1,27 @@
+#pragma once
+
+#include "localsearch.h"
+
+namespace lossycompressor {
+	/// Uses hill-climbing restarted from perturbed best solution whenever the search stagnates.
+	/**
+		Counts fitness evaluations since the last improvement of current solution.
+		When this count exceeds the stagnation limit the best solution found so far
+		is perturbed by moving several of its points and hill-climbing continues
+		from the perturbed diagram. Best solution is kept across the restarts.
+	*/
+	class IteratedLocalSearch : public LocalSearch {
+		// Count of evaluations without improvement per diagram point after which the search is restarted
+		const int STAGNATION_EVALUATIONS_PER_POINT = 5;
+
+		// Percentage of diagram points that are moved by the perturbation
+		const float PERTURBATION_RATE = 0.05f;
+	protected:
+		virtual int compressInternal(VoronoiDiagram * outputDiagram,
+			Color24bit * colors,
+			int * pixelPointAssignment) override;
+	public:
+		IteratedLocalSearch(CompressorAlgorithm::Args* args)
+			: LocalSearch(args) {};
+	};
+}
@@ -10,39 +10,63 @@ void LocalSearch::tweak(VoronoiDiagram * source, VoronoiDiagram * destination) {
 	// TODO do this adaptive, also bit mor reasonable
 
 	float movementPerc = 0.3f;
+	candidateOperator = ConvergenceTrace::Operator::TWEAK;
 
-	random_device rd;
-	int pointToTweak = (int)(rd() * (((float)(args->diagramPointsCount - 1)) / rd.max()) + 0.5f);
+	mt19937 & generator = Utils::getRandomGenerator();
+	int pointToTweak = (int)(generator() * (((float)(args->diagramPointsCount - 1)) / generator.max()) + 0.5f);
 
-	float halfRdMax = rd.max() / 2;
-	float horizontalMovementMultiplier = ((float)args->sourceWidth) / halfRdMax;
-	float verticalMovementMultiplier = ((float)args->sourceHeight) / halfRdMax;
+	// Points in changed parts of the image are preferred, unchanged parts were optimized before
+	for (int i = 1; i < MAX_POINT_TO_TWEAK_TRIAL_COUNT && !isInChangedBlock(source, pointToTweak); ++i) {
+		pointToTweak = (int)(generator() * (((float)(args->diagramPointsCount - 1)) / generator.max()) + 0.5f);
+	}
 
-	int32_t xDelta = (int32_t)((rd() - halfRdMax) * horizontalMovementMultiplier * movementPerc);
-	int32_t yDelta = (int32_t)((rd() - halfRdMax) * verticalMovementMultiplier * movementPerc);
+	float halfGeneratorMax = generator.max() / 2;
+	float horizontalMovementMultiplier = ((float)args->sourceWidth) / halfGeneratorMax;
+	float verticalMovementMultiplier = ((float)args->sourceHeight) / halfGeneratorMax;
 
-	for (int i = 0; i < args->diagramPointsCount; ++i) {
-		destination->diagramPointsXCoordinates[i] = source->diagramPointsXCoordinates[i];
-		destination->diagramPointsYCoordinates[i] = source->diagramPointsYCoordinates[i];
-		if (i == pointToTweak) {
-			destination->diagramPointsXCoordinates[i] += xDelta;
-			destination->diagramPointsYCoordinates[i] += yDelta;
-		}
+	int32_t xDelta = (int32_t)((generator() - halfGeneratorMax) * horizontalMovementMultiplier * movementPerc);
+	int32_t yDelta = (int32_t)((generator() - halfGeneratorMax) * verticalMovementMultiplier * movementPerc);
+
+	CompressorUtils::copy(source, destination);
+	movePoint(destination, pointToTweak, xDelta, yDelta);
+}
+
+void LocalSearch::perturb(VoronoiDiagram * source, VoronoiDiagram * destination, int perturbedPointsCount) {
+	candidateOperator = ConvergenceTrace::Operator::PERTURBATION;
+	CompressorUtils::copy(source, destination);
+
+	for (int i = 0; i < perturbedPointsCount; ++i) {
+		int pointToMove = Utils::generateRandom(args->diagramPointsCount - 1);
+
+		// Move the point anywhere in the image
+		int32_t xDelta = Utils::generateRandom(args->sourceWidth - 1) - destination->x(pointToMove);
+		int32_t yDelta = Utils::generateRandom(args->sourceHeight - 1) - destination->y(pointToMove);
+		movePoint(destination, pointToMove, xDelta, yDelta);
 	}
+}
+
+void LocalSearch::movePoint(VoronoiDiagram * diagram, int pointIndex, int32_t xDelta, int32_t yDelta) {
+	int32_t x = diagram->x(pointIndex) + xDelta;
+	int32_t y = diagram->y(pointIndex) + yDelta;
+	x = x < 0 ? 0 : (x > args->sourceWidth - 1 ? args->sourceWidth - 1 : x);
+	y = y < 0 ? 0 : (y > args->sourceHeight - 1 ? args->sourceHeight - 1 : y);
+	xDelta = x - diagram->x(pointIndex);
+	yDelta = y - diagram->y(pointIndex);
+	diagram->setPoint(pointIndex, x, y);
 
 	// Maintain the sorted order of diagram points
-	int currentIndex = pointToTweak;
+	int currentIndex = pointIndex;
 	if (xDelta > 0 || (xDelta == 0 && yDelta > 0)) {
-		while (currentIndex < args->diagramPointsCount - 1 && CompressorUtils::compare(destination, currentIndex, currentIndex + 1) == 1) {
-			Utils::swap(destination->diagramPointsXCoordinates, currentIndex, currentIndex + 1);
-			Utils::swap(destination->diagramPointsYCoordinates, currentIndex, currentIndex + 1);
+		while (currentIndex < args->diagramPointsCount - 1 && CompressorUtils::compare(diagram, currentIndex, currentIndex + 1) == 1) {
+			Utils::swap(diagram->diagramPointsXCoordinates, currentIndex, currentIndex + 1);
+			Utils::swap(diagram->diagramPointsYCoordinates, currentIndex, currentIndex + 1);
 			++currentIndex;
 		}
 	}
 	else if (xDelta < 0 || (xDelta == 0 && yDelta < 0)) {
-		while (currentIndex > 0 && CompressorUtils::compare(destination, currentIndex - 1, currentIndex) == 1) {
-			Utils::swap(destination->diagramPointsXCoordinates, currentIndex, currentIndex - 1);
-			Utils::swap(destination->diagramPointsYCoordinates, currentIndex, currentIndex - 1);
+		while (currentIndex > 0 && CompressorUtils::compare(diagram, currentIndex - 1, currentIndex) == 1) {
+			Utils::swap(diagram->diagramPointsXCoordinates, currentIndex, currentIndex - 1);
+			Utils::swap(diagram->diagramPointsYCoordinates, currentIndex, currentIndex - 1);
 			--currentIndex;
 		}
 	}
@@ -51,27 +75,46 @@ void LocalSearch::tweak(VoronoiDiagram * source, VoronoiDiagram * destination) {
 int LocalSearch::compressInternal(VoronoiDiagram * outputDiagram,
 	Color24bit * colors, int * pixelPointAssignment) {
 
-	VoronoiDiagram * current = new VoronoiDiagram(args->diagramPointsCount);
+	vector<VoronoiDiagram*> checkpointDiagrams;
+	vector<float> checkpointDiagramsFitness;
+	bool isResumed;
+	int err = readCheckpoint("local_search", 1, &checkpointDiagrams, &checkpointDiagramsFitness, &isResumed);
+	if (err != 0) {
+		return err;
+	}
+
+	VoronoiDiagram * current;
 	float currentFitness = -1;
 
 	VoronoiDiagram * next = new VoronoiDiagram(args->diagramPointsCount);
 	float nextFitness = -1;
 
-	// Generate random diagram as our starting position
-	CompressorUtils::generateRandomDiagram(current, args->sourceWidth, args->sourceHeight);
-	currentFitness = calculateFitness(current);
-
-	// Try few random diagrams - it's possible to generate pretty good staring point just randomly
-	for (int i = 0; i < 15 && canContinueComputing(); ++i) {
-		CompressorUtils::generateRandomDiagram(next, args->sourceWidth, args->sourceHeight);
-		nextFitness = calculateFitness(next);
-		if (nextFitness < currentFitness) {
-			CompressorUtils::swap(&current, &next);
-			currentFitness = nextFitness;
+	if (isResumed) {
+		current = checkpointDiagrams[0];
+		currentFitness = checkpointDiagramsFitness[0];
+	}
+	else {
+		// Generate random diagram or take the initial one as our starting position
+		current = new VoronoiDiagram(args->diagramPointsCount);
+		generateStartingDiagram(current);
+		currentFitness = calculateFitness(current);
+
+		// Try few random diagrams - it's possible to generate pretty good staring point just randomly
+		for (int i = 0; i < 15 && args->initialDiagram == NULL && canContinueComputing(); ++i) {
+			CompressorUtils::generateRandomDiagram(next, args->sourceWidth, args->sourceHeight);
+			nextFitness = calculateFitness(next);
+			if (nextFitness < currentFitness) {
+				CompressorUtils::swap(&current, &next);
+				currentFitness = nextFitness;
+			}
 		}
 	}
 
 	while (canContinueComputing()) {
+		if (isCheckpointDue()) {
+			writeCheckpoint("local_search", vector<VoronoiDiagram*>(1, current), vector<float>(1, currentFitness));
+		}
+
 		tweak(current, next);
 		nextFitness = calculateFitness(next);
 
@@ -9,6 +9,22 @@ namespace lossycompressor {
 	protected:
 		/// Tweaks the source diagram and copies it into destination diagram.
 		void tweak(VoronoiDiagram * source, VoronoiDiagram * destination);
+
+		/// Moves given count of randomly chosen points of the source diagram and copies it into destination diagram.
+		/**
+			Unlike tweak() this is meant to do a bigger jump in the search space.
+
+			\param[in] source					Diagram that will be perturbed.
+			\param[out] destination				Diagram into which the perturbed diagram will be written.
+			\param[in] perturbedPointsCount		Count of points that will be moved.
+		*/
+		void perturb(VoronoiDiagram * source, VoronoiDiagram * destination, int perturbedPointsCount);
+
+		/// Moves point on given index by given deltas and puts it to its right place in the sorted diagram.
+		/**
+			Point is kept inside the image, so every diagram can be stored in the compressed file.
+		*/
+		void movePoint(VoronoiDiagram * diagram, int pointIndex, int32_t xDelta, int32_t yDelta);
 	public:
 		LocalSearch(CompressorAlgorithm::Args* args)
 			: CompressorAlgorithm(args) {};
@@ -18,4 +34,4 @@ namespace lossycompressor {
 			Color24bit * colors,
 			int * pixelPointAssignment) override;
 	};
-}
\ No newline at end of file
+}
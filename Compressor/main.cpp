@@ -1,6 +1,11 @@
 #include <cstdio>
+#include <cstring>
 #include <random>
 #include "compressor.h"
+#include "decompressor.h"
+#include "batchcompressor.h"
+#include "sequencecompressor.h"
+#include "compressionserver.h"
 #include "utils.h"
 
 using namespace std;
@@ -57,9 +62,180 @@ using namespace lossycompressor;
 //	doTestIteration(Compressor::ComputationType::LOCAL_SEARCH, NULL);
 //}
 
-int main(int argc, char* argv[]) {
+int decode(int argc, char* argv[]) {
+	if (argc < 4) {
+		printf("Usage: --decode compressed_file_path image_file_path [bmp|raw] [--size width height]\n");
+		printf("       [--window x y width height] [--samples samples_per_axis] [--bytes max_read_size_in_bytes]\n");
+		return 1;
+	}
+
+	Decompressor::Args decompressorArgs;
+	decompressorArgs.compressedPath = argv[2];
+	decompressorArgs.destinationImagePath = argv[3];
+	for (int i = 4; i < argc; ++i) {
+		if (strcmp(argv[i], "raw") == 0) {
+			decompressorArgs.outputFormat = Decompressor::OutputFormat::RAW;
+		}
+		else if (strcmp(argv[i], "bmp") == 0) {
+			decompressorArgs.outputFormat = Decompressor::OutputFormat::BMP;
+		}
+		else if (strcmp(argv[i], "--size") == 0 && i + 2 < argc) {
+			decompressorArgs.outputWidth = atoi(argv[++i]);
+			decompressorArgs.outputHeight = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--window") == 0 && i + 4 < argc) {
+			decompressorArgs.windowX = atoi(argv[++i]);
+			decompressorArgs.windowY = atoi(argv[++i]);
+			decompressorArgs.windowWidth = atoi(argv[++i]);
+			decompressorArgs.windowHeight = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+			decompressorArgs.samplesPerAxis = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--bytes") == 0 && i + 1 < argc) {
+			decompressorArgs.maxReadSizeBytes = atoi(argv[++i]);
+		}
+		else {
+			printf("Unknown decoding option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	Decompressor decompressor(&decompressorArgs);
+
+	LARGE_INTEGER startTime, endTime;
+	Utils::recordTime(&startTime);
+	int decompressionResult = decompressor.decompress();
+
+	Utils::recordTime(&endTime);
+	double calculationTotalTime = Utils::calculateInterval(&startTime, &endTime);
+	if (decompressionResult == 0) {
+		printf("Decompressing took %.4f seconds\n", calculationTotalTime);
+	}
+
+	return decompressionResult;
+}
+
+int batch(int argc, char* argv[]) {
 	if (argc < 4) {
+		printf("Usage: --batch manifest_or_directory_path summary_csv_path [--threads thread_count]\n");
+		return 1;
+	}
+
+	BatchCompressor::Args batchArgs;
+	batchArgs.manifestPath = argv[2];
+	batchArgs.summaryPath = argv[3];
+	batchArgs.computationLimit = Compressor::ComputationLimit::FITNESS_COUNT;
+	batchArgs.maxFitnessEvaluationCount = 40000;
+	batchArgs.useCuda = true;
+	for (int i = 4; i < argc; ++i) {
+		if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			batchArgs.threadCount = atoi(argv[++i]);
+		}
+		else {
+			printf("Unknown batch option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	BatchCompressor batchCompressor(&batchArgs);
+
+	LARGE_INTEGER startTime, endTime;
+	Utils::recordTime(&startTime);
+	int batchResult = batchCompressor.compress();
+
+	Utils::recordTime(&endTime);
+	double calculationTotalTime = Utils::calculateInterval(&startTime, &endTime);
+	if (batchResult == 0) {
+		printf("Batch compressing took %.4f seconds, %d jobs failed\n", calculationTotalTime, batchCompressor.getFailedJobsCount());
+	}
+
+	return batchResult;
+}
+
+int sequence(int argc, char* argv[]) {
+	if (argc < 4) {
+		printf("Usage: --sequence frame_list_or_directory_path summary_csv_path [--warm-share share] [--mask-block block_size]\n");
+		return 1;
+	}
+
+	SequenceCompressor::Args sequenceArgs;
+	sequenceArgs.framesPath = argv[2];
+	sequenceArgs.summaryPath = argv[3];
+	sequenceArgs.computationLimit = Compressor::ComputationLimit::FITNESS_COUNT;
+	sequenceArgs.maxFitnessEvaluationCount = 40000;
+	sequenceArgs.useCuda = true;
+	for (int i = 4; i < argc; ++i) {
+		if (strcmp(argv[i], "--warm-share") == 0 && i + 1 < argc) {
+			sequenceArgs.warmComputationShare = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--mask-block") == 0 && i + 1 < argc) {
+			sequenceArgs.changedBlockSize = atoi(argv[++i]);
+		}
+		else {
+			printf("Unknown sequence option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	SequenceCompressor sequenceCompressor(&sequenceArgs);
+
+	LARGE_INTEGER startTime, endTime;
+	Utils::recordTime(&startTime);
+	int sequenceResult = sequenceCompressor.compress();
+
+	Utils::recordTime(&endTime);
+	double calculationTotalTime = Utils::calculateInterval(&startTime, &endTime);
+	if (sequenceResult == 0) {
+		printf("Sequence compressing took %.4f seconds, %d frames failed\n", calculationTotalTime, sequenceCompressor.getFailedFramesCount());
+	}
+
+	return sequenceResult;
+}
+
+int serve(int argc, char* argv[]) {
+	CompressionServer::Args serverArgs;
+	serverArgs.useCuda = true;
+	for (int i = 2; i < argc; ++i) {
+		if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			serverArgs.threadCount = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--queue") == 0 && i + 1 < argc) {
+			serverArgs.maxQueuedJobsCount = atoi(argv[++i]);
+		}
+		else {
+			printf("Unknown server option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	CompressionServer server(&serverArgs);
+	return server.runOnStandardStreams();
+}
+
+int main(int argc, char* argv[]) {
+	if (argc > 1 && strcmp(argv[1], "--decode") == 0) {
+		return decode(argc, argv);
+	}
+	if (argc > 1 && strcmp(argv[1], "--batch") == 0) {
+		return batch(argc, argv);
+	}
+	if (argc > 1 && strcmp(argv[1], "--sequence") == 0) {
+		return sequence(argc, argv);
+	}
+	if (argc > 1 && strcmp(argv[1], "--serve") == 0) {
+		return serve(argc, argv);
+	}
+
+	if (argc < 5) {
 		printf("Usage: source_image_file_path compressed_file_path compressed_image_file_path max_size_in_bytes\n");
+		printf("       [--checkpoint checkpoint_path] [--checkpoint-interval secs] [--resume] [--seed-vor seed_compressed_file_path]\n");
+		printf("       [--trace trace_path] [--trace-format csv|binary] [--trace-decimation n] [--stats stats_json_path]\n");
+		printf("       --decode compressed_file_path image_file_path [bmp|raw] [--size width height]\n");
+		printf("                [--window x y width height] [--samples samples_per_axis] [--bytes max_read_size_in_bytes]\n");
+		printf("       --batch manifest_or_directory_path summary_csv_path [--threads thread_count]\n");
+		printf("       --sequence frame_list_or_directory_path summary_csv_path [--warm-share share] [--mask-block block_size]\n");
+		printf("       --serve [--threads thread_count] [--queue max_queued_jobs_count]\n");
 		return 1;
 	}
 
@@ -74,6 +250,46 @@ int main(int argc, char* argv[]) {
 	compressorArgs.maxFitnessEvaluationCount = 40000;
 	compressorArgs.useCuda = true;
 	compressorArgs.logImprovementToConsole = false;
+	for (int i = 5; i < argc; ++i) {
+		if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+			compressorArgs.checkpointPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--checkpoint-interval") == 0 && i + 1 < argc) {
+			compressorArgs.checkpointIntervalSecs = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--resume") == 0) {
+			compressorArgs.resumeFromCheckpoint = true;
+		}
+		else if (strcmp(argv[i], "--seed-vor") == 0 && i + 1 < argc) {
+			compressorArgs.seedCompressedPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			compressorArgs.traceFileName = argv[++i];
+		}
+		else if (strcmp(argv[i], "--trace-format") == 0 && i + 1 < argc) {
+			++i;
+			if (strcmp(argv[i], "csv") == 0) {
+				compressorArgs.traceFormat = ConvergenceTrace::Format::CSV;
+			}
+			else if (strcmp(argv[i], "binary") == 0) {
+				compressorArgs.traceFormat = ConvergenceTrace::Format::BINARY;
+			}
+			else {
+				printf("Unknown trace format %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--trace-decimation") == 0 && i + 1 < argc) {
+			compressorArgs.traceDecimation = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+			compressorArgs.statsFileName = argv[++i];
+		}
+		else {
+			printf("Unknown compression option %s\n", argv[i]);
+			return 1;
+		}
+	}
 
 	Compressor compressor(&compressorArgs);
 
@@ -0,0 +1,95 @@
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include "Windows.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace lossycompressor;
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+int MappedFile::open(const char * path) {
+	close();
+
+#ifdef _WIN32
+	fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE) {
+		fileHandle = NULL;
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+		close();
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+	mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	if (mappingHandle == NULL) {
+		close();
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+	data = (uint8_t *)MapViewOfFile(mappingHandle, FILE_MAP_COPY, 0, 0, 0);
+	if (data == NULL) {
+		close();
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+	size = (size_t)fileSize.QuadPart;
+#else
+	int fileDescriptor = ::open(path, O_RDONLY);
+	if (fileDescriptor < 0) {
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+	struct stat fileStatus;
+	if (fstat(fileDescriptor, &fileStatus) != 0 || fileStatus.st_size == 0) {
+		::close(fileDescriptor);
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+	// Mapping stays valid after the file is closed
+	void * mapping = mmap(NULL, (size_t)fileStatus.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileDescriptor, 0);
+	::close(fileDescriptor);
+	if (mapping == MAP_FAILED) {
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+	data = (uint8_t *)mapping;
+	size = (size_t)fileStatus.st_size;
+#endif
+	return 0;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+	if (data != NULL) {
+		UnmapViewOfFile(data);
+	}
+	if (mappingHandle != NULL) {
+		CloseHandle(mappingHandle);
+	}
+	if (fileHandle != NULL) {
+		CloseHandle(fileHandle);
+	}
+	mappingHandle = NULL;
+	fileHandle = NULL;
+#else
+	if (data != NULL) {
+		munmap(data, size);
+	}
+#endif
+	data = NULL;
+	size = 0;
+}
+
+uint8_t * MappedFile::getData() {
+	return data;
+}
+
+size_t MappedFile::getSize() {
+	return size;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace lossycompressor {
+
+	/// File mapped into memory for reading.
+	/**
+		Pages of the file are loaded by the operating system when they are first accessed,
+		so large files are read without copying them into another buffer. Mapping is private
+		copy-on-write, writing into the data does not change the file.
+		File is mapped by CreateFileMapping on Windows and by mmap elsewhere.
+	*/
+	class MappedFile {
+		uint8_t * data = NULL;
+		size_t size = 0;
+#ifdef _WIN32
+		void * fileHandle = NULL;
+		void * mappingHandle = NULL;
+#endif
+	public:
+		static const int ERROR_FILE_COULD_NOT_OPEN_FILE = 2;	///< Error code. File could not be open or mapped.
+
+		MappedFile() {};
+		~MappedFile();
+
+		/// Map the whole file, previously mapped file is unmapped.
+		/**
+			\return 0 if successfull, error code otherwise.
+		*/
+		int open(const char * path);
+
+		/// Unmap the file.
+		void close();
+
+		/// Returns mapped data of the file, NULL if no file is mapped.
+		uint8_t * getData();
+
+		/// Returns size of the mapped file in bytes.
+		size_t getSize();
+	};
+}
@@ -20,11 +20,19 @@ int MemeticAlgorithm::compressInternal(VoronoiDiagram * outputDiagram,
 	VoronoiDiagram * best = NULL;
 	float bestFitness;
 
-	generateInitialPopulation(POPULATION_SIZE,
+	int err = startPopulation("memetic", POPULATION_SIZE,
 		&population, &populationFitness,
 		&bestFitness, &best);
+	if (err != 0) {
+		delete diagramPool[0];
+		return err;
+	}
 
 	while (canContinueComputing()) {
+		if (isCheckpointDue()) {
+			writeCheckpoint("memetic", population, populationFitness);
+		}
+
 		selection(selectionSize, &population, &populationFitness, &diagramPool);
 		
 		// Improve selected individuals by local search
@@ -0,0 +1,38 @@
+#include "pixelformat.h"
+
+using namespace std;
+using namespace lossycompressor;
+
+int PixelFormatUtils::getBytesPerPixel(PixelFormat format) {
+	switch (format) {
+	case PixelFormat::GRAY8:
+		return Gray8Pixel::BYTES_PER_PIXEL;
+	case PixelFormat::BGR24:
+		return Bgr24Pixel::BYTES_PER_PIXEL;
+	default:
+		return Bgra32Pixel::BYTES_PER_PIXEL;
+	}
+}
+
+int PixelFormatUtils::getChannelsCount(PixelFormat format) {
+	return format == PixelFormat::GRAY8 ? Gray8Pixel::CHANNELS_COUNT : Bgr24Pixel::CHANNELS_COUNT;
+}
+
+Color24bit PixelFormatUtils::readColor(PixelFormat format, const uint8_t * pixel) {
+	Color24bit color;
+	if (format == PixelFormat::GRAY8) {
+		color.b = pixel[0];
+		color.g = pixel[0];
+		color.r = pixel[0];
+	}
+	else {
+		color.b = pixel[0];
+		color.g = pixel[1];
+		color.r = pixel[2];
+	}
+	return color;
+}
+
+float PixelFormatUtils::getWeight(PixelFormat format, const uint8_t * pixel) {
+	return format == PixelFormat::BGRA32_ALPHA_WEIGHTED ? Bgra32AlphaWeightedPixel::weight(pixel) : 1;
+}
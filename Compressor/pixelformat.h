@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include "color.h"
+
+// Pixel formats are used both in host code and in CUDA kernels
+#ifdef __CUDACC__
+#define PIXEL_FORMAT_FUNCTION __host__ __device__ inline
+#else
+#define PIXEL_FORMAT_FUNCTION inline
+#endif
+
+namespace lossycompressor {
+
+	/// Format of pixels in source image data.
+	enum PixelFormat {
+		GRAY8,					///< 1 byte per pixel, gray level.
+		BGR24,					///< 3 bytes (b, g, r) per pixel.
+		BGRA32,					///< 4 bytes (b, g, r, a) per pixel, alpha is ignored.
+		BGRA32_ALPHA_WEIGHTED	///< 4 bytes (b, g, r, a) per pixel, colors and deviations of pixels are weighted by their alpha.
+	};
+
+	/*
+	Pixel formats passed as template parameters, so inner loops of fitness evaluators
+	are compiled for every format. Every format has:
+		BYTES_PER_PIXEL - count of bytes of a pixel in image data,
+		CHANNELS_COUNT - count of color channels of a pixel,
+		CHANNEL_COPIES - count of (b, g, r) channels represented by one channel, so that
+			fitness of gray image is the same as fitness of the same image with 3 channels,
+		channel() - value of a channel of a pixel,
+		colorChannel() and setColorChannel() - value of a channel of a point color,
+		weight() - weight of a pixel in colors and fitness.
+	*/
+
+	struct Gray8Pixel {
+		static const int BYTES_PER_PIXEL = 1;
+		static const int CHANNELS_COUNT = 1;
+		static const int CHANNEL_COPIES = 3;
+
+		PIXEL_FORMAT_FUNCTION static int channel(const uint8_t * pixel, int channelIndex) {
+			return pixel[0];
+		}
+
+		PIXEL_FORMAT_FUNCTION static int colorChannel(const Color24bit & color, int channelIndex) {
+			return color.b;
+		}
+
+		PIXEL_FORMAT_FUNCTION static void setColorChannel(Color24bit * color, int channelIndex, uint8_t value) {
+			color->b = value;
+			color->g = value;
+			color->r = value;
+		}
+
+		PIXEL_FORMAT_FUNCTION static float weight(const uint8_t * pixel) {
+			return 1;
+		}
+	};
+
+	struct Bgr24Pixel {
+		static const int BYTES_PER_PIXEL = 3;
+		static const int CHANNELS_COUNT = 3;
+		static const int CHANNEL_COPIES = 1;
+
+		PIXEL_FORMAT_FUNCTION static int channel(const uint8_t * pixel, int channelIndex) {
+			return pixel[channelIndex];
+		}
+
+		PIXEL_FORMAT_FUNCTION static int colorChannel(const Color24bit & color, int channelIndex) {
+			return channelIndex == 0 ? color.b : (channelIndex == 1 ? color.g : color.r);
+		}
+
+		PIXEL_FORMAT_FUNCTION static void setColorChannel(Color24bit * color, int channelIndex, uint8_t value) {
+			if (channelIndex == 0) {
+				color->b = value;
+			}
+			else if (channelIndex == 1) {
+				color->g = value;
+			}
+			else {
+				color->r = value;
+			}
+		}
+
+		PIXEL_FORMAT_FUNCTION static float weight(const uint8_t * pixel) {
+			return 1;
+		}
+	};
+
+	struct Bgra32Pixel : public Bgr24Pixel {
+		static const int BYTES_PER_PIXEL = 4;
+	};
+
+	struct Bgra32AlphaWeightedPixel : public Bgra32Pixel {
+		PIXEL_FORMAT_FUNCTION static float weight(const uint8_t * pixel) {
+			return pixel[3] / 255.0f;
+		}
+	};
+
+	/// Contains methods for pixel formats chosen at runtime.
+	/**
+		These are meant for code that goes through the image once, fitness evaluators
+		use the pixel format structures as template parameters instead.
+	*/
+	class PixelFormatUtils {
+	public:
+		/// Returns count of bytes of a pixel in image data.
+		static int getBytesPerPixel(PixelFormat format);
+
+		/// Returns count of color channels of a pixel, 1 for gray pixels and 3 otherwise.
+		static int getChannelsCount(PixelFormat format);
+
+		/// Returns color of the pixel, gray level is copied into all channels.
+		static Color24bit readColor(PixelFormat format, const uint8_t * pixel);
+
+		/// Returns weight of the pixel in colors and fitness between 0 and 1.
+		static float getWeight(PixelFormat format, const uint8_t * pixel);
+	};
+}
@@ -0,0 +1,321 @@
+#include "rasterizer.h"
+#include "utils.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+
+using namespace std;
+using namespace lossycompressor;
+
+Rasterizer::Rasterizer(VoronoiDiagram * diagram, int32_t width, int32_t height)
+	: diagram(diagram), width(width), height(height) {
+
+	int diagramPointsCount = diagram->diagramPointsCount;
+	int32_t minX = diagram->x(0), maxX = diagram->x(0);
+	int32_t minY = diagram->y(0), maxY = diagram->y(0);
+	for (int i = 1; i < diagramPointsCount; ++i) {
+		minX = min(minX, diagram->x(i));
+		maxX = max(maxX, diagram->x(i));
+		minY = min(minY, diagram->y(i));
+		maxY = max(maxY, diagram->y(i));
+	}
+	int32_t boxWidth = maxX - minX + 1;
+	int32_t boxHeight = maxY - minY + 1;
+	bucketSize = Utils::max(1, (int)sqrt((double)boxWidth * boxHeight * POINTS_PER_BUCKET / diagramPointsCount));
+	gridX = minX;
+	gridY = minY;
+	gridWidth = (boxWidth + bucketSize - 1) / bucketSize;
+	gridHeight = (boxHeight + bucketSize - 1) / bucketSize;
+
+	// Count points in buckets first, then place them in order of their indices
+	bucketStarts.assign(gridWidth * gridHeight + 1, 0);
+	vector<int> pointBuckets(diagramPointsCount);
+	for (int i = 0; i < diagramPointsCount; ++i) {
+		int32_t bucketX = (diagram->x(i) - gridX) / bucketSize;
+		int32_t bucketY = (diagram->y(i) - gridY) / bucketSize;
+		pointBuckets[i] = bucketY * gridWidth + bucketX;
+		++bucketStarts[pointBuckets[i] + 1];
+	}
+	for (int i = 0; i < gridWidth * gridHeight; ++i) {
+		bucketStarts[i + 1] += bucketStarts[i];
+	}
+	bucketPoints.resize(diagramPointsCount);
+	vector<int> bucketEnds(bucketStarts.begin(), bucketStarts.end() - 1);
+	for (int i = 0; i < diagramPointsCount; ++i) {
+		bucketPoints[bucketEnds[pointBuckets[i]]++] = i;
+	}
+}
+
+int32_t Rasterizer::calculateBucketX(double x) {
+	int32_t bucketX = (int32_t)floor((x - gridX) / bucketSize);
+	return bucketX < 0 ? 0 : (bucketX >= gridWidth ? gridWidth - 1 : bucketX);
+}
+
+int32_t Rasterizer::calculateBucketY(double y) {
+	int32_t bucketY = (int32_t)floor((y - gridY) / bucketSize);
+	return bucketY < 0 ? 0 : (bucketY >= gridHeight ? gridHeight - 1 : bucketY);
+}
+
+int Rasterizer::findClosestPoint(double x, double y, int excludedPointIndex) {
+	int32_t pixelBucketX = calculateBucketX(x);
+	int32_t pixelBucketY = calculateBucketY(y);
+	int closestPointIndex = -1;
+	double closestSquareDistance = 0;
+	// Coordinates are read directly, this is the innermost loop of decoding
+	int32_t * pointsXCoordinates = diagram->diagramPointsXCoordinates;
+	int32_t * pointsYCoordinates = diagram->diagramPointsYCoordinates;
+
+	for (int32_t ring = 0; ; ++ring) {
+		for (int32_t bucketY = pixelBucketY - ring; bucketY <= pixelBucketY + ring; ++bucketY) {
+			if (bucketY < 0 || bucketY >= gridHeight) {
+				continue;
+			}
+			// Inner rows of the ring contain only its left and right bucket
+			bool isRingEdgeRow = bucketY == pixelBucketY - ring || bucketY == pixelBucketY + ring;
+			int32_t bucketXStep = isRingEdgeRow || ring == 0 ? 1 : 2 * ring;
+			for (int32_t bucketX = pixelBucketX - ring; bucketX <= pixelBucketX + ring; bucketX += bucketXStep) {
+				if (bucketX < 0 || bucketX >= gridWidth) {
+					continue;
+				}
+				int bucket = bucketY * gridWidth + bucketX;
+				for (int i = bucketStarts[bucket]; i < bucketStarts[bucket + 1]; ++i) {
+					int pointIndex = bucketPoints[i];
+					if (pointIndex == excludedPointIndex) {
+						continue;
+					}
+					double xDistance = pointsXCoordinates[pointIndex] - x;
+					double yDistance = pointsYCoordinates[pointIndex] - y;
+					double squareDistance = xDistance * xDistance + yDistance * yDistance;
+					if (closestPointIndex < 0 || squareDistance < closestSquareDistance
+						|| (squareDistance == closestSquareDistance && pointIndex < closestPointIndex)) {
+						closestPointIndex = pointIndex;
+						closestSquareDistance = squareDistance;
+					}
+				}
+			}
+		}
+
+		// Points outside of the searched square of buckets are at least this far,
+		// sides of the square at the edge of the grid have no more points behind them
+		double outsideDistance = HUGE_VAL;
+		if (pixelBucketX - ring > 0) {
+			outsideDistance = min(outsideDistance, x - (gridX + (double)(pixelBucketX - ring) * bucketSize - 1));
+		}
+		if (pixelBucketX + ring < gridWidth - 1) {
+			outsideDistance = min(outsideDistance, gridX + (double)(pixelBucketX + ring + 1) * bucketSize - x);
+		}
+		if (pixelBucketY - ring > 0) {
+			outsideDistance = min(outsideDistance, y - (gridY + (double)(pixelBucketY - ring) * bucketSize - 1));
+		}
+		if (pixelBucketY + ring < gridHeight - 1) {
+			outsideDistance = min(outsideDistance, gridY + (double)(pixelBucketY + ring + 1) * bucketSize - y);
+		}
+		if (outsideDistance == HUGE_VAL
+			|| (closestPointIndex >= 0 && closestSquareDistance < outsideDistance * outsideDistance)) {
+			break;
+		}
+	}
+	return closestPointIndex;
+}
+
+void Rasterizer::collectCandidates(double left, double top, double right, double bottom, vector<int> * candidates) {
+	int32_t * pointsXCoordinates = diagram->diagramPointsXCoordinates;
+	int32_t * pointsYCoordinates = diagram->diagramPointsYCoordinates;
+
+	// Closest point of any position in the rectangle is not further from it than the point
+	// closest to the rectangle center, so it is not further from the rectangle than that point's
+	// distance to the furthest rectangle corner
+	int centerPointIndex = findClosestPoint((left + right) / 2, (top + bottom) / 2);
+	double centerPointX = pointsXCoordinates[centerPointIndex];
+	double centerPointY = pointsYCoordinates[centerPointIndex];
+	double furthestXDistance = max(fabs(centerPointX - left), fabs(centerPointX - right));
+	double furthestYDistance = max(fabs(centerPointY - top), fabs(centerPointY - bottom));
+	double maxSquareDistance = furthestXDistance * furthestXDistance + furthestYDistance * furthestYDistance;
+
+	int32_t leftBucketX = calculateBucketX(left);
+	int32_t rightBucketX = calculateBucketX(right);
+	int32_t topBucketY = calculateBucketY(top);
+	int32_t bottomBucketY = calculateBucketY(bottom);
+
+	candidates->clear();
+	for (int32_t ring = 0; ; ++ring) {
+		for (int32_t bucketY = topBucketY - ring; bucketY <= bottomBucketY + ring; ++bucketY) {
+			if (bucketY < 0 || bucketY >= gridHeight) {
+				continue;
+			}
+			bool isRingEdgeRow = bucketY == topBucketY - ring || bucketY == bottomBucketY + ring;
+			int32_t bucketXStep = isRingEdgeRow || ring == 0 ? 1 : rightBucketX - leftBucketX + 2 * ring;
+			for (int32_t bucketX = leftBucketX - ring; bucketX <= rightBucketX + ring; bucketX += bucketXStep) {
+				if (bucketX < 0 || bucketX >= gridWidth) {
+					continue;
+				}
+				int bucket = bucketY * gridWidth + bucketX;
+				for (int i = bucketStarts[bucket]; i < bucketStarts[bucket + 1]; ++i) {
+					int pointIndex = bucketPoints[i];
+					double x = pointsXCoordinates[pointIndex];
+					double y = pointsYCoordinates[pointIndex];
+					double xDistance = x < left ? left - x : (x > right ? x - right : 0);
+					double yDistance = y < top ? top - y : (y > bottom ? y - bottom : 0);
+					if (xDistance * xDistance + yDistance * yDistance <= maxSquareDistance) {
+						candidates->push_back(pointIndex);
+					}
+				}
+			}
+		}
+
+		double outsideDistance = HUGE_VAL;
+		if (leftBucketX - ring > 0) {
+			outsideDistance = min(outsideDistance, left - (gridX + (double)(leftBucketX - ring) * bucketSize - 1));
+		}
+		if (rightBucketX + ring < gridWidth - 1) {
+			outsideDistance = min(outsideDistance, gridX + (double)(rightBucketX + ring + 1) * bucketSize - right);
+		}
+		if (topBucketY - ring > 0) {
+			outsideDistance = min(outsideDistance, top - (gridY + (double)(topBucketY - ring) * bucketSize - 1));
+		}
+		if (bottomBucketY + ring < gridHeight - 1) {
+			outsideDistance = min(outsideDistance, gridY + (double)(bottomBucketY + ring + 1) * bucketSize - bottom);
+		}
+		if (outsideDistance == HUGE_VAL || outsideDistance * outsideDistance > maxSquareDistance) {
+			break;
+		}
+	}
+
+	// With candidates ordered by index the first of equally distant points is kept
+	sort(candidates->begin(), candidates->end());
+}
+
+int Rasterizer::findClosestCandidate(double x, double y,
+	double * candidatesXCoordinates, double * candidatesYCoordinates, int candidatesCount) {
+
+	int closestCandidate = 0;
+	double closestSquareDistance = HUGE_VAL;
+	for (int k = 0; k < candidatesCount; ++k) {
+		double xDistance = candidatesXCoordinates[k] - x;
+		double yDistance = candidatesYCoordinates[k] - y;
+		double squareDistance = xDistance * xDistance + yDistance * yDistance;
+		if (squareDistance < closestSquareDistance) {
+			closestCandidate = k;
+			closestSquareDistance = squareDistance;
+		}
+	}
+	return closestCandidate;
+}
+
+void Rasterizer::rasterizeBlockRows(View * view, int32_t startBlockRow, int32_t endBlockRow) {
+	int samplesPerAxis = view->samplesPerAxis;
+	int samplesCount = samplesPerAxis * samplesPerAxis;
+	vector<int> candidates;
+	vector<double> candidatesXCoordinates;
+	vector<double> candidatesYCoordinates;
+
+	// Samples of output pixel u are at windowX + (u + (k + 0.5) / samplesPerAxis) * scaleX - 0.5,
+	// source pixel centers are at integer coordinates
+	vector<double> sampleOffsetsX(samplesPerAxis);
+	vector<double> sampleOffsetsY(samplesPerAxis);
+	for (int k = 0; k < samplesPerAxis; ++k) {
+		sampleOffsetsX[k] = (k + 0.5) / samplesPerAxis * view->scaleX + view->windowX - 0.5;
+		sampleOffsetsY[k] = (k + 0.5) / samplesPerAxis * view->scaleY + view->windowY - 0.5;
+	}
+
+	for (int32_t blockY = startBlockRow; blockY < endBlockRow; ++blockY) {
+		for (int32_t blockX = 0; blockX < view->blocksPerRow; ++blockX) {
+			int32_t left = blockX * view->blockSize;
+			int32_t top = blockY * view->blockSize;
+			int32_t right = min(left + view->blockSize, view->outputWidth) - 1;
+			int32_t bottom = min(top + view->blockSize, view->outputHeight) - 1;
+
+			collectCandidates(left * view->scaleX + sampleOffsetsX[0],
+				top * view->scaleY + sampleOffsetsY[0],
+				right * view->scaleX + sampleOffsetsX[samplesPerAxis - 1],
+				bottom * view->scaleY + sampleOffsetsY[samplesPerAxis - 1],
+				&candidates);
+			int candidatesCount = (int)candidates.size();
+			candidatesXCoordinates.resize(candidatesCount);
+			candidatesYCoordinates.resize(candidatesCount);
+			for (int k = 0; k < candidatesCount; ++k) {
+				candidatesXCoordinates[k] = diagram->diagramPointsXCoordinates[candidates[k]];
+				candidatesYCoordinates[k] = diagram->diagramPointsYCoordinates[candidates[k]];
+			}
+
+			for (int32_t i = top; i <= bottom; ++i) {
+				uint8_t * row = view->imageData + (int64_t)i * view->rowWidthInBytes;
+				for (int32_t j = left; j <= right; ++j) {
+					if (samplesCount == 1) {
+						int closestCandidate = findClosestCandidate(
+							j * view->scaleX + sampleOffsetsX[0], i * view->scaleY + sampleOffsetsY[0],
+							candidatesXCoordinates.data(), candidatesYCoordinates.data(), candidatesCount);
+						Color24bit color = view->colors[candidates[closestCandidate]];
+						row[j * 3] = color.b;
+						row[j * 3 + 1] = color.g;
+						row[j * 3 + 2] = color.r;
+						continue;
+					}
+
+					int bSum = 0, gSum = 0, rSum = 0;
+					for (int sampleY = 0; sampleY < samplesPerAxis; ++sampleY) {
+						for (int sampleX = 0; sampleX < samplesPerAxis; ++sampleX) {
+							int closestCandidate = findClosestCandidate(
+								j * view->scaleX + sampleOffsetsX[sampleX], i * view->scaleY + sampleOffsetsY[sampleY],
+								candidatesXCoordinates.data(), candidatesYCoordinates.data(), candidatesCount);
+							Color24bit color = view->colors[candidates[closestCandidate]];
+							bSum += color.b;
+							gSum += color.g;
+							rSum += color.r;
+						}
+					}
+					row[j * 3] = (uint8_t)((bSum + samplesCount / 2) / samplesCount);
+					row[j * 3 + 1] = (uint8_t)((gSum + samplesCount / 2) / samplesCount);
+					row[j * 3 + 2] = (uint8_t)((rSum + samplesCount / 2) / samplesCount);
+				}
+			}
+		}
+	}
+}
+
+void Rasterizer::rasterize(Color24bit * colors, uint8_t * imageData, int rowWidthInBytes, int threadCount) {
+	rasterize(colors, width, height, 0, 0, width, height, 1, imageData, rowWidthInBytes, threadCount);
+}
+
+void Rasterizer::rasterize(Color24bit * colors, int32_t outputWidth, int32_t outputHeight,
+	double windowX, double windowY, double windowWidth, double windowHeight,
+	int samplesPerAxis, uint8_t * imageData, int rowWidthInBytes, int threadCount) {
+
+	View view;
+	view.colors = colors;
+	view.outputWidth = outputWidth;
+	view.outputHeight = outputHeight;
+	view.windowX = windowX;
+	view.windowY = windowY;
+	view.scaleX = windowWidth / outputWidth;
+	view.scaleY = windowHeight / outputHeight;
+	view.samplesPerAxis = Utils::max(1, samplesPerAxis);
+	view.imageData = imageData;
+	view.rowWidthInBytes = rowWidthInBytes;
+
+	// Blocks cover about one bucket of the source image. When downscaling, such blocks would have
+	// only few pixels to share the cost of collecting candidates, so they can cover up to two buckets
+	double bucketSizeInOutput = bucketSize / max(view.scaleX, view.scaleY);
+	view.blockSize = Utils::max(1, (int)max(bucketSizeInOutput, min((double)MIN_BLOCK_SIZE, 2 * bucketSizeInOutput)));
+	view.blocksPerRow = (outputWidth + view.blockSize - 1) / view.blockSize;
+	view.blocksPerColumn = (outputHeight + view.blockSize - 1) / view.blockSize;
+
+	if (threadCount <= 0) {
+		threadCount = Utils::max(1, (int)thread::hardware_concurrency());
+	}
+	threadCount = threadCount > view.blocksPerColumn ? view.blocksPerColumn : threadCount;
+
+	// Every thread draws a band of consecutive rows of blocks
+	vector<thread> threads;
+	for (int i = 1; i < threadCount; ++i) {
+		int32_t startBlockRow = (int32_t)((int64_t)view.blocksPerColumn * i / threadCount);
+		int32_t endBlockRow = (int32_t)((int64_t)view.blocksPerColumn * (i + 1) / threadCount);
+		threads.push_back(thread(&Rasterizer::rasterizeBlockRows, this, &view, startBlockRow, endBlockRow));
+	}
+	rasterizeBlockRows(&view, 0, (int32_t)((int64_t)view.blocksPerColumn / threadCount));
+
+	for (int i = 0; i < threads.size(); ++i) {
+		threads[i].join();
+	}
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "voronoidiagram.h"
+#include "color.h"
+
+namespace lossycompressor {
+
+	/// Draws voronoi diagram into image pixels.
+	/**
+		Points of the diagram are put into a uniform grid of buckets covering their bounding box,
+		so a diagram with points of only a part of the image is drawn as fast as the whole diagram.
+		Closest point to a pixel is searched in rings of buckets around the pixel until no closer point can exist.
+		When more points have the same distance the one with lowest index is taken.
+
+		Image is drawn by blocks of pixels. Points that can be closest to any pixel
+		of a block are collected once and every pixel only compares these.
+		Image is split into bands of blocks drawn in parallel threads.
+
+		Diagram can be drawn in any size and any window of the source image can be drawn.
+		Centers of output pixels are mapped into the source image, so the work depends
+		only on the count of output pixels and the count of diagram points.
+	*/
+	class Rasterizer {
+		// Average count of points in one bucket of the grid
+		const float POINTS_PER_BUCKET = 0.25f;
+		// Size of a block of output pixels sharing the closest point candidates that is considered big enough
+		const int MIN_BLOCK_SIZE = 8;
+
+		// Drawn window of the source image and the output image
+		struct View {
+			Color24bit * colors;
+			int32_t outputWidth;
+			int32_t outputHeight;
+			double windowX;
+			double windowY;
+			double scaleX;	// Source pixels per output pixel
+			double scaleY;
+			int samplesPerAxis;
+			int32_t blockSize;
+			int32_t blocksPerRow;
+			int32_t blocksPerColumn;
+			uint8_t * imageData;
+			int rowWidthInBytes;
+		};
+
+		VoronoiDiagram * diagram;
+		int32_t width;
+		int32_t height;
+
+		int32_t bucketSize;
+		int32_t gridX;		// Coordinates of the top left corner of the grid
+		int32_t gridY;
+		int32_t gridWidth;
+		int32_t gridHeight;
+		// Points of bucket i are bucketPoints[bucketStarts[i]] to bucketPoints[bucketStarts[i + 1] - 1]
+		std::vector<int> bucketStarts;
+		std::vector<int> bucketPoints;
+
+		int32_t calculateBucketX(double x);
+		int32_t calculateBucketY(double y);
+
+		// Returns index of the first of the closest candidates, candidates are ordered by point index
+		static int findClosestCandidate(double x, double y,
+			double * candidatesXCoordinates, double * candidatesYCoordinates, int candidatesCount);
+
+		void rasterizeBlockRows(View * view, int32_t startBlockRow, int32_t endBlockRow);
+	public:
+		/// Construct a rasterizer of the diagram in image of given size.
+		/**
+			Diagram must not be changed or deleted while the rasterizer is used.
+		*/
+		Rasterizer(VoronoiDiagram * diagram, int32_t width, int32_t height);
+
+		/// Returns index of diagram point closest to given position.
+		/**
+			\param[in] excludedPointIndex	Index of a point that is skipped, so the second closest point can be found. No point is skipped if negative.
+		*/
+		int findClosestPoint(double x, double y, int excludedPointIndex = -1);
+
+		/// Collect indices of points that can be the closest point of any position in the rectangle.
+		/**
+			Some points that are never the closest can be collected too.
+
+			\param[out] candidates		Collected point indices in ascending order.
+		*/
+		void collectCandidates(double left, double top, double right, double bottom, std::vector<int> * candidates);
+
+		/// Fill every pixel with the color of its closest diagram point.
+		/**
+			\param[in] colors			Colors of diagram points.
+			\param[out] imageData		Pixel data stored by rows from top to bottom, 3 bytes (b, g, r) per pixel.
+			\param[in] rowWidthInBytes	Width of a row in image data in bytes.
+			\param[in] threadCount		Count of threads used, count of hardware threads if 0.
+		*/
+		void rasterize(Color24bit * colors, uint8_t * imageData, int rowWidthInBytes, int threadCount = 0);
+
+		/// Draw a window of the source image scaled into the output image.
+		/**
+			Every output pixel gets the mean color of samplesPerAxis * samplesPerAxis samples
+			spread evenly over its area, 1 sample gives the color of the closest point to its center.
+
+			\param[in] colors			Colors of diagram points.
+			\param[in] outputWidth		Width of the output image.
+			\param[in] outputHeight		Height of the output image.
+			\param[in] windowX			X coordinate of the left edge of the drawn window in source pixels.
+			\param[in] windowY			Y coordinate of the top edge of the drawn window in source pixels.
+			\param[in] windowWidth		Width of the drawn window in source pixels.
+			\param[in] windowHeight		Height of the drawn window in source pixels.
+			\param[in] samplesPerAxis	Count of samples of every output pixel in each axis.
+			\param[out] imageData		Pixel data stored by rows from top to bottom, 3 bytes (b, g, r) per pixel.
+			\param[in] rowWidthInBytes	Width of a row in image data in bytes.
+			\param[in] threadCount		Count of threads used, count of hardware threads if 0.
+		*/
+		void rasterize(Color24bit * colors, int32_t outputWidth, int32_t outputHeight,
+			double windowX, double windowY, double windowWidth, double windowHeight,
+			int samplesPerAxis, uint8_t * imageData, int rowWidthInBytes, int threadCount = 0);
+	};
+}
@@ -0,0 +1,266 @@
+#include "sequencecompressor.h"
+#include "compressorutils.h"
+#include "utils.h"
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+using namespace lossycompressor;
+
+SequenceCompressor::~SequenceCompressor() {
+	delete previousDiagram;
+}
+
+int SequenceCompressor::compress() {
+	frames.clear();
+	delete previousDiagram;
+	previousDiagram = NULL;
+
+	int err = Utils::isDirectory(args->framesPath) ? readDirectory() : readFrameList();
+	if (err != 0) {
+		return err;
+	}
+
+	// Files of the current and the previous frame are mapped alternately
+	MappedFile frameFiles[2];
+	BmpFile::ImageLayout layouts[2];
+	bool hasPreviousLayout = false;
+
+	Compressor::ReusedFitnessEvaluators reusedFitnessEvaluators;
+	for (int i = 0; i < frames.size(); ++i) {
+		Frame * frame = &frames[i];
+		MappedFile * frameFile = &frameFiles[i % 2];
+		BmpFile::ImageLayout * layout = &layouts[i % 2];
+
+		frame->err = frameFile->open(frame->sourceImagePath.c_str());
+		if (frame->err == 0) {
+			frame->err = BmpFile::parse(frameFile->getData(), frameFile->getSize(), layout);
+		}
+		if (frame->err != 0) {
+			printf("Frame %s could not be read, error code %d\n", frame->sourceImagePath.c_str(), frame->err);
+			frameFile->close();
+			hasPreviousLayout = false;
+			continue;
+		}
+
+		compressFrame(frame, layout, hasPreviousLayout ? &layouts[(i + 1) % 2] : NULL, &reusedFitnessEvaluators);
+		frameFiles[(i + 1) % 2].close();
+		// Previous diagram is not replaced by a failed frame, so its pixels must not be compared with the next frame
+		hasPreviousLayout = frame->err == 0;
+	}
+	reusedFitnessEvaluators.release();
+
+	return args->summaryPath != NULL ? writeSummary() : 0;
+}
+
+int SequenceCompressor::readFrameList() {
+	FILE * file;
+	errno_t err = fopen_s(&file, args->framesPath, "r");
+	if (err != 0 || file == NULL) {
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+
+	char lineBuffer[MAX_LINE_LENGTH];
+	int lineNumber = 0;
+	while (fgets(lineBuffer, sizeof(lineBuffer), file) != NULL) {
+		++lineNumber;
+		string line(lineBuffer);
+		// Longer line would be split into several bogus frames
+		if (line.empty() || (line.back() != '\n' && !feof(file))) {
+			printf("Line %d of the frame list is longer than %d characters\n", lineNumber, MAX_LINE_LENGTH - 1);
+			fclose(file);
+			return ERROR_INVALID_FRAME_LIST;
+		}
+		line.erase(line.find_last_not_of(" \t\r\n") + 1);
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+		Frame frame;
+		frame.sourceImagePath = line;
+		frame.destinationCompressedPath = line + ".vor";
+		frame.destinationImagePath = line + ".vor.bmp";
+		frames.push_back(frame);
+	}
+
+	fclose(file);
+	return 0;
+}
+
+int SequenceCompressor::readDirectory() {
+	string directoryPath = args->framesPath;
+	if (!directoryPath.empty() && directoryPath.back() != '/' && directoryPath.back() != '\\') {
+		directoryPath += '/';
+	}
+
+	vector<string> fileNames;
+	if (!Utils::listFiles(directoryPath, ".bmp", &fileNames)) {
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+
+	// Reconstructed images of earlier runs are not frames
+	for (int i = 0; i < fileNames.size(); ++i) {
+		if (fileNames[i].size() > 8 && fileNames[i].compare(fileNames[i].size() - 8, 8, ".vor.bmp") == 0) {
+			continue;
+		}
+		Frame frame;
+		frame.sourceImagePath = directoryPath + fileNames[i];
+		frame.destinationCompressedPath = frame.sourceImagePath + ".vor";
+		frame.destinationImagePath = frame.sourceImagePath + ".vor.bmp";
+		frames.push_back(frame);
+	}
+	return 0;
+}
+
+void SequenceCompressor::compressFrame(Frame * frame, BmpFile::ImageLayout * layout, BmpFile::ImageLayout * previousLayout,
+	Compressor::ReusedFitnessEvaluators * reusedFitnessEvaluators) {
+
+	Compressor::Args compressorArgs;
+	compressorArgs.sourceImagePath = frame->sourceImagePath.c_str();
+	compressorArgs.destinationCompressedPath = frame->destinationCompressedPath.c_str();
+	compressorArgs.destinationImagePath = frame->destinationImagePath.c_str();
+	compressorArgs.maxCompressedSizeBytes = args->maxCompressedSizeBytes;
+	compressorArgs.computationType = args->computationType;
+	compressorArgs.computationLimit = args->computationLimit;
+	compressorArgs.maxComputationTimeSecs = args->maxComputationTimeSecs;
+	compressorArgs.maxFitnessEvaluationCount = args->maxFitnessEvaluationCount;
+	compressorArgs.useCuda = args->useCuda;
+	compressorArgs.logImprovementToConsole = false;
+	compressorArgs.reusedFitnessEvaluators = reusedFitnessEvaluators;
+
+	vector<uint8_t> changedBlocks;
+	if (previousDiagram != NULL) {
+		compressorArgs.seedDiagram = previousDiagram;
+		compressorArgs.seedDiagramWidth = previousWidth;
+		compressorArgs.seedDiagramHeight = previousHeight;
+		compressorArgs.maxComputationTimeSecs = args->maxComputationTimeSecs * args->warmComputationShare;
+		compressorArgs.maxFitnessEvaluationCount = Utils::max(1, (int)(args->maxFitnessEvaluationCount * args->warmComputationShare));
+
+		// Mask is only meaningful if the seed diagram comes from the previous frame of the same kind
+		if (args->changedBlockSize > 0 && previousLayout != NULL && previousWidth == layout->width && previousHeight == layout->height
+			&& previousLayout->width == layout->width && previousLayout->height == layout->height
+			&& previousLayout->bytesPerPixel == layout->bytesPerPixel) {
+			int changedBlocksCount = findChangedBlocks(layout, previousLayout, &changedBlocks);
+			frame->changedBlocksPercent = 100.0 * changedBlocksCount / changedBlocks.size();
+			compressorArgs.changedBlocks = changedBlocks.data();
+			compressorArgs.changedBlockSize = args->changedBlockSize;
+		}
+	}
+
+	LARGE_INTEGER startTime, endTime;
+	Utils::recordTime(&startTime);
+	Compressor compressor(&compressorArgs);
+	frame->err = compressor.compress();
+	Utils::recordTime(&endTime);
+
+	frame->computationTimeSecs = Utils::calculateInterval(&startTime, &endTime);
+	frame->fitnessEvaluationsCount = compressor.getFitnessEvaluationsCount();
+	frame->fitness = compressor.getFitness();
+	printf("Compressing frame %s finished with code %d in %.4f seconds\n",
+		frame->sourceImagePath.c_str(), frame->err, frame->computationTimeSecs);
+	if (frame->err != 0) {
+		return;
+	}
+
+	// Next frame starts from this one
+	VoronoiDiagram * diagram = compressor.getDiagram();
+	if (previousDiagram != NULL && previousWidth == layout->width && previousHeight == layout->height) {
+		frame->keptPointsCount = countKeptPoints(diagram);
+	}
+	delete previousDiagram;
+	previousDiagram = new VoronoiDiagram(diagram->diagramPointsCount);
+	CompressorUtils::copy(diagram, previousDiagram);
+	previousWidth = layout->width;
+	previousHeight = layout->height;
+}
+
+int SequenceCompressor::findChangedBlocks(BmpFile::ImageLayout * layout, BmpFile::ImageLayout * previousLayout,
+	vector<uint8_t> * changedBlocks) {
+
+	int32_t blockSize = args->changedBlockSize;
+	int32_t blocksWidth = (layout->width + blockSize - 1) / blockSize;
+	int32_t blocksHeight = (layout->height + blockSize - 1) / blockSize;
+	vector<uint8_t> changedPixelBlocks((size_t)blocksWidth * blocksHeight, 0);
+
+	int rowBytesCount = layout->width * layout->bytesPerPixel;
+	for (int32_t y = 0; y < layout->height; ++y) {
+		const uint8_t * row = layout->topRowData + (int64_t)y * layout->rowStrideInBytes;
+		const uint8_t * previousRow = previousLayout->topRowData + (int64_t)y * previousLayout->rowStrideInBytes;
+		uint8_t * blocksRow = &changedPixelBlocks[(size_t)(y / blockSize) * blocksWidth];
+		for (int i = 0; i < rowBytesCount; ++i) {
+			if (abs(row[i] - previousRow[i]) >= args->changeThreshold) {
+				blocksRow[i / layout->bytesPerPixel / blockSize] = 1;
+			}
+		}
+	}
+
+	// Points in neighbouring blocks may own the changed pixels
+	changedBlocks->assign(changedPixelBlocks.size(), 0);
+	int changedBlocksCount = 0;
+	for (int32_t y = 0; y < blocksHeight; ++y) {
+		for (int32_t x = 0; x < blocksWidth; ++x) {
+			bool isChanged = false;
+			for (int32_t neighbourY = Utils::max(0, y - 1); neighbourY <= y + 1 && neighbourY < blocksHeight && !isChanged; ++neighbourY) {
+				for (int32_t neighbourX = Utils::max(0, x - 1); neighbourX <= x + 1 && neighbourX < blocksWidth && !isChanged; ++neighbourX) {
+					isChanged = changedPixelBlocks[(size_t)neighbourY * blocksWidth + neighbourX] != 0;
+				}
+			}
+			if (isChanged) {
+				(*changedBlocks)[(size_t)y * blocksWidth + x] = 1;
+				++changedBlocksCount;
+			}
+		}
+	}
+	return changedBlocksCount;
+}
+
+int SequenceCompressor::countKeptPoints(VoronoiDiagram * diagram) {
+	int keptPointsCount = 0;
+	int index = 0, previousIndex = 0;
+	while (index < diagram->diagramPointsCount && previousIndex < previousDiagram->diagramPointsCount) {
+		int comparison = CompressorUtils::compare(diagram->x(index), diagram->y(index),
+			previousDiagram->x(previousIndex), previousDiagram->y(previousIndex));
+		if (comparison == 0) {
+			++keptPointsCount;
+			++index;
+			++previousIndex;
+		}
+		else if (comparison < 0) {
+			++index;
+		}
+		else {
+			++previousIndex;
+		}
+	}
+	return keptPointsCount;
+}
+
+int SequenceCompressor::writeSummary() {
+	FILE * file;
+	errno_t err = fopen_s(&file, args->summaryPath, "w");
+	if (err != 0 || file == NULL) {
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+
+	fprintf(file, "frame_path,compressed_path,error,time_secs,fitness_evaluations,fitness,changed_blocks_percent,kept_points\n");
+	for (int i = 0; i < frames.size(); ++i) {
+		Frame & frame = frames[i];
+		fprintf(file, "%s,%s,%d,%.4f,%d,%f,%.1f,%d\n",
+			Utils::quoteCsvField(frame.sourceImagePath).c_str(), Utils::quoteCsvField(frame.destinationCompressedPath).c_str(), frame.err,
+			frame.computationTimeSecs, frame.fitnessEvaluationsCount, frame.fitness,
+			frame.changedBlocksPercent, frame.keptPointsCount);
+	}
+
+	fflush(file);
+	fclose(file);
+	return 0;
+}
+
+int SequenceCompressor::getFailedFramesCount() {
+	int failedFramesCount = 0;
+	for (int i = 0; i < frames.size(); ++i) {
+		if (frames[i].err != 0) {
+			++failedFramesCount;
+		}
+	}
+	return failedFramesCount;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "compressor.h"
+#include "mappedfile.h"
+
+namespace lossycompressor {
+
+	/// Class compressing a sequence of frames, every frame starts from the diagram of the previous one.
+	/**
+		Frames are read from a list file with one BMP image path per line, or they are all BMP images
+		in a directory ordered by name. Empty lines and lines starting with # are skipped. Every frame
+		is compressed into files with added extensions .vor and .vor.bmp next to it.
+
+		The first frame is compressed from a random diagram with the full computation limits. Every next
+		frame starts from the diagram of the previous compressed frame with warmComputationShare of the limits.
+		Pixels of a frame are compared with the previous frame of the same size and format, blocks of pixels
+		that changed and their neighbours form a mask and computations move points inside of them when possible.
+		Every frame is stored in a complete compressed file, so it can be decoded without the previous ones,
+		count of points kept from the previous frame is reported in the summary, where paths are quoted.
+	*/
+	class SequenceCompressor {
+	public:
+		/// Instance of this class is passed as a parameter into SequenceCompressor.
+		struct Args {
+			const char * framesPath;													///< Path of the list file of frames or of the directory with frames.
+			const char * summaryPath = NULL;											///< Path of the CSV file into which summary of frames is written, not written if NULL.
+			uint32_t maxCompressedSizeBytes = 4000;										///< Maximum size of compressed files of frames.
+			Compressor::ComputationType computationType = Compressor::ComputationType::LOCAL_SEARCH;	///< Type of computation of frames.
+			Compressor::ComputationLimit computationLimit = Compressor::ComputationLimit::TIME;		///< Type of computation limit of frames.
+			double maxComputationTimeSecs = 60;											///< Time limit of the first frame.
+			int maxFitnessEvaluationCount = 40000;										///< Limit on fitness evaluation of the first frame.
+			double warmComputationShare = 0.2;											///< Share of the limits given to frames starting from the previous frame.
+			int32_t changedBlockSize = 16;												///< Size of blocks of the mask of changed pixels, mask is not used if 0.
+			int changeThreshold = 8;													///< Difference of a color channel at which the pixel is considered changed.
+			bool useCuda = false;														///< True if CUDA acceleration should be used, false otherwise.
+		};
+	private:
+		static const int MAX_LINE_LENGTH = 4096;
+
+		// Compression of one frame
+		struct Frame {
+			std::string sourceImagePath;
+			std::string destinationCompressedPath;
+			std::string destinationImagePath;
+
+			// Results
+			int err = 0;
+			double computationTimeSecs = 0;
+			int fitnessEvaluationsCount = 0;
+			float fitness = -1;
+			double changedBlocksPercent = 100;
+			int keptPointsCount = 0;
+		};
+
+		SequenceCompressor::Args * args;
+		std::vector<Frame> frames;
+
+		// Diagram of the last successfully compressed frame and size of its image
+		VoronoiDiagram * previousDiagram = NULL;
+		int32_t previousWidth = 0;
+		int32_t previousHeight = 0;
+
+		int readFrameList();
+		int readDirectory();
+		void compressFrame(Frame * frame, BmpFile::ImageLayout * layout, BmpFile::ImageLayout * previousLayout,
+			Compressor::ReusedFitnessEvaluators * reusedFitnessEvaluators);
+		// Marks blocks with a changed pixel and their neighbours, returns count of marked blocks
+		int findChangedBlocks(BmpFile::ImageLayout * layout, BmpFile::ImageLayout * previousLayout, std::vector<uint8_t> * changedBlocks);
+		// Returns count of points of the diagram that are also in the previous diagram, both are sorted
+		int countKeptPoints(VoronoiDiagram * diagram);
+		int writeSummary();
+	public:
+		static const int ERROR_FILE_COULD_NOT_OPEN_FILE = 2;		///< Sequence compression error code. List file, directory or summary file could not be open.
+		static const int ERROR_INVALID_FRAME_LIST = 23;				///< Sequence compression error code. List file contains a line longer than 4095 characters.
+
+		/// Construct a new SequenceCompressor with given arguments.
+		SequenceCompressor(SequenceCompressor::Args * args) : args(args) {};
+		~SequenceCompressor();
+
+		/// Compress all frames in their order and write the summary.
+		/**
+			Failed frame does not stop the others, the next frame starts from the last compressed one.
+
+			\return	0 if all frames were processed and the summary was written, error code of this class otherwise.
+		*/
+		int compress();
+
+		/// Returns count of frames whose compression failed.
+		int getFailedFramesCount();
+	};
+}
@@ -1,6 +1,13 @@
 #include "utils.h"
 #include <cmath>
 #include <random>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#ifndef _WIN32
+#include <dirent.h>
+#endif
 
 using namespace std;
 using namespace lossycompressor;
@@ -34,9 +41,94 @@ double Utils::calculateInterval(LARGE_INTEGER * start, LARGE_INTEGER * end) {
 	return static_cast<double>(end->QuadPart - start->QuadPart) / frequency.QuadPart;
 }
 
+mt19937 & Utils::getRandomGenerator() {
+	thread_local mt19937 generator(random_device{}());
+	return generator;
+}
+
 int Utils::generateRandom(int max) {
-	random_device rd;
-	double m = max / (double)(rd.max() - rd.min());
-	unsigned int randVal = rd();
-	return (int) ((randVal - rd.min()) * m);
+	mt19937 & generator = getRandomGenerator();
+	double m = max / (double)(generator.max() - generator.min());
+	unsigned int randVal = generator();
+	return (int) ((randVal - generator.min()) * m);
+}
+
+float Utils::generateRandomFloat() {
+	mt19937 & generator = getRandomGenerator();
+	return (float)((generator() - generator.min()) / ((double)(generator.max() - generator.min()) + 1));
+}
+
+bool Utils::seekFile(FILE * file, int64_t offset, int origin) {
+#ifdef _WIN32
+	return _fseeki64(file, offset, origin) == 0;
+#else
+	return fseeko(file, (off_t)offset, origin) == 0;
+#endif
+}
+
+int64_t Utils::tellFile(FILE * file) {
+#ifdef _WIN32
+	return _ftelli64(file);
+#else
+	return (int64_t)ftello(file);
+#endif
+}
+
+string Utils::quoteCsvField(const string & field) {
+	string quotedField = "\"";
+	for (size_t i = 0; i < field.size(); ++i) {
+		if (field[i] == '"') {
+			quotedField += '"';
+		}
+		quotedField += field[i];
+	}
+	quotedField += '"';
+	return quotedField;
+}
+
+bool Utils::isDirectory(const char * path) {
+#ifdef _WIN32
+	DWORD attributes = GetFileAttributesA(path);
+	return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+	DIR * directory = opendir(path);
+	if (directory == NULL) {
+		return false;
+	}
+	closedir(directory);
+	return true;
+#endif
+}
+
+bool Utils::listFiles(const string & directoryPath, const char * extension, vector<string> * fileNames) {
+	size_t extensionLength = strlen(extension);
+#ifdef _WIN32
+	WIN32_FIND_DATAA findData;
+	HANDLE findHandle = FindFirstFileA((directoryPath + "*" + extension).c_str(), &findData);
+	if (findHandle == INVALID_HANDLE_VALUE) {
+		return GetLastError() == ERROR_FILE_NOT_FOUND;
+	}
+	do {
+		if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
+			fileNames->push_back(findData.cFileName);
+		}
+	} while (FindNextFileA(findHandle, &findData));
+	FindClose(findHandle);
+#else
+	DIR * directory = opendir(directoryPath.c_str());
+	if (directory == NULL) {
+		return false;
+	}
+	for (dirent * entry = readdir(directory); entry != NULL; entry = readdir(directory)) {
+		string fileName = entry->d_name;
+		string fileExtension = fileName.size() > extensionLength ? fileName.substr(fileName.size() - extensionLength) : "";
+		transform(fileExtension.begin(), fileExtension.end(), fileExtension.begin(), ::tolower);
+		if (fileExtension == extension) {
+			fileNames->push_back(fileName);
+		}
+	}
+	closedir(directory);
+#endif
+	sort(fileNames->begin(), fileNames->end());
+	return true;
 }
@@ -1,6 +1,10 @@
 #pragma once
 
 #include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
 
 #define NOMINMAX
 #include "Windows.h"
@@ -35,7 +39,43 @@ namespace lossycompressor {
 		/// Calculate time interval between two events.
 		static double calculateInterval(LARGE_INTEGER * start, LARGE_INTEGER * end);
 		
+		/// Returns random number generator of the calling thread.
+		/**
+			Generator is seeded from the random device when the thread uses it for the first time,
+			its state can be saved and restored to repeat the same sequence of random numbers.
+		*/
+		static std::mt19937 & getRandomGenerator();
+
 		/// Generate random integer between  and max inclusive.
 		static int generateRandom(int max);
+
+		/// Generate random float between 0 inclusive and 1 exclusive.
+		static float generateRandomFloat();
+
+		/// Sets position in the file with 64 bit offset, so files larger than 2 GiB can be read on every platform.
+		/**
+			\param[in] file		Open file.
+			\param[in] offset	Offset relative to the origin.
+			\param[in] origin	SEEK_SET, SEEK_CUR or SEEK_END.
+			\return false if the position could not be set.
+		*/
+		static bool seekFile(FILE * file, int64_t offset, int origin);
+
+		/// Returns position in the file with 64 bit offset, -1 if it could not be read.
+		static int64_t tellFile(FILE * file);
+
+		/// Returns the field enclosed in double quotes with its double quotes doubled, so it can be written into CSV file.
+		static std::string quoteCsvField(const std::string & field);
+
+		/// Returns true if the path is an existing directory.
+		static bool isDirectory(const char * path);
+
+		/// Lists names of files in the directory whose extension matches given one without regard to case, sorted by name.
+		/**
+			\param[in] directoryPath	Path of the directory ending with a path separator.
+			\param[in] extension		Extension including the dot.
+			\return false if the directory could not be open.
+		*/
+		static bool listFiles(const std::string & directoryPath, const char * extension, std::vector<std::string> * fileNames);
 	};
 }
\ No newline at end of file
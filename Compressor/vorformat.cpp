@@ -0,0 +1,973 @@
+#include "vorformat.h"
+#include "bitstream.h"
+#include "rasterizer.h"
+#include "utils.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+using namespace lossycompressor;
+
+int VorFormat::encode(int32_t width, int32_t height, VoronoiDiagram * diagram, Color24bit * colors,
+	vector<uint8_t> * output, int32_t indexTileSize, int channelsCount) {
+
+	return encode(width, height, diagram, colors, NULL, 0, NULL, output, indexTileSize, channelsCount);
+}
+
+int VorFormat::encode(int32_t width, int32_t height, VoronoiDiagram * diagram,
+	Color24bit * palette, int paletteSize, int * colorPaletteIndices,
+	vector<uint8_t> * output, int32_t indexTileSize, int channelsCount) {
+
+	return encode(width, height, diagram, NULL, palette, paletteSize, colorPaletteIndices, output, indexTileSize, channelsCount);
+}
+
+int VorFormat::encode(int32_t width, int32_t height, VoronoiDiagram * diagram,
+	Color24bit * colors, Color24bit * palette, int paletteSize, int * colorPaletteIndices,
+	vector<uint8_t> * output, int32_t indexTileSize, int channelsCount) {
+
+	int err = checkDiagram(width, height, diagram);
+	if (err != 0) {
+		return err;
+	}
+	for (int i = 1; i < diagram->diagramPointsCount; ++i) {
+		if (diagram->x(i) < diagram->x(i - 1)) {
+			return ERROR_POINTS_NOT_SORTED;
+		}
+	}
+	if (palette != NULL && (paletteSize < 1 || paletteSize > (channelsCount == 1 ? MAX_GRAY_PALETTE_SIZE : MAX_PALETTE_SIZE))) {
+		return ERROR_INVALID_PALETTE;
+	}
+	if (indexTileSize < 0) {
+		return ERROR_INVALID_INDEX_TILE_SIZE;
+	}
+
+	int diagramPointsCount = diagram->diagramPointsCount;
+	int bestOrder = findBestExpGolombOrder(diagram, NULL, NULL);
+	int colorDepth = palette == NULL ? calculateColorBitCount(channelsCount) : BitWriter::calculateBitCount(paletteSize);
+
+	// Points are written first, tile index needs their positions in the point stream
+	BitWriter pointsWriter;
+	vector<uint64_t> pointOffsets(indexTileSize > 0 ? diagramPointsCount : 0);
+	int yBitCount = BitWriter::calculateBitCount(height);
+	int32_t previousX = 0;
+	for (int i = 0; i < diagramPointsCount; ++i) {
+		if (indexTileSize > 0) {
+			pointOffsets[i] = pointsWriter.getBitCount();
+		}
+		pointsWriter.writeExpGolomb(diagram->x(i) - previousX, bestOrder);
+		pointsWriter.writeBits(diagram->y(i), yBitCount);
+		if (palette == NULL) {
+			writeColor(&pointsWriter, colors[i], channelsCount);
+		}
+		else {
+			pointsWriter.writeBits(colorPaletteIndices[i], colorDepth);
+		}
+		previousX = diagram->x(i);
+	}
+	if (indexTileSize > 0 && pointsWriter.getBitCount() > UINT32_MAX) {
+		return ERROR_INVALID_INDEX_TILE_SIZE;
+	}
+
+	BitWriter writer;
+	writer.writeBits('V', 8);
+	writer.writeBits('O', 8);
+	writer.writeBits('R', 8);
+	writer.writeBits(FORMAT_VERSION, 8);
+	writer.writeVarint(width);
+	writer.writeVarint(height);
+	writer.writeVarint(diagramPointsCount);
+	writer.writeBits(colorDepth, 8);
+	writer.writeBits(bestOrder, 8);
+	writer.writeBits((indexTileSize > 0 ? FLAG_TILE_INDEX : 0) | (channelsCount == 1 ? FLAG_GRAY : 0), 8);
+	if (palette != NULL) {
+		writer.writeVarint(paletteSize);
+		for (int i = 0; i < paletteSize; ++i) {
+			writeColor(&writer, palette[i], channelsCount);
+		}
+	}
+
+	if (indexTileSize > 0) {
+		int offsetBitCount = BitWriter::calculateBitCount((uint32_t)pointsWriter.getBitCount());
+		writer.writeVarint(indexTileSize);
+		writer.writeBits(offsetBitCount, 8);
+
+		// Tile covers positions up to half a pixel around its pixels, so windows
+		// drawn in any scale get all points that can be closest to their samples
+		Rasterizer rasterizer(diagram, width, height);
+		vector<int> candidates;
+		int indexBitCount = BitWriter::calculateBitCount(diagramPointsCount);
+		int xBitCount = BitWriter::calculateBitCount(width);
+		for (int32_t tileY = 0; tileY < height; tileY += indexTileSize) {
+			for (int32_t tileX = 0; tileX < width; tileX += indexTileSize) {
+				int32_t tileRight = (int32_t)min((int64_t)tileX + indexTileSize, (int64_t)width);
+				int32_t tileBottom = (int32_t)min((int64_t)tileY + indexTileSize, (int64_t)height);
+				rasterizer.collectCandidates(tileX - 0.5, tileY - 0.5, tileRight - 0.5, tileBottom - 0.5, &candidates);
+				int firstPointIndex = candidates.front();
+				writer.writeBits(firstPointIndex, indexBitCount);
+				writer.writeBits(candidates.back(), indexBitCount);
+				writer.writeBits((uint32_t)pointOffsets[firstPointIndex], offsetBitCount);
+				writer.writeBits(firstPointIndex > 0 ? diagram->x(firstPointIndex - 1) : 0, xBitCount);
+			}
+		}
+	}
+
+	// Header is padded to whole bytes by the writer
+	*output = writer.getData();
+	output->insert(output->end(), pointsWriter.getData().begin(), pointsWriter.getData().end());
+	return 0;
+}
+
+int VorFormat::encodeProgressive(int32_t width, int32_t height, VoronoiDiagram * diagram, Color24bit * colors,
+	uint8_t * sourceImageData, int rowWidthInBytes, PixelFormat sourcePixelFormat, vector<uint8_t> * output) {
+
+	int err = checkDiagram(width, height, diagram);
+	if (err != 0) {
+		return err;
+	}
+
+	int diagramPointsCount = diagram->diagramPointsCount;
+	vector<int> pointOrder;
+	orderPointsByImportance(width, height, diagram, colors, sourceImageData, rowWidthInBytes, sourcePixelFormat, &pointOrder);
+	vector<int> levelSizes;
+	calculateLevelSizes(diagramPointsCount, PROGRESSIVE_FIRST_LEVEL_POINTS_COUNT, &levelSizes);
+
+	// Points of every level are sorted by coordinates, equal points by their order in the diagram
+	int levelStart = 0;
+	for (size_t level = 0; level < levelSizes.size(); ++level) {
+		sort(pointOrder.begin() + levelStart, pointOrder.begin() + levelStart + levelSizes[level],
+			[diagram](int first, int second) {
+			if (diagram->x(first) != diagram->x(second)) {
+				return diagram->x(first) < diagram->x(second);
+			}
+			if (diagram->y(first) != diagram->y(second)) {
+				return diagram->y(first) < diagram->y(second);
+			}
+			return first < second;
+		});
+		levelStart += levelSizes[level];
+	}
+	int bestOrder = findBestExpGolombOrder(diagram, pointOrder.data(), &levelSizes);
+	int channelsCount = PixelFormatUtils::getChannelsCount(sourcePixelFormat);
+
+	BitWriter writer;
+	writer.writeBits('V', 8);
+	writer.writeBits('O', 8);
+	writer.writeBits('R', 8);
+	writer.writeBits(FORMAT_VERSION, 8);
+	writer.writeVarint(width);
+	writer.writeVarint(height);
+	writer.writeVarint(diagramPointsCount);
+	writer.writeBits(calculateColorBitCount(channelsCount), 8);
+	writer.writeBits(bestOrder, 8);
+	writer.writeBits(FLAG_PROGRESSIVE | (channelsCount == 1 ? FLAG_GRAY : 0), 8);
+	writer.writeVarint(PROGRESSIVE_FIRST_LEVEL_POINTS_COUNT);
+
+	int yBitCount = BitWriter::calculateBitCount(height);
+	vector<Color24bit> prefixColors(diagramPointsCount);
+	levelStart = 0;
+	for (size_t level = 0; level < levelSizes.size(); ++level) {
+		int levelEnd = levelStart + levelSizes[level];
+		int32_t previousX = 0;
+		for (int i = levelStart; i < levelEnd; ++i) {
+			writer.writeExpGolomb(diagram->x(pointOrder[i]) - previousX, bestOrder);
+			writer.writeBits(diagram->y(pointOrder[i]), yBitCount);
+			previousX = diagram->x(pointOrder[i]);
+		}
+
+		// Last level has the colors of the whole diagram
+		if (levelEnd < diagramPointsCount) {
+			fitPrefixColors(width, height, diagram, colors, sourceImageData, rowWidthInBytes, sourcePixelFormat,
+				&pointOrder, levelEnd, prefixColors.data());
+		}
+		else {
+			for (int i = 0; i < levelEnd; ++i) {
+				prefixColors[i] = colors[pointOrder[i]];
+			}
+		}
+		for (int i = 0; i < levelEnd; ++i) {
+			writeColor(&writer, prefixColors[i], channelsCount);
+		}
+		levelStart = levelEnd;
+	}
+
+	*output = writer.getData();
+	return 0;
+}
+
+int VorFormat::checkDiagram(int32_t width, int32_t height, VoronoiDiagram * diagram) {
+	for (int i = 0; i < diagram->diagramPointsCount; ++i) {
+		if (diagram->x(i) < 0 || diagram->x(i) >= width
+			|| diagram->y(i) < 0 || diagram->y(i) >= height) {
+			return ERROR_POINT_OUTSIDE_IMAGE;
+		}
+	}
+	return 0;
+}
+
+int VorFormat::calculateColorBitCount(int channelsCount) {
+	return channelsCount == 1 ? CHANNEL_DEPTH : 3 * CHANNEL_DEPTH;
+}
+
+void VorFormat::writeColor(BitWriter * writer, const Color24bit & color, int channelsCount) {
+	// Gray level is taken from the blue channel
+	writer->writeBits(color.b, CHANNEL_DEPTH);
+	if (channelsCount != 1) {
+		writer->writeBits(color.g, CHANNEL_DEPTH);
+		writer->writeBits(color.r, CHANNEL_DEPTH);
+	}
+}
+
+Color24bit VorFormat::readColor(BitReader * reader, int channelsCount) {
+	Color24bit color;
+	color.b = (uint8_t)reader->readBits(CHANNEL_DEPTH);
+	if (channelsCount == 1) {
+		color.g = color.b;
+		color.r = color.b;
+	}
+	else {
+		color.g = (uint8_t)reader->readBits(CHANNEL_DEPTH);
+		color.r = (uint8_t)reader->readBits(CHANNEL_DEPTH);
+	}
+	return color;
+}
+
+int VorFormat::findBestExpGolombOrder(VoronoiDiagram * diagram, int * pointOrder, vector<int> * levelSizes) {
+	// Find the order of Exp-Golomb code giving the shortest horizontal distances,
+	// distances start from 0 in every level, whole diagram is one level if there are no levels
+	int diagramPointsCount = diagram->diagramPointsCount;
+	int bestOrder = 0;
+	uint64_t bestBitCount = UINT64_MAX;
+	for (int order = 0; order <= MAX_EXP_GOLOMB_ORDER; ++order) {
+		uint64_t bitCount = 0;
+		int level = 0;
+		int levelEnd = levelSizes == NULL ? diagramPointsCount : (*levelSizes)[0];
+		int32_t previousX = 0;
+		for (int i = 0; i < diagramPointsCount; ++i) {
+			if (i == levelEnd) {
+				++level;
+				levelEnd += (*levelSizes)[level];
+				previousX = 0;
+			}
+			int pointIndex = pointOrder == NULL ? i : pointOrder[i];
+			bitCount += BitWriter::calculateExpGolombBitCount(diagram->x(pointIndex) - previousX, order);
+			previousX = diagram->x(pointIndex);
+		}
+		if (bitCount < bestBitCount) {
+			bestBitCount = bitCount;
+			bestOrder = order;
+		}
+	}
+	return bestOrder;
+}
+
+void VorFormat::calculateLevelSizes(int diagramPointsCount, int firstLevelPointsCount, vector<int> * levelSizes) {
+	levelSizes->clear();
+	int levelStart = 0;
+	while (levelStart < diagramPointsCount) {
+		int64_t levelSize = levelStart == 0 ? firstLevelPointsCount : (int64_t)levelStart * (PROGRESSIVE_LEVEL_GROWTH - 1);
+		levelSize = min(levelSize, (int64_t)diagramPointsCount - levelStart);
+		levelSizes->push_back((int)levelSize);
+		levelStart += (int)levelSize;
+	}
+}
+
+void VorFormat::orderPointsByImportance(int32_t width, int32_t height, VoronoiDiagram * diagram, Color24bit * colors,
+	uint8_t * sourceImageData, int rowWidthInBytes, PixelFormat sourcePixelFormat, vector<int> * pointOrder) {
+
+	// Pixels of a removed point would get the color of their second closest point
+	int diagramPointsCount = diagram->diagramPointsCount;
+	vector<int64_t> removalErrors(diagramPointsCount, 0);
+	Rasterizer rasterizer(diagram, width, height);
+	int bytesPerPixel = PixelFormatUtils::getBytesPerPixel(sourcePixelFormat);
+	for (int32_t i = 0; i < height; ++i) {
+		for (int32_t j = 0; j < width; ++j) {
+			int closestPointIndex = rasterizer.findClosestPoint(j, i);
+			int secondClosestPointIndex = rasterizer.findClosestPoint(j, i, closestPointIndex);
+			if (secondClosestPointIndex < 0) {
+				continue;
+			}
+			Color24bit pixel = PixelFormatUtils::readColor(sourcePixelFormat,
+				sourceImageData + (int64_t)i * rowWidthInBytes + j * bytesPerPixel);
+			Color24bit closestColor = colors[closestPointIndex];
+			Color24bit secondClosestColor = colors[secondClosestPointIndex];
+			removalErrors[closestPointIndex] += abs(pixel.b - secondClosestColor.b)
+				+ abs(pixel.g - secondClosestColor.g)
+				+ abs(pixel.r - secondClosestColor.r)
+				- abs(pixel.b - closestColor.b)
+				- abs(pixel.g - closestColor.g)
+				- abs(pixel.r - closestColor.r);
+		}
+	}
+
+	pointOrder->resize(diagramPointsCount);
+	for (int i = 0; i < diagramPointsCount; ++i) {
+		(*pointOrder)[i] = i;
+	}
+	stable_sort(pointOrder->begin(), pointOrder->end(), [&removalErrors](int first, int second) {
+		return removalErrors[first] > removalErrors[second];
+	});
+
+	// Equal points keep their order of the diagram, the first of them stays the closest after decoding
+	vector<int32_t> xCoordinates(diagramPointsCount);
+	vector<int32_t> yCoordinates(diagramPointsCount);
+	for (int i = 0; i < diagramPointsCount; ++i) {
+		xCoordinates[i] = diagram->x((*pointOrder)[i]);
+		yCoordinates[i] = diagram->y((*pointOrder)[i]);
+	}
+	vector<int> streamIndices;
+	sortStreamIndices(xCoordinates.data(), yCoordinates.data(), diagramPointsCount, &streamIndices);
+	vector<int> equalPoints;
+	for (int i = 0; i < diagramPointsCount; ) {
+		int equalEnd = i + 1;
+		while (equalEnd < diagramPointsCount
+			&& xCoordinates[streamIndices[equalEnd]] == xCoordinates[streamIndices[i]]
+			&& yCoordinates[streamIndices[equalEnd]] == yCoordinates[streamIndices[i]]) {
+			++equalEnd;
+		}
+		if (equalEnd - i > 1) {
+			equalPoints.clear();
+			for (int k = i; k < equalEnd; ++k) {
+				equalPoints.push_back((*pointOrder)[streamIndices[k]]);
+			}
+			sort(equalPoints.begin(), equalPoints.end());
+			for (int k = i; k < equalEnd; ++k) {
+				(*pointOrder)[streamIndices[k]] = equalPoints[k - i];
+			}
+		}
+		i = equalEnd;
+	}
+}
+
+void VorFormat::fitPrefixColors(int32_t width, int32_t height, VoronoiDiagram * diagram, Color24bit * colors,
+	uint8_t * sourceImageData, int rowWidthInBytes, PixelFormat sourcePixelFormat, vector<int> * pointOrder, int prefixCount,
+	Color24bit * prefixColors) {
+
+	// Prefix is drawn in the same order as the decoder sorts it
+	vector<int32_t> xCoordinates(prefixCount);
+	vector<int32_t> yCoordinates(prefixCount);
+	for (int i = 0; i < prefixCount; ++i) {
+		xCoordinates[i] = diagram->x((*pointOrder)[i]);
+		yCoordinates[i] = diagram->y((*pointOrder)[i]);
+	}
+	vector<int> streamIndices;
+	sortStreamIndices(xCoordinates.data(), yCoordinates.data(), prefixCount, &streamIndices);
+	VoronoiDiagram prefixDiagram(prefixCount);
+	for (int i = 0; i < prefixCount; ++i) {
+		prefixDiagram.setPoint(i, xCoordinates[streamIndices[i]], yCoordinates[streamIndices[i]]);
+	}
+
+	vector<int64_t> bSums(prefixCount, 0), gSums(prefixCount, 0), rSums(prefixCount, 0);
+	vector<int64_t> pixelPerPointCounts(prefixCount, 0);
+	Rasterizer rasterizer(&prefixDiagram, width, height);
+	int bytesPerPixel = PixelFormatUtils::getBytesPerPixel(sourcePixelFormat);
+	for (int32_t i = 0; i < height; ++i) {
+		for (int32_t j = 0; j < width; ++j) {
+			int pointIndex = rasterizer.findClosestPoint(j, i);
+			Color24bit pixel = PixelFormatUtils::readColor(sourcePixelFormat,
+				sourceImageData + (int64_t)i * rowWidthInBytes + j * bytesPerPixel);
+			bSums[pointIndex] += pixel.b;
+			gSums[pointIndex] += pixel.g;
+			rSums[pointIndex] += pixel.r;
+			pixelPerPointCounts[pointIndex] += 1;
+		}
+	}
+
+	for (int i = 0; i < prefixCount; ++i) {
+		int streamIndex = streamIndices[i];
+		if (pixelPerPointCounts[i] == 0) {
+			prefixColors[streamIndex] = colors[(*pointOrder)[streamIndex]];
+			continue;
+		}
+		prefixColors[streamIndex].b = (uint8_t)(bSums[i] / (double)pixelPerPointCounts[i] + 0.5);
+		prefixColors[streamIndex].g = (uint8_t)(gSums[i] / (double)pixelPerPointCounts[i] + 0.5);
+		prefixColors[streamIndex].r = (uint8_t)(rSums[i] / (double)pixelPerPointCounts[i] + 0.5);
+	}
+}
+
+void VorFormat::sortStreamIndices(int32_t * xCoordinates, int32_t * yCoordinates, int count, vector<int> * streamIndices) {
+	streamIndices->resize(count);
+	for (int i = 0; i < count; ++i) {
+		(*streamIndices)[i] = i;
+	}
+	sort(streamIndices->begin(), streamIndices->end(), [xCoordinates, yCoordinates](int first, int second) {
+		if (xCoordinates[first] != xCoordinates[second]) {
+			return xCoordinates[first] < xCoordinates[second];
+		}
+		if (yCoordinates[first] != yCoordinates[second]) {
+			return yCoordinates[first] < yCoordinates[second];
+		}
+		return first < second;
+	});
+}
+
+int VorFormat::decode(const uint8_t * data, size_t dataSize,
+	int32_t * width, int32_t * height, VoronoiDiagram ** diagram, Color24bit ** colors) {
+
+	if (dataSize >= 4 && memcmp(data, "VOR", 3) == 0) {
+		if (data[3] > FORMAT_VERSION) {
+			return ERROR_UNSUPPORTED_COMPRESSED_FILE_VERSION;
+		}
+		return decodeBitPacked(data, dataSize, width, height, diagram, colors);
+	}
+	// Version 1 has no signature, it starts with the width
+	return decodeV1(data, dataSize, width, height, diagram, colors);
+}
+
+int VorFormat::decodeV1(const uint8_t * data, size_t dataSize,
+	int32_t * width, int32_t * height, VoronoiDiagram ** diagram, Color24bit ** colors) {
+
+	if (dataSize < V1_HEADER_SIZE) {
+		return ERROR_INVALID_COMPRESSED_FILE;
+	}
+
+	int32_t diagramPointsCount;
+	memcpy(width, data, 4);
+	memcpy(height, data + 4, 4);
+	memcpy(&diagramPointsCount, data + 10, 4);
+	if (*width <= 0 || *height <= 0 || diagramPointsCount <= 0
+		|| (dataSize - V1_HEADER_SIZE) / V1_POINT_SIZE < (size_t)diagramPointsCount) {
+		return ERROR_INVALID_COMPRESSED_FILE;
+	}
+
+	*diagram = new VoronoiDiagram(diagramPointsCount);
+	*colors = new Color24bit[diagramPointsCount];
+	for (int i = 0; i < diagramPointsCount; ++i) {
+		const uint8_t * pointData = data + V1_HEADER_SIZE + i * V1_POINT_SIZE;
+		int32_t x, y;
+		memcpy(&x, pointData, 4);
+		memcpy(&y, pointData + 4, 4);
+		(*diagram)->setPoint(i, x, y);
+		(*colors)[i].b = pointData[8];
+		(*colors)[i].g = pointData[9];
+		(*colors)[i].r = pointData[10];
+	}
+	return 0;
+}
+
+int VorFormat::decodeBitPacked(const uint8_t * data, size_t dataSize,
+	int32_t * width, int32_t * height, VoronoiDiagram ** diagram, Color24bit ** colors) {
+
+	Header header;
+	bool isTruncated;
+	int err = decodeHeader(data, dataSize, &header, &isTruncated);
+	if (err != 0) {
+		return err;
+	}
+	*width = header.width;
+	*height = header.height;
+	if (header.firstLevelPointsCount > 0) {
+		return decodeProgressivePoints(data, dataSize, &header, false, diagram, colors);
+	}
+	return decodePoints(data, dataSize, &header, header.pointsPosition, 0, header.diagramPointsCount,
+		diagram, colors);
+}
+
+int VorFormat::decodePrefix(const uint8_t * data, size_t dataSize,
+	int32_t * width, int32_t * height, VoronoiDiagram ** diagram, Color24bit ** colors) {
+
+	Header header;
+	bool isTruncated;
+	if (dataSize < 4 || memcmp(data, "VOR", 3) != 0 || data[3] > FORMAT_VERSION
+		|| decodeHeader(data, dataSize, &header, &isTruncated) != 0 || header.firstLevelPointsCount == 0) {
+		return decode(data, dataSize, width, height, diagram, colors);
+	}
+	*width = header.width;
+	*height = header.height;
+	return decodeProgressivePoints(data, dataSize, &header, true, diagram, colors);
+}
+
+int VorFormat::decodeHeader(const uint8_t * data, size_t dataSize, Header * header, bool * isTruncated) {
+	BitReader reader(data, dataSize);
+	reader.seek(3 * 8);
+	header->version = (uint8_t)reader.readBits(8);
+	uint32_t readWidth = reader.readVarint();
+	uint32_t readHeight = reader.readVarint();
+	uint32_t diagramPointsCount = reader.readVarint();
+	uint32_t colorDepth = reader.readBits(8);
+	int order = reader.readBits(8);
+	uint32_t flags = header->version >= 3 ? reader.readBits(8) : 0;
+	*isTruncated = reader.hasOverflown();
+	int channelsCount = (flags & FLAG_GRAY) != 0 ? 1 : 3;
+	uint32_t colorBitCount = calculateColorBitCount(channelsCount);
+	if (reader.hasOverflown()
+		|| readWidth == 0 || readWidth > INT32_MAX || readHeight == 0 || readHeight > INT32_MAX
+		|| diagramPointsCount == 0 || diagramPointsCount > INT32_MAX
+		|| colorDepth > colorBitCount || order > MAX_EXP_GOLOMB_ORDER) {
+		return ERROR_INVALID_COMPRESSED_FILE;
+	}
+	if ((flags & ~(FLAG_TILE_INDEX | FLAG_PROGRESSIVE | FLAG_GRAY)) != 0) {
+		return ERROR_UNSUPPORTED_COMPRESSED_FILE_VERSION;
+	}
+	if ((flags & FLAG_PROGRESSIVE) != 0 && ((flags & FLAG_TILE_INDEX) != 0 || colorDepth != colorBitCount)) {
+		return ERROR_INVALID_COMPRESSED_FILE;
+	}
+	header->width = readWidth;
+	header->height = readHeight;
+	header->diagramPointsCount = diagramPointsCount;
+	header->colorDepth = colorDepth;
+	header->channelsCount = channelsCount;
+	header->order = order;
+
+	header->palette.clear();
+	if (colorDepth < colorBitCount) {
+		uint32_t paletteSize = reader.readVarint();
+		*isTruncated = reader.hasOverflown()
+			|| (uint64_t)dataSize * 8 - reader.getPosition() < (uint64_t)paletteSize * colorBitCount;
+		if (*isTruncated || paletteSize < 1 || paletteSize > MAX_PALETTE_SIZE
+			|| BitWriter::calculateBitCount(paletteSize) != colorDepth) {
+			return ERROR_INVALID_COMPRESSED_FILE;
+		}
+		header->palette.resize(paletteSize);
+		for (uint32_t i = 0; i < paletteSize; ++i) {
+			header->palette[i] = readColor(&reader, channelsCount);
+		}
+	}
+
+	header->firstLevelPointsCount = 0;
+	if ((flags & FLAG_PROGRESSIVE) != 0) {
+		header->firstLevelPointsCount = reader.readVarint();
+		*isTruncated = reader.hasOverflown();
+		if (*isTruncated || header->firstLevelPointsCount == 0) {
+			return ERROR_INVALID_COMPRESSED_FILE;
+		}
+	}
+
+	header->indexTileSize = 0;
+	header->tilesPerRow = 0;
+	header->tiles.clear();
+	if ((flags & FLAG_TILE_INDEX) != 0) {
+		uint32_t indexTileSize = reader.readVarint();
+		int offsetBitCount = reader.readBits(8);
+		*isTruncated = reader.hasOverflown();
+		if (*isTruncated || indexTileSize == 0 || indexTileSize > INT32_MAX || offsetBitCount > 32) {
+			return ERROR_INVALID_COMPRESSED_FILE;
+		}
+		header->indexTileSize = indexTileSize;
+		header->tilesPerRow = (int32_t)((readWidth + (uint64_t)indexTileSize - 1) / indexTileSize);
+		uint64_t tilesCount = header->tilesPerRow * ((readHeight + (uint64_t)indexTileSize - 1) / indexTileSize);
+
+		// Check the size of the index before allocating
+		int indexBitCount = BitWriter::calculateBitCount(diagramPointsCount);
+		int xBitCount = BitWriter::calculateBitCount(readWidth);
+		uint64_t entryBitCount = 2 * indexBitCount + offsetBitCount + xBitCount;
+		*isTruncated = (uint64_t)dataSize * 8 - reader.getPosition() < tilesCount * entryBitCount;
+		if (*isTruncated) {
+			return ERROR_INVALID_COMPRESSED_FILE;
+		}
+		header->tiles.resize((size_t)tilesCount);
+		for (uint64_t i = 0; i < tilesCount; ++i) {
+			TileEntry * tile = &header->tiles[(size_t)i];
+			tile->firstPointIndex = reader.readBits(indexBitCount);
+			tile->lastPointIndex = reader.readBits(indexBitCount);
+			tile->firstPointOffset = reader.readBits(offsetBitCount);
+			tile->previousX = (int32_t)reader.readBits(xBitCount);
+			if (tile->firstPointIndex > tile->lastPointIndex || tile->lastPointIndex >= diagramPointsCount
+				|| (uint32_t)tile->previousX >= readWidth) {
+				return ERROR_INVALID_COMPRESSED_FILE;
+			}
+		}
+		reader.seek((reader.getPosition() + 7) / 8 * 8);
+	}
+
+	header->pointsPosition = reader.getPosition();
+	return 0;
+}
+
+int VorFormat::decodePoints(const uint8_t * data, size_t dataSize, Header * header,
+	uint64_t position, int32_t previousX, uint32_t pointsCount,
+	VoronoiDiagram ** diagram, Color24bit ** colors) {
+
+	// Every point takes at least this many bits, check before allocating
+	int yBitCount = BitWriter::calculateBitCount(header->height);
+	int minPointBitCount = 1 + header->order + yBitCount + header->colorDepth;
+	if ((uint64_t)dataSize * 8 < position
+		|| (uint64_t)dataSize * 8 - position < (uint64_t)pointsCount * minPointBitCount) {
+		return ERROR_INVALID_COMPRESSED_FILE;
+	}
+
+	BitReader reader(data, dataSize);
+	reader.seek(position);
+	vector<Color24bit> & palette = header->palette;
+	VoronoiDiagram * readDiagram = new VoronoiDiagram(pointsCount);
+	Color24bit * readColors = new Color24bit[pointsCount];
+	int64_t x = previousX;
+	for (uint32_t i = 0; i < pointsCount; ++i) {
+		x += reader.readExpGolomb(header->order);
+		uint32_t y = reader.readBits(yBitCount);
+		uint32_t paletteIndex = 0;
+		if (palette.empty()) {
+			readColors[i] = readColor(&reader, header->channelsCount);
+		}
+		else {
+			paletteIndex = reader.readBits(header->colorDepth);
+			if (paletteIndex < palette.size()) {
+				readColors[i] = palette[paletteIndex];
+			}
+		}
+		if (reader.hasOverflown() || x >= header->width || y >= (uint32_t)header->height
+			|| (!palette.empty() && paletteIndex >= palette.size())) {
+			delete readDiagram;
+			delete[] readColors;
+			return ERROR_INVALID_COMPRESSED_FILE;
+		}
+		readDiagram->setPoint(i, (int32_t)x, (int32_t)y);
+	}
+
+	*diagram = readDiagram;
+	*colors = readColors;
+	return 0;
+}
+
+int VorFormat::decodeProgressivePoints(const uint8_t * data, size_t dataSize, Header * header, bool allowPrefix,
+	VoronoiDiagram ** diagram, Color24bit ** colors) {
+
+	vector<int> levelSizes;
+	calculateLevelSizes(header->diagramPointsCount, header->firstLevelPointsCount, &levelSizes);
+	int yBitCount = BitWriter::calculateBitCount(header->height);
+
+	// Points are read until the end of the data, only complete levels are decoded
+	BitReader reader(data, dataSize);
+	reader.seek(header->pointsPosition);
+	vector<int32_t> xCoordinates;
+	vector<int32_t> yCoordinates;
+	vector<Color24bit> levelColors;
+	vector<Color24bit> completeColors;
+	int completePointsCount = 0;
+	for (size_t level = 0; level < levelSizes.size(); ++level) {
+		int64_t x = 0;
+		for (int i = 0; i < levelSizes[level] && !reader.hasOverflown(); ++i) {
+			x += reader.readExpGolomb(header->order);
+			uint32_t y = reader.readBits(yBitCount);
+			if (!reader.hasOverflown() && (x >= header->width || y >= (uint32_t)header->height)) {
+				return ERROR_INVALID_COMPRESSED_FILE;
+			}
+			xCoordinates.push_back((int32_t)x);
+			yCoordinates.push_back((int32_t)y);
+		}
+		int levelEnd = completePointsCount + levelSizes[level];
+		if (reader.hasOverflown() || (uint64_t)dataSize * 8 - reader.getPosition() < (uint64_t)levelEnd * header->colorDepth) {
+			break;
+		}
+		levelColors.resize(levelEnd);
+		for (int i = 0; i < levelEnd; ++i) {
+			levelColors[i] = readColor(&reader, header->channelsCount);
+		}
+		completeColors.swap(levelColors);
+		completePointsCount = levelEnd;
+	}
+	if (completePointsCount == 0 || (!allowPrefix && completePointsCount < (int)header->diagramPointsCount)) {
+		return ERROR_INVALID_COMPRESSED_FILE;
+	}
+
+	vector<int> streamIndices;
+	sortStreamIndices(xCoordinates.data(), yCoordinates.data(), completePointsCount, &streamIndices);
+	VoronoiDiagram * readDiagram = new VoronoiDiagram(completePointsCount);
+	Color24bit * readColors = new Color24bit[completePointsCount];
+	for (int i = 0; i < completePointsCount; ++i) {
+		readDiagram->setPoint(i, xCoordinates[streamIndices[i]], yCoordinates[streamIndices[i]]);
+		readColors[i] = completeColors[streamIndices[i]];
+	}
+
+	*diagram = readDiagram;
+	*colors = readColors;
+	return 0;
+}
+
+void VorFormat::findRegionPoints(Header * header,
+	int32_t windowX, int32_t windowY, int32_t windowWidth, int32_t windowHeight,
+	TileEntry * firstTile, uint32_t * lastPointIndex) {
+
+	// Window is clamped into the image, at least one tile is always covered
+	int64_t left = max((int64_t)0, min((int64_t)windowX, (int64_t)header->width - 1));
+	int64_t top = max((int64_t)0, min((int64_t)windowY, (int64_t)header->height - 1));
+	int64_t right = max(left, min((int64_t)windowX + windowWidth - 1, (int64_t)header->width - 1));
+	int64_t bottom = max(top, min((int64_t)windowY + windowHeight - 1, (int64_t)header->height - 1));
+
+	*firstTile = header->tiles[(size_t)((top / header->indexTileSize) * header->tilesPerRow + left / header->indexTileSize)];
+	*lastPointIndex = 0;
+	for (int64_t tileY = top / header->indexTileSize; tileY <= bottom / header->indexTileSize; ++tileY) {
+		for (int64_t tileX = left / header->indexTileSize; tileX <= right / header->indexTileSize; ++tileX) {
+			TileEntry * tile = &header->tiles[(size_t)(tileY * header->tilesPerRow + tileX)];
+			if (tile->firstPointIndex < firstTile->firstPointIndex) {
+				*firstTile = *tile;
+			}
+			*lastPointIndex = max(*lastPointIndex, tile->lastPointIndex);
+		}
+	}
+}
+
+int VorFormat::decodeRegion(const uint8_t * data, size_t dataSize,
+	int32_t windowX, int32_t windowY, int32_t windowWidth, int32_t windowHeight,
+	int32_t * width, int32_t * height, VoronoiDiagram ** diagram, Color24bit ** colors) {
+
+	Header header;
+	bool isTruncated;
+	if (dataSize < 4 || memcmp(data, "VOR", 3) != 0 || data[3] > FORMAT_VERSION
+		|| decodeHeader(data, dataSize, &header, &isTruncated) != 0 || header.tiles.empty()) {
+		return decode(data, dataSize, width, height, diagram, colors);
+	}
+
+	TileEntry firstTile;
+	uint32_t lastPointIndex;
+	findRegionPoints(&header, windowX, windowY, windowWidth, windowHeight, &firstTile, &lastPointIndex);
+	*width = header.width;
+	*height = header.height;
+	return decodePoints(data, dataSize, &header,
+		header.pointsPosition + firstTile.firstPointOffset, firstTile.previousX,
+		lastPointIndex - firstTile.firstPointIndex + 1, diagram, colors);
+}
+
+int VorFormat::write(const char * path, int32_t width, int32_t height,
+	VoronoiDiagram * diagram, Color24bit * colors, int32_t indexTileSize, int channelsCount) {
+
+	vector<uint8_t> data;
+	int err = encode(width, height, diagram, colors, &data, indexTileSize, channelsCount);
+	if (err != 0) {
+		return err;
+	}
+	return writeData(path, &data);
+}
+
+int VorFormat::write(const char * path, int32_t width, int32_t height, VoronoiDiagram * diagram,
+	Color24bit * palette, int paletteSize, int * colorPaletteIndices, int32_t indexTileSize, int channelsCount) {
+
+	vector<uint8_t> data;
+	int err = encode(width, height, diagram, palette, paletteSize, colorPaletteIndices, &data, indexTileSize, channelsCount);
+	if (err != 0) {
+		return err;
+	}
+	return writeData(path, &data);
+}
+
+int VorFormat::writeProgressive(const char * path, int32_t width, int32_t height,
+	VoronoiDiagram * diagram, Color24bit * colors, uint8_t * sourceImageData, int rowWidthInBytes,
+	PixelFormat sourcePixelFormat) {
+
+	vector<uint8_t> data;
+	int err = encodeProgressive(width, height, diagram, colors, sourceImageData, rowWidthInBytes, sourcePixelFormat, &data);
+	if (err != 0) {
+		return err;
+	}
+	return writeData(path, &data);
+}
+
+int VorFormat::writeData(const char * path, vector<uint8_t> * data) {
+	FILE* file;
+	errno_t openErr = fopen_s(
+		&file,
+		path,
+		"wb");
+	if (openErr != 0 || file == NULL) {
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+
+	fwrite(data->data(), 1, data->size(), file);
+
+	fflush(file);
+	fclose(file);
+	return 0;
+}
+
+int VorFormat::read(const char * path,
+	int32_t * width, int32_t * height, VoronoiDiagram ** diagram, Color24bit ** colors) {
+
+	FILE* file;
+	errno_t openErr = fopen_s(
+		&file,
+		path,
+		"rb");
+	if (openErr != 0 || file == NULL) {
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+
+	vector<uint8_t> data;
+	uint8_t buffer[4096];
+	size_t readCount;
+	while ((readCount = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		data.insert(data.end(), buffer, buffer + readCount);
+	}
+	fclose(file);
+
+	return decode(data.data(), data.size(), width, height, diagram, colors);
+}
+
+int VorFormat::readPrefix(const char * path, uint32_t maxSizeBytes,
+	int32_t * width, int32_t * height, VoronoiDiagram ** diagram, Color24bit ** colors) {
+
+	FILE* file;
+	errno_t openErr = fopen_s(
+		&file,
+		path,
+		"rb");
+	if (openErr != 0 || file == NULL) {
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+
+	vector<uint8_t> data(maxSizeBytes);
+	data.resize(fread(data.data(), 1, data.size(), file));
+	fclose(file);
+
+	return decodePrefix(data.data(), data.size(), width, height, diagram, colors);
+}
+
+int VorFormat::readRegion(const char * path,
+	int32_t windowX, int32_t windowY, int32_t windowWidth, int32_t windowHeight,
+	int32_t * width, int32_t * height, VoronoiDiagram ** diagram, Color24bit ** colors) {
+
+	FILE* file;
+	errno_t openErr = fopen_s(
+		&file,
+		path,
+		"rb");
+	if (openErr != 0 || file == NULL) {
+		return ERROR_FILE_COULD_NOT_OPEN_FILE;
+	}
+	// Positions are 64 bit, so windows of files larger than 2 GiB are read from the right place
+	int64_t fileEndPosition = Utils::seekFile(file, 0, SEEK_END) ? Utils::tellFile(file) : -1;
+	if (fileEndPosition < 0) {
+		fclose(file);
+		return ERROR_FILE_COULD_NOT_SEEK;
+	}
+	size_t fileSize = (size_t)fileEndPosition;
+
+	// Read longer beginnings of the file until the whole header with tile index is read
+	vector<uint8_t> data;
+	Header header;
+	bool isTruncated = true;
+	int err = 0;
+	for (size_t readSize = 4096; isTruncated && data.size() < fileSize; readSize *= 2) {
+		data.resize(min(readSize, fileSize));
+		if (!Utils::seekFile(file, 0, SEEK_SET)) {
+			fclose(file);
+			return ERROR_FILE_COULD_NOT_SEEK;
+		}
+		data.resize(fread(data.data(), 1, data.size(), file));
+		if (data.size() < 4 || memcmp(data.data(), "VOR", 3) != 0 || data[3] > FORMAT_VERSION) {
+			break;
+		}
+		err = decodeHeader(data.data(), data.size(), &header, &isTruncated);
+	}
+	if (isTruncated || err != 0 || header.tiles.empty()) {
+		// Files without tile index are read whole
+		fclose(file);
+		return read(path, width, height, diagram, colors);
+	}
+
+	TileEntry firstTile;
+	uint32_t lastPointIndex;
+	findRegionPoints(&header, windowX, windowY, windowWidth, windowHeight, &firstTile, &lastPointIndex);
+	uint32_t pointsCount = lastPointIndex - firstTile.firstPointIndex + 1;
+
+	// Points end before the first point of any tile starting after them and no point is longer than the longest code
+	uint64_t startPosition = header.pointsPosition + firstTile.firstPointOffset;
+	int maxPointBitCount = BitWriter::calculateExpGolombBitCount(header.width - 1, header.order)
+		+ BitWriter::calculateBitCount(header.height) + header.colorDepth;
+	uint64_t endPosition = min((uint64_t)fileSize * 8, startPosition + (uint64_t)pointsCount * maxPointBitCount);
+	for (size_t i = 0; i < header.tiles.size(); ++i) {
+		if (header.tiles[i].firstPointIndex > lastPointIndex) {
+			endPosition = min(endPosition, header.pointsPosition + header.tiles[i].firstPointOffset);
+		}
+	}
+
+	size_t startByte = (size_t)(startPosition / 8);
+	data.resize((size_t)((endPosition + 7) / 8) - min(startByte, (size_t)((endPosition + 7) / 8)));
+	if (!Utils::seekFile(file, (int64_t)startByte, SEEK_SET)) {
+		fclose(file);
+		return ERROR_FILE_COULD_NOT_SEEK;
+	}
+	data.resize(fread(data.data(), 1, data.size(), file));
+	fclose(file);
+
+	*width = header.width;
+	*height = header.height;
+	return decodePoints(data.data(), data.size(), &header, startPosition % 8, firstTile.previousX,
+		pointsCount, diagram, colors);
+}
+
+int VorFormat::calculateHeaderSize(int32_t width, int32_t height, int diagramPointsCount, int paletteSize, int channelsCount) {
+	int headerSize = 4
+		+ BitWriter::calculateVarintByteCount(width)
+		+ BitWriter::calculateVarintByteCount(height)
+		+ BitWriter::calculateVarintByteCount(diagramPointsCount)
+		+ 3;
+	if (paletteSize > 0) {
+		headerSize += BitWriter::calculateVarintByteCount(paletteSize) + paletteSize * calculateColorBitCount(channelsCount) / 8;
+	}
+	return headerSize;
+}
+
+uint64_t VorFormat::calculateTileIndexBitCount(int32_t width, int32_t height, int diagramPointsCount,
+	int32_t indexTileSize, uint64_t pointsBitCount) {
+
+	if (indexTileSize <= 0) {
+		return 0;
+	}
+	uint64_t tilesCount = ((width + (uint64_t)indexTileSize - 1) / indexTileSize)
+		* ((height + (uint64_t)indexTileSize - 1) / indexTileSize);
+	int offsetBitCount = BitWriter::calculateBitCount((uint32_t)min(pointsBitCount, (uint64_t)UINT32_MAX));
+	uint64_t entriesBitCount = tilesCount * (2 * BitWriter::calculateBitCount(diagramPointsCount)
+		+ offsetBitCount + BitWriter::calculateBitCount(width));
+	return ((uint64_t)BitWriter::calculateVarintByteCount(indexTileSize) + 1) * 8 + (entriesBitCount + 7) / 8 * 8;
+}
+
+int VorFormat::calculateMaxDiagramPointsCount(uint32_t maxSizeBytes, int32_t width, int32_t height,
+	int paletteSize, int32_t indexTileSize, bool progressive, int channelsCount) {
+
+	int colorBitCount = calculateColorBitCount(channelsCount);
+	int colorDepth = paletteSize > 0 ? BitWriter::calculateBitCount(paletteSize) : colorBitCount;
+	int pointFixedBitCount = BitWriter::calculateBitCount(height) + colorDepth;
+
+	// Bisect the largest count of points whose size bound fits
+	int fittingPointsCount = 0;
+	int exceedingPointsCount = (int)((uint64_t)maxSizeBytes * 8 / (pointFixedBitCount + 1)) + 1;
+	vector<int> levelSizes;
+	while (exceedingPointsCount - fittingPointsCount > 1) {
+		int pointsCount = (fittingPointsCount + exceedingPointsCount) / 2;
+
+		// Distances start from 0 in every level of progressive file, other files have one level
+		uint64_t colorsBitCount = (uint64_t)pointsCount * colorDepth;
+		levelSizes.assign(1, pointsCount);
+		if (progressive) {
+			calculateLevelSizes(pointsCount, PROGRESSIVE_FIRST_LEVEL_POINTS_COUNT, &levelSizes);
+			colorsBitCount = 0;
+			uint64_t levelEnd = 0;
+			for (size_t level = 0; level < levelSizes.size(); ++level) {
+				levelEnd += levelSizes[level];
+				colorsBitCount += levelEnd * colorBitCount;
+			}
+		}
+
+		// Code length k + 1 + 2 * floor(log2(d / 2^k + 1)) is bounded by the same expression
+		// without the floor, which is concave, so evenly spread points give the upper bound
+		double minDistancesBitCount = -1;
+		for (int order = 0; order <= MAX_EXP_GOLOMB_ORDER; ++order) {
+			double distancesBitCount = 0;
+			for (size_t level = 0; level < levelSizes.size(); ++level) {
+				double meanDistance = (width - 1) / (double)levelSizes[level];
+				distancesBitCount += levelSizes[level]
+					* (order + 1 + 2 * log2(meanDistance / pow(2.0, order) + 1));
+			}
+			if (minDistancesBitCount < 0 || distancesBitCount < minDistancesBitCount) {
+				minDistancesBitCount = distancesBitCount;
+			}
+		}
+
+		uint64_t pointsBitCount = (uint64_t)pointsCount * (pointFixedBitCount - colorDepth)
+			+ colorsBitCount + (uint64_t)ceil(minDistancesBitCount);
+		uint64_t bitCount = (uint64_t)calculateHeaderSize(width, height, pointsCount, paletteSize, channelsCount) * 8
+			+ calculateTileIndexBitCount(width, height, pointsCount, indexTileSize, pointsBitCount)
+			+ pointsBitCount;
+		if (progressive) {
+			bitCount += (uint64_t)BitWriter::calculateVarintByteCount(PROGRESSIVE_FIRST_LEVEL_POINTS_COUNT) * 8;
+		}
+		if ((bitCount + 7) / 8 <= maxSizeBytes) {
+			fittingPointsCount = pointsCount;
+		}
+		else {
+			exceedingPointsCount = pointsCount;
+		}
+	}
+	return fittingPointsCount;
+}
@@ -0,0 +1,284 @@
+#pragma once
+
+#include "voronoidiagram.h"
+#include "color.h"
+#include "pixelformat.h"
+#include "bitstream.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace lossycompressor {
+
+	/// Reads and writes compressed voronoi diagram files.
+	/**
+		Files are written in version 3 of the format, which is bit-packed:
+		3 bytes - characters "VOR",
+		1 byte - format version (3),
+		varint - image width,
+		varint - image height,
+		varint - count of points in diagram,
+		1 byte - color depth, 24 (8 in gray files) if colors are stored in points or count of bits of palette index,
+		1 byte - order of Exp-Golomb code of horizontal distances,
+		1 byte - flags, bit 0 is set if the file contains tile index, bit 1 is set if the file is progressive,
+			bit 2 is set if the file is gray.
+		If colors are stored in palette, header continues with:
+		varint - count of palette colors,
+		3 bytes per palette color - palette color (b, g, r), 1 byte gray level in gray files.
+		If the file contains tile index, header continues with:
+		varint - tile size in pixels,
+		1 byte - count of bits of point offsets,
+		bit-packed entry for every tile of the image by rows from the top left tile:
+			ceil(log2(count of points)) bits - index of the first point that can be closest to any position in the tile,
+			ceil(log2(count of points)) bits - index of the last such point,
+			count of bits of point offsets - position of the first point in the bit stream of points,
+			ceil(log2(width)) bits - x coordinate of the point before the first point (0 for the first point of diagram),
+		zero bits up to a whole byte.
+		Rest of the file is a bit stream (most significant bit first) of diagram points
+		sorted by x and then y coordinate, every point is stored as:
+			Exp-Golomb code - difference of x coordinate from previous point (first point from 0),
+			ceil(log2(height)) bits - y coordinate,
+			24 bits - point color (b, g, r), 8 bits - gray level in gray files, or color depth bits - index of point color in palette.
+		Varints store 7 bits in every byte starting from the lowest, the highest bit
+		of byte is set if more bytes follow.
+
+		Progressive files store colors in points and have no tile index, their header continues with:
+		varint - count of points in the first level.
+		Rest of the progressive file is a bit stream of levels, every level has 3 times more points than
+		all previous levels together, except the last level which has the remaining points. Level contains:
+			new points sorted by x and then y coordinate, every point is stored as:
+				Exp-Golomb code - difference of x coordinate from previous point of the level (first point from 0),
+				ceil(log2(height)) bits - y coordinate,
+			24 bits - color (b, g, r), or 8 bits - gray level in gray files, of every point of all levels up to this one in order of the stream.
+		Points are ordered by their contribution to the image, so the points of the first levels
+		give a coarser image with colors fitted to them. Beginning of the file can be drawn, see decodePrefix().
+		Diagram of a progressive file is sorted by x, y and order in the stream after decoding.
+
+		Gray files store one channel of every color, so their points are 16 bits shorter. Palette of gray file
+		has at most MAX_GRAY_PALETTE_SIZE colors, so that its indices are shorter than gray levels.
+
+		Tile index allows drawing a window of the image by reading only the points between the first
+		and the last point of the tiles covered by the window, see readRegion().
+
+		Version 2 files are the same as version 3 files without the flags byte.
+		Version 1 files are still read, they have the following format:
+		4 bytes - image width,
+		4 bytes - image height,
+		2 bytes - image color depth,
+		4 bytes - count of points in diagram.
+		Rest of the file contains diagram points in following format:
+			4 bytes - point x coordinate,
+			4 bytes - point y coordinate,
+			3 bytes - point color.
+	*/
+	class VorFormat {
+		static const uint8_t FORMAT_VERSION = 3;
+		static const int CHANNEL_DEPTH = 8;
+		static const int MAX_EXP_GOLOMB_ORDER = 24;
+		static const uint8_t FLAG_TILE_INDEX = 1;
+		static const uint8_t FLAG_PROGRESSIVE = 2;
+		static const uint8_t FLAG_GRAY = 4;
+		static const int PROGRESSIVE_FIRST_LEVEL_POINTS_COUNT = 16;
+		static const int PROGRESSIVE_LEVEL_GROWTH = 4;		// Ratio of points after and before a level
+
+		static const int V1_HEADER_SIZE = 14;
+		static const int V1_POINT_SIZE = 11;
+
+		// Entry of tile index
+		struct TileEntry {
+			uint32_t firstPointIndex;
+			uint32_t lastPointIndex;
+			uint32_t firstPointOffset;	// Bit position in the point stream
+			int32_t previousX;			// X coordinate of the point before the first point
+		};
+
+		// Header of bit-packed versions
+		struct Header {
+			uint8_t version;
+			int32_t width;
+			int32_t height;
+			uint32_t diagramPointsCount;
+			int colorDepth;
+			int channelsCount;		// 1 in gray files, 3 otherwise
+			int order;
+			std::vector<Color24bit> palette;
+			uint32_t firstLevelPointsCount;		// 0 if the file is not progressive
+			int32_t indexTileSize;		// 0 if there is no tile index
+			int32_t tilesPerRow;
+			std::vector<TileEntry> tiles;
+			uint64_t pointsPosition;	// Bit position of the point stream in the file
+		};
+
+		static int decodeV1(const uint8_t * data, size_t dataSize,
+			int32_t * width, int32_t * height, VoronoiDiagram ** diagram, Color24bit ** colors);
+		static int decodeBitPacked(const uint8_t * data, size_t dataSize,
+			int32_t * width, int32_t * height, VoronoiDiagram ** diagram, Color24bit ** colors);
+		// isTruncated is set if the data ends before the end of the header
+		static int decodeHeader(const uint8_t * data, size_t dataSize, Header * header, bool * isTruncated);
+		// Decodes points from given bit position of the data, previousX is the x coordinate of the point before them
+		static int decodePoints(const uint8_t * data, size_t dataSize, Header * header,
+			uint64_t position, int32_t previousX, uint32_t pointsCount,
+			VoronoiDiagram ** diagram, Color24bit ** colors);
+		static int decodeProgressivePoints(const uint8_t * data, size_t dataSize, Header * header, bool allowPrefix,
+			VoronoiDiagram ** diagram, Color24bit ** colors);
+		// Finds the first tile entry and the last point index of tiles covered by the window
+		static void findRegionPoints(Header * header,
+			int32_t windowX, int32_t windowY, int32_t windowWidth, int32_t windowHeight,
+			TileEntry * firstTile, uint32_t * lastPointIndex);
+		static int encode(int32_t width, int32_t height, VoronoiDiagram * diagram,
+			Color24bit * colors, Color24bit * palette, int paletteSize, int * colorPaletteIndices,
+			std::vector<uint8_t> * output, int32_t indexTileSize, int channelsCount);
+		static int checkDiagram(int32_t width, int32_t height, VoronoiDiagram * diagram);
+		static int calculateColorBitCount(int channelsCount);
+		static void writeColor(BitWriter * writer, const Color24bit & color, int channelsCount);
+		static Color24bit readColor(BitReader * reader, int channelsCount);
+		static int findBestExpGolombOrder(VoronoiDiagram * diagram, int * pointOrder, std::vector<int> * levelSizes);
+		static void calculateLevelSizes(int diagramPointsCount, int firstLevelPointsCount, std::vector<int> * levelSizes);
+		// Sorts points by decreasing increase of the image error when the point is removed
+		static void orderPointsByImportance(int32_t width, int32_t height, VoronoiDiagram * diagram, Color24bit * colors,
+			uint8_t * sourceImageData, int rowWidthInBytes, PixelFormat sourcePixelFormat, std::vector<int> * pointOrder);
+		// Fits colors of the first prefixCount points of the order, points without pixels keep their colors
+		static void fitPrefixColors(int32_t width, int32_t height, VoronoiDiagram * diagram, Color24bit * colors,
+			uint8_t * sourceImageData, int rowWidthInBytes, PixelFormat sourcePixelFormat, std::vector<int> * pointOrder, int prefixCount,
+			Color24bit * prefixColors);
+		// Sorts indices of stream by coordinates of their points and then by the stream order
+		static void sortStreamIndices(int32_t * xCoordinates, int32_t * yCoordinates, int count, std::vector<int> * streamIndices);
+		static int calculateHeaderSize(int32_t width, int32_t height, int diagramPointsCount, int paletteSize, int channelsCount);
+		static uint64_t calculateTileIndexBitCount(int32_t width, int32_t height, int diagramPointsCount,
+			int32_t indexTileSize, uint64_t pointsBitCount);
+	public:
+		static const int ERROR_FILE_COULD_NOT_OPEN_FILE = 2;				///< Error code. File could not be open.
+		static const int ERROR_INVALID_COMPRESSED_FILE = 6;					///< Error code. Compressed file is damaged or it is not a compressed file.
+		static const int ERROR_UNSUPPORTED_COMPRESSED_FILE_VERSION = 7;		///< Error code. Compressed file was written by a newer version of the format.
+		static const int ERROR_POINT_OUTSIDE_IMAGE = 8;						///< Error code. Diagram contains a point which is not inside the image.
+		static const int ERROR_INVALID_PALETTE = 9;							///< Error code. Palette is empty or has too many colors.
+		static const int ERROR_INVALID_INDEX_TILE_SIZE = 11;				///< Error code. Tile size of tile index is negative or the points are too large to be indexed.
+		static const int ERROR_PROGRESSIVE_OPTIONS_CONFLICT = 12;			///< Error code. Progressive file can not use palette or tile index.
+		static const int ERROR_POINTS_NOT_SORTED = 24;						///< Error code. Points of the encoded diagram are not sorted by their horizontal coordinate.
+		static const int ERROR_FILE_COULD_NOT_SEEK = 22;					///< Error code. Position in the file could not be set or read.
+
+		static const int MAX_PALETTE_SIZE = 1 << 16;						///< Maximal count of colors in palette.
+		static const int MAX_GRAY_PALETTE_SIZE = 1 << 7;					///< Maximal count of colors in palette of gray file.
+
+		/// Encode the diagram into bytes of the compressed file.
+		/**
+			Points of the diagram must be sorted and must lie inside the image.
+
+			\param[in] indexTileSize		Size of tiles of tile index in pixels, file contains no tile index if 0.
+			\param[in] channelsCount		1 if the file is gray, gray level of colors is taken from b. 3 otherwise.
+			\return 0 if successfull, error code otherwise.
+		*/
+		static int encode(int32_t width, int32_t height, VoronoiDiagram * diagram, Color24bit * colors,
+			std::vector<uint8_t> * output, int32_t indexTileSize = 0, int channelsCount = 3);
+
+		/// Encode the diagram with colors stored in palette.
+		/**
+			Points of the diagram must be sorted and must lie inside the image.
+
+			\param[in] palette				Palette colors.
+			\param[in] paletteSize			Count of palette colors, at least 1 and at most MAX_PALETTE_SIZE, or MAX_GRAY_PALETTE_SIZE in gray file.
+			\param[in] colorPaletteIndices	Index of palette color of every point.
+			\param[in] indexTileSize		Size of tiles of tile index in pixels, file contains no tile index if 0.
+			\param[in] channelsCount		1 if the file is gray, gray level of colors is taken from b. 3 otherwise.
+			\return 0 if successfull, error code otherwise.
+		*/
+		static int encode(int32_t width, int32_t height, VoronoiDiagram * diagram,
+			Color24bit * palette, int paletteSize, int * colorPaletteIndices,
+			std::vector<uint8_t> * output, int32_t indexTileSize = 0, int channelsCount = 3);
+
+		/// Encode the diagram into progressive file with points ordered by their contribution to the image.
+		/**
+			Points of the diagram must lie inside the image. Colors of all points are stored after
+			every level, colors of the last level are the given colors and colors of previous levels
+			are means of source pixels closest to the points of the levels.
+
+			\param[in] sourceImageData		Source image pixels stored by rows from top to bottom.
+			\param[in] rowWidthInBytes		Width of a row in source image data in bytes.
+			\param[in] sourcePixelFormat	Format of source image pixels, file is gray if the pixels are gray.
+			\return 0 if successfull, error code otherwise.
+		*/
+		static int encodeProgressive(int32_t width, int32_t height, VoronoiDiagram * diagram, Color24bit * colors,
+			uint8_t * sourceImageData, int rowWidthInBytes, PixelFormat sourcePixelFormat, std::vector<uint8_t> * output);
+
+		/// Decode the diagram from bytes of the compressed file in any supported version.
+		/**
+			Diagram and colors are allocated by this method and must be deleted by the caller.
+
+			\return 0 if successfull, error code otherwise.
+		*/
+		static int decode(const uint8_t * data, size_t dataSize,
+			int32_t * width, int32_t * height, VoronoiDiagram ** diagram, Color24bit ** colors);
+
+		/// Decode the diagram from the beginning of the compressed file.
+		/**
+			Diagram of a progressive file contains points of all levels read completely, at least
+			the first level must be read. Other files must be complete, see decode().
+			Diagram and colors are allocated by this method and must be deleted by the caller.
+
+			\return 0 if successfull, error code otherwise.
+		*/
+		static int decodePrefix(const uint8_t * data, size_t dataSize,
+			int32_t * width, int32_t * height, VoronoiDiagram ** diagram, Color24bit ** colors);
+
+		/// Decode only points of the diagram needed for drawing given window of the image.
+		/**
+			Decoded diagram contains all points that can be closest to any position in the window
+			and usually some more, they are in the same order as in the whole diagram, so equally
+			distant points are resolved the same way. Whole diagram is decoded if the file has no tile index.
+			Diagram and colors are allocated by this method and must be deleted by the caller.
+
+			\param[in] windowX			X coordinate of the left edge of the window in pixels.
+			\param[in] windowY			Y coordinate of the top edge of the window in pixels.
+			\param[in] windowWidth		Width of the window in pixels.
+			\param[in] windowHeight	Height of the window in pixels.
+			\return 0 if successfull, error code otherwise.
+		*/
+		static int decodeRegion(const uint8_t * data, size_t dataSize,
+			int32_t windowX, int32_t windowY, int32_t windowWidth, int32_t windowHeight,
+			int32_t * width, int32_t * height, VoronoiDiagram ** diagram, Color24bit ** colors);
+
+		/// Encode the diagram and write it into the file.
+		static int write(const char * path, int32_t width, int32_t height,
+			VoronoiDiagram * diagram, Color24bit * colors, int32_t indexTileSize = 0, int channelsCount = 3);
+
+		/// Encode the diagram with colors stored in palette and write it into the file.
+		static int write(const char * path, int32_t width, int32_t height, VoronoiDiagram * diagram,
+			Color24bit * palette, int paletteSize, int * colorPaletteIndices, int32_t indexTileSize = 0, int channelsCount = 3);
+
+		/// Encode the diagram into progressive file and write it, see encodeProgressive().
+		static int writeProgressive(const char * path, int32_t width, int32_t height,
+			VoronoiDiagram * diagram, Color24bit * colors, uint8_t * sourceImageData, int rowWidthInBytes,
+			PixelFormat sourcePixelFormat = PixelFormat::BGR24);
+
+		/// Write bytes of encoded diagram into the file.
+		static int writeData(const char * path, std::vector<uint8_t> * data);
+
+		/// Read the file and decode the diagram from it, see decode().
+		static int read(const char * path,
+			int32_t * width, int32_t * height, VoronoiDiagram ** diagram, Color24bit ** colors);
+
+		/// Read at most given count of bytes from the beginning of the file and decode the diagram from them, see decodePrefix().
+		static int readPrefix(const char * path, uint32_t maxSizeBytes,
+			int32_t * width, int32_t * height, VoronoiDiagram ** diagram, Color24bit ** colors);
+
+		/// Read only the header and points of the file needed for drawing given window, see decodeRegion().
+		static int readRegion(const char * path,
+			int32_t windowX, int32_t windowY, int32_t windowWidth, int32_t windowHeight,
+			int32_t * width, int32_t * height, VoronoiDiagram ** diagram, Color24bit ** colors);
+
+		/// Returns maximal count of points of diagram that always fits into given size.
+		/**
+			Colors are stored in palette of given size, or in points if the palette size is 0.
+			File contains tile index with given tile size if it is not 0.
+			Progressive file has no palette and tile index, it stores colors of all points after every level.
+			Colors have 1 channel in gray file and 3 channels otherwise.
+
+			Size of horizontal distances depends on positions of the points. Exp-Golomb code length
+			is bounded by a concave function of the distance and the distances sum to less than
+			the image width, so the distances are largest when points are spread evenly.
+			Such bound holds for any diagram with the returned count of points.
+		*/
+		static int calculateMaxDiagramPointsCount(uint32_t maxSizeBytes, int32_t width, int32_t height,
+			int paletteSize = 0, int32_t indexTileSize = 0, bool progressive = false, int channelsCount = 3);
+	};
+}
@@ -8,4 +8,35 @@ int32_t VoronoiDiagram::x(int index) {
 
 int32_t VoronoiDiagram::y(int index) {
 	return diagramPointsYCoordinates[index];
-}
\ No newline at end of file
+}
+
+void VoronoiDiagram::setPoint(int index, int32_t x, int32_t y) {
+	hash -= pointHash(diagramPointsXCoordinates[index], diagramPointsYCoordinates[index]);
+	diagramPointsXCoordinates[index] = x;
+	diagramPointsYCoordinates[index] = y;
+	hash += pointHash(x, y);
+}
+
+uint64_t VoronoiDiagram::getHash() {
+	return hash;
+}
+
+void VoronoiDiagram::copyHash(VoronoiDiagram * source) {
+	hash = source->hash;
+}
+
+void VoronoiDiagram::recalculateHash() {
+	hash = 0;
+	for (int i = 0; i < diagramPointsCount; ++i) {
+		hash += pointHash(diagramPointsXCoordinates[i], diagramPointsYCoordinates[i]);
+	}
+}
+
+uint64_t VoronoiDiagram::pointHash(int32_t x, int32_t y) {
+	// SplitMix64 finalizer of the packed coordinates
+	uint64_t h = (((uint64_t)(uint32_t)x) << 32) | (uint32_t)y;
+	h += 0x9E3779B97F4A7C15ULL;
+	h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+	return h ^ (h >> 31);
+}
@@ -12,6 +12,9 @@ namespace lossycompressor {
 	struct VoronoiDiagram{
 	private:
 		bool hasSelfAllocatedPoints;
+
+		// Sum of hashes of all points in the diagram
+		uint64_t hash;
 	public:
 		/// Count of points in the diagram.
 		const int32_t diagramPointsCount;
@@ -25,18 +28,21 @@ namespace lossycompressor {
 		/// Constructs new diagram.
 		/**
 			Automatically deallocates arrays of points in the diagram in the destructor.
+			All points are initially placed at (0, 0).
 
 			param[in] diagramPointsCount	Count of points in the diagram.
 		*/
 		VoronoiDiagram(int32_t diagramPointsCount)
 			: diagramPointsCount(diagramPointsCount),
-			diagramPointsXCoordinates(new int32_t[diagramPointsCount]),
-			diagramPointsYCoordinates(new int32_t[diagramPointsCount]),
-			hasSelfAllocatedPoints(true) {}
+			diagramPointsXCoordinates(new int32_t[diagramPointsCount]()),
+			diagramPointsYCoordinates(new int32_t[diagramPointsCount]()),
+			hasSelfAllocatedPoints(true),
+			hash(diagramPointsCount * pointHash(0, 0)) {}
 
 		/// Constructs new diagram.
 		/**
 			Points in the diagram will not be automatically deallocated.
+			Hash of the diagram is not calculated, call recalculateHash() if it is needed.
 
 			param[in] diagramPointsCount			Count of points in the diagram.
 			param[in] diagramPointsXCoordinates		Pointer to array of X coordinates of points in the diagram.
@@ -47,7 +53,8 @@ namespace lossycompressor {
 			: diagramPointsCount(diagramPointsCount),
 			diagramPointsXCoordinates(diagramPointsXCoordinates),
 			diagramPointsYCoordinates(diagramPointsYCoordinates),
-			hasSelfAllocatedPoints(false){}
+			hasSelfAllocatedPoints(false),
+			hash(0) {}
 
 		~VoronoiDiagram() {
 			if (hasSelfAllocatedPoints) {
@@ -61,5 +68,26 @@ namespace lossycompressor {
 
 		/// Returns Y coordinate of point on given index.
 		int32_t y(int index);
+
+		/// Sets coordinates of point on given index and updates the diagram hash.
+		void setPoint(int index, int32_t x, int32_t y);
+
+		/// Returns hash of the diagram.
+		/**
+			Hash is a sum of hashes of individual points (Zobrist-style), so it does not
+			depend on the order of points and it is updated in constant time when a point moves.
+			Coordinates must be changed only through setPoint() for the hash to stay valid,
+			reordering the points does not change it.
+		*/
+		uint64_t getHash();
+
+		/// Copies the hash from another diagram containing the same points.
+		void copyHash(VoronoiDiagram * source);
+
+		/// Calculates the hash of the diagram from all its points.
+		void recalculateHash();
+
+		/// Returns hash of a single point.
+		static uint64_t pointHash(int32_t x, int32_t y);
 	};
 }